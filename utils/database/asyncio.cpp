@@ -0,0 +1,319 @@
+#include "asyncio.hpp"
+#include "config.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <climits>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace DB;
+
+static int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+// NOTE: The ring heads and tails are shared with the kernel
+static unsigned load_acquire(unsigned *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(unsigned *value, unsigned to)
+{
+    __atomic_store_n(value, to, __ATOMIC_RELEASE);
+}
+
+AsyncIO::AsyncIO(int fd)
+    : m_fd(fd)
+{
+    if (getenv("DB_DISABLE_IO_URING"))
+        return;
+
+    if (!setup_ring())
+        close_ring();
+}
+
+AsyncIO::~AsyncIO()
+{
+    wait();
+    close_ring();
+}
+
+bool AsyncIO::setup_ring()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ring_fd = io_uring_setup(Config::io_queue_depth, &params);
+    if (m_ring_fd < 0)
+        return false;
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    // Newer kernels map both rings with one call
+    auto is_single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (is_single_mmap)
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+    auto map = [&](size_t size, off_t offset) -> void*
+    {
+        auto *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_ring_fd, offset);
+        return memory == MAP_FAILED ? nullptr : memory;
+    };
+
+    m_sq_ring = map(m_sq_ring_size, IORING_OFF_SQ_RING);
+    m_cq_ring = is_single_mmap ? m_sq_ring : map(m_cq_ring_size, IORING_OFF_CQ_RING);
+    m_sqes = map(m_sqes_size, IORING_OFF_SQES);
+    if (!m_sq_ring || !m_cq_ring || !m_sqes)
+        return false;
+
+    auto *sq = (char*)m_sq_ring;
+    m_sq_head = (unsigned*)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    m_sq_array = (unsigned*)(sq + params.sq_off.array);
+
+    auto *cq = (char*)m_cq_ring;
+    m_cq_head = (unsigned*)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    m_cqes = cq + params.cq_off.cqes;
+
+    // NOTE: There's never more in flight than there are submission
+    //       entries, so neither ring can overflow
+    m_slots.resize(params.sq_entries);
+    for (uint32_t i = 0; i < params.sq_entries; i++)
+        m_free_slots.push_back(params.sq_entries - i - 1);
+    return true;
+}
+
+void AsyncIO::close_ring()
+{
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ring && m_cq_ring != m_sq_ring)
+        munmap(m_cq_ring, m_cq_ring_size);
+    if (m_sq_ring)
+        munmap(m_sq_ring, m_sq_ring_size);
+    if (m_ring_fd >= 0)
+        close(m_ring_fd);
+
+    m_sqes = m_cq_ring = m_sq_ring = nullptr;
+    m_ring_fd = -1;
+    m_slots.clear();
+    m_free_slots.clear();
+}
+
+void AsyncIO::submit_reads(const std::vector<Request> &requests)
+{
+    submit(requests, false);
+}
+
+void AsyncIO::submit_writes(const std::vector<Request> &requests)
+{
+    submit(requests, true);
+}
+
+void AsyncIO::submit(const std::vector<Request> &requests, bool is_write)
+{
+    if (!uses_io_uring())
+    {
+        complete_vectored(requests, is_write);
+        return;
+    }
+
+    unsigned to_submit = 0;
+    for (const auto &request : requests)
+    {
+        // Make room by waiting for some of what's in flight
+        if (m_free_slots.empty())
+        {
+            enter(to_submit, 1);
+            to_submit = 0;
+            reap();
+        }
+
+        auto slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        m_slots[slot] = { request, is_write };
+
+        auto tail = *m_sq_tail;
+        auto index = tail & *m_sq_mask;
+        auto &sqe = ((io_uring_sqe*)m_sqes)[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = m_fd;
+        sqe.off = request.offset;
+        sqe.addr = (uint64_t)request.data;
+        sqe.len = request.size;
+        sqe.user_data = slot;
+
+        m_sq_array[index] = index;
+        store_release(m_sq_tail, tail + 1);
+        to_submit += 1;
+    }
+
+    if (to_submit)
+        enter(to_submit, 0);
+}
+
+void AsyncIO::enter(unsigned to_submit, unsigned min_complete)
+{
+    auto flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;)
+    {
+        auto submitted = io_uring_enter(m_ring_fd, to_submit, min_complete, flags);
+        if (submitted < 0 && errno == EINTR)
+            continue;
+
+        if (submitted < 0)
+        {
+            perror("io_uring_enter()");
+            m_has_failed = true;
+            return;
+        }
+
+        to_submit -= std::min(to_submit, (unsigned)submitted);
+        if (!to_submit)
+            return;
+    }
+}
+
+void AsyncIO::reap()
+{
+    auto head = *m_cq_head;
+    auto tail = load_acquire(m_cq_tail);
+    for (; head != tail; head++)
+    {
+        const auto &cqe = ((io_uring_cqe*)m_cqes)[head & *m_cq_mask];
+        auto slot = (uint32_t)cqe.user_data;
+        auto [request, is_write] = m_slots[slot];
+        m_free_slots.push_back(slot);
+
+        // NOTE: Failed requests (such as an op the kernel doesn't support)
+        //       are retried synchronously, as is the rest of a short one
+        if (cqe.res < 0)
+        {
+            complete_synchronously(request, is_write);
+        }
+        else if ((size_t)cqe.res < request.size)
+        {
+            complete_synchronously({ request.offset + cqe.res,
+                request.data + cqe.res, request.size - cqe.res }, is_write);
+        }
+    }
+
+    store_release(m_cq_head, head);
+}
+
+bool AsyncIO::wait()
+{
+    while (uses_io_uring() && in_flight() > 0 && !m_has_failed)
+    {
+        enter(0, in_flight());
+        reap();
+    }
+
+    auto ok = !m_has_failed;
+    m_has_failed = false;
+    return ok;
+}
+
+void AsyncIO::complete_vectored(std::vector<Request> requests, bool is_write)
+{
+    // NOTE: Requests next to each other in the file are done with one call
+    std::sort(requests.begin(), requests.end(), [](const auto &a, const auto &b)
+    {
+        return a.offset < b.offset;
+    });
+
+    size_t start = 0;
+    while (start < requests.size())
+    {
+        auto end = start + 1;
+        while (end < requests.size() && end - start < IOV_MAX &&
+            requests[end].offset == requests[end - 1].offset + requests[end - 1].size)
+        {
+            end += 1;
+        }
+
+        if (end - start == 1)
+        {
+            complete_synchronously(requests[start], is_write);
+            start = end;
+            continue;
+        }
+
+        std::vector<iovec> iov;
+        size_t total_size = 0;
+        for (size_t i = start; i < end; i++)
+        {
+            iov.push_back({ requests[i].data, requests[i].size });
+            total_size += requests[i].size;
+        }
+
+        ssize_t result;
+        do
+        {
+            result = is_write
+                ? pwritev(m_fd, iov.data(), iov.size(), requests[start].offset)
+                : preadv(m_fd, iov.data(), iov.size(), requests[start].offset);
+        } while (result < 0 && errno == EINTR);
+
+        // Finish anything left over one request at a time
+        size_t done = std::max(result, (ssize_t)0);
+        for (size_t i = start; i < end && done < total_size; i++)
+        {
+            auto request = requests[i];
+            if (done >= request.size)
+            {
+                done -= request.size;
+                total_size -= request.size;
+                continue;
+            }
+
+            complete_synchronously({ request.offset + done,
+                request.data + done, request.size - done }, is_write);
+            total_size -= request.size;
+            done = 0;
+        }
+
+        start = end;
+    }
+}
+
+void AsyncIO::complete_synchronously(Request request, bool is_write)
+{
+    size_t done = 0;
+    while (done < request.size)
+    {
+        auto result = is_write
+            ? pwrite(m_fd, request.data + done, request.size - done, request.offset + done)
+            : pread(m_fd, request.data + done, request.size - done, request.offset + done);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+        {
+            perror(is_write ? "pwrite()" : "pread()");
+            m_has_failed = true;
+            return;
+        }
+
+        done += result;
+    }
+}
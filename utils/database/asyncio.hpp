@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DB
+{
+
+    // Batches of positional reads and writes on a file. These are submitted
+    // through io_uring, so they can run while the caller gets on with
+    // something else. When io_uring is unavailable, or disabled with the
+    // DB_DISABLE_IO_URING environment variable, requests are done when
+    // they're submitted instead, with neighbouring ones done in one preadv/pwritev.
+    // NOTE: Requests in flight together may complete in any order, so writes
+    //       in the same batch must not overlap
+    class AsyncIO
+    {
+    public:
+        struct Request
+        {
+            size_t offset;
+            char *data;
+            size_t size;
+        };
+
+        explicit AsyncIO(int fd);
+        ~AsyncIO();
+
+        AsyncIO(const AsyncIO&) = delete;
+        AsyncIO(AsyncIO&) = delete;
+
+        // NOTE: The buffers have to stay valid until wait() returns
+        void submit_reads(const std::vector<Request>&);
+        void submit_writes(const std::vector<Request>&);
+
+        // Wait for everything submitted so far, returns false if any request failed
+        bool wait();
+
+        inline bool uses_io_uring() const { return m_ring_fd >= 0; }
+        inline size_t in_flight() const { return m_slots.size() - m_free_slots.size(); }
+
+    private:
+        struct Slot
+        {
+            Request request;
+            bool is_write;
+        };
+
+        bool setup_ring();
+        void close_ring();
+        void submit(const std::vector<Request>&, bool is_write);
+        void enter(unsigned to_submit, unsigned min_complete);
+        void reap();
+        void complete_vectored(std::vector<Request>, bool is_write);
+        void complete_synchronously(Request, bool is_write);
+
+        int m_fd;
+        int m_ring_fd { -1 };
+        bool m_has_failed { false };
+        std::vector<Slot> m_slots;
+        std::vector<uint32_t> m_free_slots;
+
+        // Shared with the kernel
+        void *m_sq_ring { nullptr };
+        void *m_cq_ring { nullptr };
+        void *m_sqes { nullptr };
+        size_t m_sq_ring_size { 0 };
+        size_t m_cq_ring_size { 0 };
+        size_t m_sqes_size { 0 };
+
+        unsigned *m_sq_head { nullptr };
+        unsigned *m_sq_tail { nullptr };
+        unsigned *m_sq_mask { nullptr };
+        unsigned *m_sq_array { nullptr };
+        unsigned *m_cq_head { nullptr };
+        unsigned *m_cq_tail { nullptr };
+        unsigned *m_cq_mask { nullptr };
+        void *m_cqes { nullptr };
+
+    };
+
+}
@@ -0,0 +1,227 @@
+#include "database.hpp"
+#include <libjson/libjson.hpp>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <getopt.h>
+using namespace DB;
+
+static struct option cmd_options[] =
+{
+    { "help",       no_argument,        0, 'h' },
+    { "sizes",      required_argument,  0, 's' },
+    { "queries",    required_argument,  0, 'q' },
+    { "directory",  required_argument,  0, 'd' },
+    { "compress",   no_argument,        0, 'c' },
+    { 0, 0, 0, 0 },
+};
+
+void show_help()
+{
+    std::cout << "usage: database_bench [-h] [-s sizes] [-q count] [-d dir] [-c]\n";
+    std::cout << "\nBenchmark the database, outputting the results as JSON\n";
+    std::cout << "\noptional arguments:\n";
+    std::cout << "  -h, --help\t\tShow this help message and exit\n";
+    std::cout << "  -s, --sizes\t\tComma separated row counts (default 1000,100000,1000000)\n";
+    std::cout << "  -q, --queries\t\tNumber of point queries to average over (default 10)\n";
+    std::cout << "  -d, --directory\tWhere to create the benchmark databases (default /tmp)\n";
+    std::cout << "  -c, --compress\tCompress sealed row data chunks\n";
+}
+
+struct Options
+{
+    std::vector<size_t> sizes { 1000, 100000, 1000000 };
+    size_t query_count { 10 };
+    std::string directory { "/tmp" };
+    bool compress { false };
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Run a query, exiting if it fails, so we don't report timings of errors
+static SqlResult run(DataBase &db, const std::string &query)
+{
+    auto result = db.execute_sql(query);
+    if (!result.good())
+    {
+        result.output_errors();
+        exit(1);
+    }
+
+    return result;
+}
+
+static size_t count_rows(const SqlResult &result)
+{
+    return std::distance(result.begin(), result.end());
+}
+
+// Same schema as debtorsbook
+static void create_table(DataBase &db)
+{
+    run(db, "CREATE TABLE Debts ("
+        "    id Integer,"
+        "    datetime BigInt,"
+        "    person Char(80),"
+        "    transaction Char(80),"
+        "    owedbyme Float,"
+        "    owedbythem Float)");
+}
+
+static std::string insert_query(size_t i)
+{
+    static const char *people[] = { "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi" };
+    static const char *transactions[] = { "lunch", "rent", "tickets", "shopping", "taxi" };
+
+    return "INSERT INTO Debts (id, datetime, person, transaction, owedbyme, owedbythem) VALUES ("
+        + std::to_string(i) + ", "
+        + std::to_string(1600000000 + i * 60) + ", "
+        + "'" + people[i % 8] + "', "
+        + "'" + transactions[i % 5] + "', "
+        + std::to_string((i * 7) % 100) + ".5, "
+        + std::to_string((i * 3) % 50) + ".25)";
+}
+
+static Json::Value bench_size(size_t row_count, const Options &options)
+{
+    auto path = options.directory + "/database_bench_" + std::to_string(row_count) + ".db";
+    std::filesystem::remove(path);
+
+    auto result = Json::object();
+    result["rows"] = Json::number(row_count);
+
+    // NOTE: The ids are spread over the table, so point queries
+    //       don't all hit the start or end of it
+    auto point_id = [&](size_t i)
+    {
+        return (i * 7919 + 13) % row_count;
+    };
+
+    {
+        auto db = DataBase::open(path);
+        db->set_compress_sealed_chunks(options.compress);
+        create_table(*db);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < row_count; i++)
+            run(*db, insert_query(i));
+
+        auto time = seconds_since(start);
+        result["insert_seconds"] = Json::number(time);
+        result["insert_rows_per_second"] = Json::number(row_count / time);
+    }
+
+    result["file_size_bytes"] = Json::number(std::filesystem::file_size(path));
+
+    auto start = std::chrono::steady_clock::now();
+    auto db = DataBase::open(path);
+    db->set_compress_sealed_chunks(options.compress);
+    result["open_seconds"] = Json::number(seconds_since(start));
+
+    {
+        start = std::chrono::steady_clock::now();
+        auto rows = count_rows(run(*db, "SELECT * FROM Debts"));
+        auto time = seconds_since(start);
+        result["full_scan_seconds"] = Json::number(time);
+        result["full_scan_rows_per_second"] = Json::number(rows / time);
+    }
+
+    {
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < options.query_count; i++)
+            run(*db, "SELECT * FROM Debts WHERE id = " + std::to_string(point_id(i)));
+        result["point_select_seconds"] = Json::number(seconds_since(start) / options.query_count);
+    }
+
+    {
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < options.query_count; i++)
+            run(*db, "UPDATE Debts SET owedbyme = 1.5 WHERE id = " + std::to_string(point_id(i)));
+        result["update_seconds"] = Json::number(seconds_since(start) / options.query_count);
+    }
+
+    {
+        // NOTE: Deleting shifts every row after the one removed,
+        //       so this deletes from the end of the table
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < options.query_count && i < row_count; i++)
+            run(*db, "DELETE FROM Debts WHERE id = " + std::to_string(row_count - i - 1));
+        result["delete_seconds"] = Json::number(seconds_since(start) / options.query_count);
+    }
+
+    const auto &page_cache = db->page_cache();
+    result["page_cache_hits"] = Json::number(page_cache.hits());
+    result["page_cache_misses"] = Json::number(page_cache.misses());
+
+    db = nullptr;
+    std::filesystem::remove(path);
+    return result;
+}
+
+static std::vector<size_t> parse_sizes(const std::string &sizes)
+{
+    std::vector<size_t> out;
+    std::stringstream stream(sizes);
+    std::string size;
+    while (std::getline(stream, size, ','))
+        out.push_back(std::stoul(size));
+
+    return out;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (;;)
+    {
+        int option_index;
+        int c = getopt_long(argc, argv, "hs:q:d:c",
+            cmd_options, &option_index);
+
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'h':
+                show_help();
+                return 0;
+            case 's':
+                options.sizes = parse_sizes(optarg);
+                break;
+            case 'q':
+                options.query_count = std::max(std::stoul(optarg), 1ul);
+                break;
+            case 'd':
+                options.directory = optarg;
+                break;
+            case 'c':
+                options.compress = true;
+                break;
+            default:
+                show_help();
+                return 1;
+        }
+    }
+
+    auto results = Json::object();
+    results["version"] = Json::string(
+        std::to_string(Config::major_version) + "." + std::to_string(Config::minor_version));
+    results["compress_sealed_chunks"] = Json::boolean(options.compress);
+    results["query_count"] = Json::number(options.query_count);
+
+    auto sizes = Json::array();
+    for (auto size : options.sizes)
+    {
+        std::cerr << "Benchmarking " << size << " rows\n";
+        sizes.append(bench_size(size, options));
+    }
+    results["sizes"] = std::move(sizes);
+
+    std::cout << results.pretty_print() << "\n";
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "checksum.hpp"
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+using namespace DB;
+
+// The CRC32C polynomial, bit reversed
+static constexpr uint32_t polynomial = 0x82F63B78;
+
+struct LookupTable
+{
+    uint32_t entries[256];
+};
+
+static constexpr LookupTable make_lookup_table()
+{
+    LookupTable table {};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+        table.entries[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr auto lookup_table = make_lookup_table();
+
+static uint32_t crc32c_table(const char *data, size_t size, uint32_t crc)
+{
+    for (size_t i = 0; i < size; i++)
+        crc = lookup_table.entries[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(const char *data, size_t size, uint32_t crc)
+{
+    uint64_t crc64 = crc;
+    for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(uint64_t));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t)crc64;
+    for (size_t i = 0; i < size; i++)
+        crc = _mm_crc32_u8(crc, (uint8_t)data[i]);
+    return crc;
+}
+#endif
+
+uint32_t Checksum::crc32c(const char *data, size_t size, uint32_t crc)
+{
+    crc = ~crc;
+#if defined(__x86_64__)
+    static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+    if (has_sse42)
+        return ~crc32c_sse42(data, size, crc);
+#endif
+
+    return ~crc32c_table(data, size, crc);
+}
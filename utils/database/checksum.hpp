@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace DB::Checksum
+{
+
+    // CRC32C (Castagnoli), with the SSE4.2 crc32 instruction when the CPU
+    // has it, or a lookup table otherwise. Passing in the result for the
+    // data before carries it on, so a chunk can be checksummed in parts.
+    uint32_t crc32c(const char *data, size_t size, uint32_t crc = 0);
+
+}
@@ -1,19 +1,43 @@
 #include "chunk.hpp"
+#include "checksum.hpp"
 #include "config.hpp"
 #include "database.hpp"
+#include "pagecache.hpp"
 #include <cassert>
+#include <cstring>
 using namespace DB;
 
 Chunk::Chunk(DB::DataBase& db, size_t header_offset)
     : m_db(db)
     , m_header_offset(header_offset)
 {
-    db.read_string(header_offset, m_type, 2);
-    m_owner_id = db.read_byte(header_offset + 2);
-    m_index = db.read_byte(header_offset + 3);
-    m_size_in_bytes = db.read_int(header_offset + 4);
-    m_padding_in_bytes = db.read_int(header_offset + 8);
+    char header[Config::chunk_header_size];
+    db.read_string(header_offset, header, sizeof(header));
+
+    auto get = [&](size_t offset, auto &value)
+    {
+        memcpy(&value, header + offset, sizeof(value));
+    };
+
+    uint64_t size_in_bytes, padding_in_bytes, raw_size_in_bytes;
+    memcpy(m_type, header, 2);
+    get(codec_offset, m_codec);
+    get(flags_offset, m_flags);
+    get(owner_id_offset, m_owner_id);
+    get(index_offset, m_index);
+    get(generation_offset, m_generation);
+    get(size_offset, size_in_bytes);
+    get(padding_offset, padding_in_bytes);
+    get(raw_size_offset, raw_size_in_bytes);
+    get(checksum_offset, m_checksum);
+    m_size_in_bytes = size_in_bytes;
+    m_padding_in_bytes = padding_in_bytes;
+    m_raw_size_in_bytes = raw_size_in_bytes;
     m_data_offset = header_offset + Config::chunk_header_size;
+
+    // NOTE: Chunks written before there were checksums get one the next time they change
+    m_has_been_verified = !(m_flags & has_checksum_flag);
+    m_is_checksum_stale = true;
 }
 
 size_t Chunk::header_size() const
@@ -27,27 +51,72 @@ bool Chunk::is_active() const
     return m_db.m_active_chunk.get() == this;
 }
 
+std::vector<char> &Chunk::cached_data()
+{
+    return m_db.m_page_cache.data(*this);
+}
+
 uint8_t Chunk::read_byte(size_t offset)
 {
     assert (!m_has_been_dropped);
+    if (is_compressed())
+        return cached_data()[offset];
+    verify_checksum();
+    if (auto *data = m_db.m_page_cache.find(*this, offset, 1))
+        return *data;
+
     return m_db.read_byte(m_data_offset + offset);
 }
 
 int Chunk::read_int(size_t offset)
 {
     assert (!m_has_been_dropped);
+    if (is_compressed())
+    {
+        int i;
+        memcpy(&i, cached_data().data() + offset, sizeof(int));
+        return i;
+    }
+    verify_checksum();
+    if (auto *data = m_db.m_page_cache.find(*this, offset, sizeof(int)))
+    {
+        int i;
+        memcpy(&i, data, sizeof(int));
+        return i;
+    }
+
     return m_db.read_int(m_data_offset + offset);
 }
 
 int64_t Chunk::read_long(size_t offset)
 {
     assert (!m_has_been_dropped);
+    if (is_compressed())
+    {
+        int64_t l;
+        memcpy(&l, cached_data().data() + offset, sizeof(int64_t));
+        return l;
+    }
+    verify_checksum();
+    if (auto *data = m_db.m_page_cache.find(*this, offset, sizeof(int64_t)))
+    {
+        int64_t l;
+        memcpy(&l, data, sizeof(int64_t));
+        return l;
+    }
+
     return m_db.read_long(m_data_offset + offset);
 }
 
 std::string Chunk::read_string(size_t offset, size_t len)
 {
     assert (!m_has_been_dropped);
+    if (is_compressed())
+        return std::string(cached_data().data() + offset, len);
+    verify_checksum();
+    if (auto *data = m_db.m_page_cache.find(*this, offset, len))
+        return std::string(data, len);
+
     std::vector<char> buffer(len);
     m_db.read_string(m_data_offset + offset, buffer.data(), len);
     return std::string(buffer.data(), buffer.size());
@@ -55,58 +124,223 @@ std::string Chunk::read_string(size_t offset, size_t len)
 
 void Chunk::check_size(size_t size)
 {
+    if (is_compressed())
+    {
+        // NOTE: Compressed chunks are written back from
+        //       the page cache, so only the raw size changes here
+        if (size > m_raw_size_in_bytes)
+        {
+            m_db.check_is_active_chunk(this);
+            m_db.m_page_cache.resize(*this, size);
+            m_raw_size_in_bytes = size;
+        }
+        return;
+    }
+
+    if (size <= m_size_in_bytes)
+        return;
+
+    // Grow into the reserved padding first, only the
+    // active chunk can grow past the end of it
     if (size > m_size_in_bytes + m_padding_in_bytes)
     {
         m_db.check_is_active_chunk(this);
-        m_size_in_bytes = size;
-        m_db.write_int(m_header_offset + 4, m_size_in_bytes);
+        m_padding_in_bytes = 0;
     }
+    else
+    {
+        m_padding_in_bytes -= size - m_size_in_bytes;
+    }
+
+    m_size_in_bytes = size;
+    m_db.write_long(m_header_offset + size_offset, m_size_in_bytes);
+    m_db.write_long(m_header_offset + padding_offset, m_padding_in_bytes);
+}
+
+void Chunk::mark_modified()
+{
+    // NOTE: This is how incremental snapshots find what's changed since the last one
+    if (m_generation == m_db.m_generation)
+        return;
+
+    m_generation = m_db.m_generation;
+    m_db.write_int(m_header_offset + generation_offset, m_generation);
+}
+
+void Chunk::verify_checksum()
+{
+    // NOTE: Reading the chunk into the page cache checks it, compressed
+    //       chunks always go through there before they're used anyway
+    if (m_has_been_verified || is_compressed())
+        return;
+
+    m_db.m_page_cache.load(*this);
+    assert (m_has_been_verified);
+}
+
+void Chunk::update_checksum(size_t offset, const char *data, size_t size)
+{
+    // Writes from the start or onto the end carry the checksum on as they go,
+    // anything after what it covers is read back on flush. Only rewriting what
+    // it already covers means it has to be worked out again from scratch.
+    if (offset == 0)
+    {
+        m_checksum = Checksum::crc32c(data, size);
+        m_checksummed_size = size;
+        m_is_checksum_stale = false;
+    }
+    else if (offset == m_checksummed_size && !m_is_checksum_stale)
+    {
+        m_checksum = Checksum::crc32c(data, size, m_checksum);
+        m_checksummed_size += size;
+    }
+    else if (offset < m_checksummed_size)
+    {
+        m_is_checksum_stale = true;
+    }
+
+    m_db.mark_checksum_changed(*this);
+}
+
+void Chunk::encode_header(char *header) const
+{
+    auto put = [&](size_t offset, auto value)
+    {
+        memcpy(header + offset, &value, sizeof(value));
+    };
+
+    memcpy(header, m_type, 2);
+    put(codec_offset, m_codec);
+    put(flags_offset, m_flags);
+    put(owner_id_offset, m_owner_id);
+    put(index_offset, m_index);
+    put(generation_offset, m_generation);
+    put(size_offset, (uint64_t)m_size_in_bytes);
+    put(padding_offset, (uint64_t)m_padding_in_bytes);
+    put(raw_size_offset, (uint64_t)m_raw_size_in_bytes);
+}
+
+uint32_t Chunk::stored_checksum() const
+{
+    // NOTE: The header's covered as well, so a damaged size or type is caught too
+    char header[checksum_offset];
+    encode_header(header);
+    return Checksum::crc32c(header, sizeof(header), m_checksum);
+}
+
+bool Chunk::can_grow_by(size_t size) const
+{
+    if (is_compressed())
+        return false;
+
+    return is_active() || m_padding_in_bytes >= size;
 }
 
 void Chunk::write_byte(size_t offset, uint8_t byte)
 {
     assert (!m_has_been_dropped);
+    verify_checksum();
+    mark_modified();
     check_size(offset + 1);
+    if (is_compressed())
+    {
+        cached_data()[offset] = byte;
+        m_db.m_page_cache.mark_dirty(*this);
+        return;
+    }
+
+    m_db.m_page_cache.write_through(*this, offset, (const char*)&byte, 1);
     m_db.write_byte(m_data_offset + offset, byte);
+    update_checksum(offset, (const char*)&byte, 1);
 }
 
 void Chunk::write_int(size_t offset, int i)
 {
     assert (!m_has_been_dropped);
+    verify_checksum();
+    mark_modified();
     check_size(offset + 4);
+    if (is_compressed())
+    {
+        memcpy(cached_data().data() + offset, &i, 4);
+        m_db.m_page_cache.mark_dirty(*this);
+        return;
+    }
+
+    m_db.m_page_cache.write_through(*this, offset, (const char*)&i, 4);
     m_db.write_int(m_data_offset + offset, i);
+    update_checksum(offset, (const char*)&i, 4);
 }
 
 void Chunk::write_long(size_t offset, int64_t l)
 {
     assert (!m_has_been_dropped);
+    verify_checksum();
+    mark_modified();
     check_size(offset + 8);
+    if (is_compressed())
+    {
+        memcpy(cached_data().data() + offset, &l, 8);
+        m_db.m_page_cache.mark_dirty(*this);
+        return;
+    }
+
+    m_db.m_page_cache.write_through(*this, offset, (const char*)&l, 8);
     m_db.write_long(m_data_offset + offset, l);
+    update_checksum(offset, (const char*)&l, 8);
 }
 
 void Chunk::write_string(size_t offset, const std::string &str)
 {
     assert (!m_has_been_dropped);
+    verify_checksum();
+    mark_modified();
     check_size(offset + str.size());
+    if (is_compressed())
+    {
+        memcpy(cached_data().data() + offset, str.data(), str.size());
+        m_db.m_page_cache.mark_dirty(*this);
+        return;
+    }
+
+    m_db.m_page_cache.write_through(*this, offset, str.data(), str.size());
     m_db.write_string(m_data_offset + offset, str);
+    update_checksum(offset, str.data(), str.size());
 }
 
 void Chunk::drop()
 {
+    mark_modified();
+    m_db.m_page_cache.evict(*this);
+
     m_db.write_string(m_header_offset, "RM");
     m_has_been_dropped = true;
 }
 
 void Chunk::shrink_to(size_t offset)
 {
-    m_padding_in_bytes = m_size_in_bytes - offset;
+    verify_checksum();
+    mark_modified();
+    if (is_compressed())
+    {
+        m_db.m_page_cache.resize(*this, offset);
+        m_raw_size_in_bytes = offset;
+        return;
+    }
+
+    // NOTE: Any space already reserved is kept, so the chunk can grow back into it
+    m_db.m_page_cache.evict(*this);
+    auto removed = m_size_in_bytes - offset;
+    m_padding_in_bytes += removed;
     m_size_in_bytes = offset;
 
-    m_db.write_int(m_header_offset + 4, m_size_in_bytes);
-    m_db.write_int(m_header_offset + 8, m_padding_in_bytes);
+    m_db.write_long(m_header_offset + size_offset, m_size_in_bytes);
+    m_db.write_long(m_header_offset + padding_offset, m_padding_in_bytes);
+    m_db.write_string(m_data_offset + m_size_in_bytes, std::string(removed, (char)0xCD));
 
-    for (size_t i = m_size_in_bytes; i < m_padding_in_bytes; i++)
-        write_byte(i, 0xCD);
+    if (m_checksummed_size > m_size_in_bytes)
+        m_is_checksum_stale = true;
+    m_db.mark_checksum_changed(*this);
 }
 
 std::ostream &operator <<(std::ostream &stream, const Chunk &chunk)
@@ -118,4 +352,3 @@ std::ostream &operator <<(std::ostream &stream, const Chunk &chunk)
         ", index = " << chunk.index() << " }";
     return stream;
 }
-
@@ -1,30 +1,57 @@
 #pragma once
 #include "forward.hpp"
+#include "compression.hpp"
 #include <string>
+#include <vector>
 
 namespace DB
 {
 
+    // Chunk header layout, all values are little endian:
+    //   0   type (2 bytes)
+    //   2   codec (u8)
+    //   3   flags (u8), see has_checksum_flag
+    //   4   owner id (u32)
+    //   8   index (u32)
+    //   12  generation it was last modified in (u32)
+    //   16  size in bytes (u64)
+    //   24  padding in bytes (u64)
+    //   32  raw size in bytes, if compressed (u64)
+    //   40  CRC32C of the stored data then the header up to here, if flagged (u32)
+    //   44  reserved (u32)
+    //
+    // The checksum is kept up to date as the chunk is written, and written
+    // to the header on flush. It's checked the first time the chunk's read.
     class Chunk
     {
         friend DataBase;
         friend DynamicData;
+        friend PageCache;
 
     public:
+        static constexpr uint8_t has_checksum_flag = 1;
+
         Chunk(const Chunk&) = delete;
         Chunk(Chunk&) = delete;
 
         inline std::string_view type() const { return std::string_view(m_type, 2); }
         inline size_t data_offset() const { return m_data_offset; }
-        inline size_t size_in_bytes() const { return m_size_in_bytes; }
+        inline size_t size_in_bytes() const { return is_compressed() ? m_raw_size_in_bytes : m_size_in_bytes; }
+        inline size_t stored_size_in_bytes() const { return m_size_in_bytes; }
         inline size_t padding_in_bytes() const { return m_padding_in_bytes; }
         inline size_t owner_id() const { return m_owner_id; }
         inline size_t index() const { return m_index; }
+        inline uint32_t generation() const { return m_generation; }
         inline void increment_index(int by) { m_index += by; }
         inline DataBase &db() { return m_db; }
+        inline bool is_compressed() const { return m_codec != Compression::None; }
         size_t header_size() const;
         bool is_active() const;
 
+        // Whether data can be appended without moving the chunk, either
+        // into its reserved padding, or because it's at the end of the file
+        bool can_grow_by(size_t size) const;
+
         uint8_t read_byte(size_t offset);
         int read_int(size_t offset);
         int64_t read_long(size_t offset);
@@ -45,7 +72,25 @@ namespace DB
         Chunk(DataBase& db)
             : m_db(db) {}
 
+        static constexpr size_t codec_offset = 2;
+        static constexpr size_t flags_offset = 3;
+        static constexpr size_t owner_id_offset = 4;
+        static constexpr size_t index_offset = 8;
+        static constexpr size_t generation_offset = 12;
+        static constexpr size_t size_offset = 16;
+        static constexpr size_t padding_offset = 24;
+        static constexpr size_t raw_size_offset = 32;
+        static constexpr size_t checksum_offset = 40;
+
         void check_size(size_t size);
+        void mark_modified();
+        void verify_checksum();
+        void update_checksum(size_t offset, const char *data, size_t size);
+
+        // The header up to the checksum, and the checksum that goes after it
+        void encode_header(char *header) const;
+        uint32_t stored_checksum() const;
+        std::vector<char> &cached_data();
 
         DataBase &m_db;
         size_t m_header_offset;
@@ -54,10 +99,24 @@ namespace DB
         char m_type[2];
         size_t m_size_in_bytes { 0 };
         size_t m_padding_in_bytes { 0 };
-        uint8_t m_owner_id { 0xCD };
-        uint8_t m_index { 0xCD };
+        uint32_t m_owner_id { 0xCDCDCDCD };
+        uint32_t m_index { 0xCDCDCDCD };
+        uint8_t m_codec { Compression::None };
+        uint32_t m_generation { 0 };
+        size_t m_raw_size_in_bytes { 0 };
         bool m_has_been_dropped { false };
 
+        // The checksum of the first m_checksummed_size bytes of stored data,
+        // or of nothing in particular once it's stale. Until the chunk's been
+        // verified, it's the stored checksum read from the header instead.
+        uint8_t m_flags { has_checksum_flag };
+        uint32_t m_checksum { 0 };
+        size_t m_checksummed_size { 0 };
+        bool m_is_checksum_stale { false };
+        bool m_is_checksum_changed { false };
+        bool m_has_been_verified { true };
+        bool m_has_failed_checksum { false };
+
     };
 
 }
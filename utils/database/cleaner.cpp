@@ -1,6 +1,17 @@
 #include "config.hpp"
 #include "cleaner.hpp"
+#include "asyncio.hpp"
+#include "checksum.hpp"
+#include "chunk.hpp"
+#include "compression.hpp"
+#include "database.hpp"
+#include "entry.hpp"
 #include <cassert>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -36,6 +47,32 @@ static void read_int(std::istream &in, size_t &out)
     out |= in.get() << 8*3;
 }
 
+static void read_long(std::istream &in, size_t &out)
+{
+    uint64_t l = 0;
+    in.read((char*)&l, sizeof(uint64_t));
+    out = l;
+}
+
+template <typename T>
+static void append(std::vector<char> &out, T value)
+{
+    auto *bytes = (const char*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Partitioned tables have the partitioning after their columns, see 'Table::write_header'
+static bool is_partitioned(const std::vector<char> &header)
+{
+    size_t offset = 1 + (uint8_t)header[0];
+    auto column_count = (uint8_t)header[offset];
+    offset += 1 + sizeof(int64_t);
+
+    for (size_t i = 0; i < column_count; i++)
+        offset += 1 + (uint8_t)header[offset] + 2;
+    return offset < header.size();
+}
+
 void Cleaner::output_info()
 {
     if (!m_has_been_processed)
@@ -45,12 +82,19 @@ void Cleaner::output_info()
     {
         std::cout << "Chunk "
             << "type = " << std::string_view(chunk.type, 2) << ", "
-            << "owner_id = " << (int)chunk.owner_id << ", "
-            << "index = " << (int)chunk.index << ", "
+            << "owner_id = " << chunk.owner_id << ", "
+            << "index = " << chunk.index << ", "
+            << "generation = " << chunk.generation << ", "
             << "size = " << chunk.size_in_bytes << ", "
-            << "padding = " << chunk.padding_in_bytes << "\n";
+            << "padding = " << chunk.padding_in_bytes;
+        if (chunk.codec != Compression::None)
+            std::cout << ", compressed from = " << chunk.raw_size_in_bytes;
+        if (chunk.flags & DB::Chunk::has_checksum_flag)
+            std::cout << ", checksum = " << chunk.checksum;
+        std::cout << "\n";
     };
 
+    std::cout << "Version " << m_major_version << "\n";
     if (m_version)
         print_chunk(*m_version);
     
@@ -71,13 +115,43 @@ void Cleaner::output_info()
             std::cout << "\t\t";
             print_chunk(chunk);
         }
+
+        if (table.stats)
+        {
+            std::cout << "\tStats:\n\t\t";
+            print_chunk(*table.stats);
+        }
+
+        if (!table.indexes.empty())
+        {
+            std::cout << "\tIndexes:\n";
+            for (const auto &chunk : table.indexes)
+            {
+                std::cout << "\t\t";
+                print_chunk(chunk);
+            }
+        }
     }
 }
 
+size_t Cleaner::header_size() const
+{
+    if (m_major_version == 1)
+        return Config::v1_chunk_header_size;
+    return Config::chunk_header_size;
+}
+
 void Cleaner::process_data_base()
 {
+    auto fd = open(m_in_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        m_major_version = DataBase::read_major_version(fd);
+        close(fd);
+    }
+
     std::ifstream in(m_in_path, std::ifstream::binary);
-    auto find_table = [&](uint8_t id) -> Table&
+    auto find_table = [&](uint32_t id) -> Table&
     {
         for (auto &table : m_tables)
         {
@@ -99,11 +173,38 @@ void Cleaner::process_data_base()
         chunk.offset = index;
         chunk.type[0] = c;
         chunk.type[1] = in.get();
-        chunk.owner_id = in.get();
-        chunk.index = in.get();
-        read_int(in, chunk.size_in_bytes);
-        read_int(in, chunk.padding_in_bytes);
+        if (m_major_version == 1)
+        {
+            chunk.owner_id = in.get();
+            chunk.index = in.get();
+            chunk.generation = 0;
+            read_int(in, chunk.size_in_bytes);
+            read_int(in, chunk.padding_in_bytes);
+            chunk.codec = in.get();
+            in.ignore(3);
+            read_int(in, chunk.raw_size_in_bytes);
+            chunk.flags = 0;
+            chunk.checksum = 0;
+        }
+        else
+        {
+            size_t owner_id, index, generation, checksum;
+            chunk.codec = in.get();
+            chunk.flags = in.get();
+            read_int(in, owner_id);
+            read_int(in, index);
+            read_int(in, generation);
+            read_long(in, chunk.size_in_bytes);
+            read_long(in, chunk.padding_in_bytes);
+            read_long(in, chunk.raw_size_in_bytes);
+            read_int(in, checksum);
+            chunk.owner_id = owner_id;
+            chunk.index = index;
+            chunk.generation = generation;
+            chunk.checksum = checksum;
+        }
 
+        m_generation = std::max(m_generation, chunk.generation);
         auto type_str = std::string_view(chunk.type, 2);
         if (type_str == "VR")
             m_version = chunk;
@@ -113,8 +214,12 @@ void Cleaner::process_data_base()
             find_table(chunk.owner_id).row_data.push_back(chunk);
         else if (type_str == "DY")
             find_table(chunk.owner_id).dynamic.push_back(chunk);
+        else if (type_str == "ST")
+            find_table(chunk.owner_id).stats = chunk;
+        else if (type_str == "TI")
+            find_table(chunk.owner_id).indexes.push_back(chunk);
 
-        index += Config::chunk_header_size;
+        index += header_size();
         index += chunk.size_in_bytes;
         index += chunk.padding_in_bytes;
         in.seekg(index);
@@ -123,54 +228,79 @@ void Cleaner::process_data_base()
     m_has_been_processed = true;
 }
 
+std::vector<char> Cleaner::read_chunk_body(std::istream &in, const Chunk &chunk) const
+{
+    in.clear();
+    in.seekg(chunk.offset + header_size(), std::ifstream::beg);
+
+    std::vector<char> data(chunk.size_in_bytes);
+    in.read(data.data(), data.size());
+    if (chunk.codec == Compression::None)
+        return data;
+
+    // NOTE: What's damaged is reported and copied as zeros, rather than ending the clean up
+    std::vector<char> raw_data(chunk.raw_size_in_bytes);
+    if (!Compression::decompress(data.data(), data.size(), raw_data.data(), raw_data.size()))
+    {
+        std::cerr << "Cleaner: Chunk at " << chunk.offset << " can't be decompressed\n";
+        std::fill(raw_data.begin(), raw_data.end(), 0);
+    }
+
+    return raw_data;
+}
+
+void Cleaner::write_chunk(std::ostream &out, Chunk chunk, const std::vector<char> &body) const
+{
+    // NOTE: Chunks are always written out decompressed and
+    //       without padding, in the current format
+    std::vector<char> header;
+    header.insert(header.end(), chunk.type, chunk.type + 2);
+    append<uint8_t>(header, Compression::None);
+    append<uint8_t>(header, DB::Chunk::has_checksum_flag);
+    append<uint32_t>(header, chunk.owner_id);
+    append<uint32_t>(header, chunk.index);
+
+    // NOTE: Every chunk is moved, so mark them all as modified for
+    //       incremental snapshots taken before the clean up
+    append<uint32_t>(header, m_generation + 1);
+    append<uint64_t>(header, body.size());
+    append<uint64_t>(header, 0);
+    append<uint64_t>(header, 0);
+
+    // NOTE: The checksum is of the body, carried on over the header before it
+    auto checksum = Checksum::crc32c(body.data(), body.size());
+    append<uint32_t>(header, Checksum::crc32c(header.data(), header.size(), checksum));
+    header.resize(Config::chunk_header_size, '\0');
+
+    out.write(header.data(), header.size());
+    out.write(body.data(), body.size());
+}
+
 void Cleaner::full_clean_up()
 {
     if (!m_has_been_processed)
         process_data_base();
-    
-    std::ifstream in(m_in_path, std::ifstream::binary);
-    std::ofstream out(m_out_path, std::ifstream::binary);
-    auto write_chunk_header = [&](const Chunk &chunk)
-    {
-        auto write_int = [&](int i)
-        {
-            out.write(((char*)&i) + 0, 1);
-            out.write(((char*)&i) + 1, 1);
-            out.write(((char*)&i) + 2, 1);
-            out.write(((char*)&i) + 3, 1);
-        };
 
-        out.write(chunk.type, 2);
-        out.write((char*)&chunk.owner_id, 1);
-        out.write((char*)&chunk.index, 1);
-        write_int(chunk.size_in_bytes);
-        write_int(0); // NOTE: We ignore the padding
-        for (int i = 0; i < Config::chunk_header_size - 12; i++)
-            out.write("\0", 1);
-   };
-
-    auto copy_chunk_body = [&](const Chunk &chunk, bool is_row_data = false)
+    if (m_major_version != Config::major_version)
     {
-        in.clear();
-        in.seekg(chunk.offset + Config::chunk_header_size, std::ifstream::beg);
+        std::cerr << "Cleaner: Can only clean version " << Config::major_version
+            << " databases, upgrade it first with 'databaseclt --upgrade'\n";
+        return;
+    }
 
-        auto count = ((int)chunk.size_in_bytes) - (is_row_data ? 1 : 0);
-        for (int i = 0; i < count; i++)
-        {
-            char c = in.get();
-            out.write(&c, 1);
-        }
+    std::ifstream in(m_in_path, std::ifstream::binary);
+    std::ofstream out(m_out_path, std::ifstream::binary);
+    auto copy_chunk = [&](const Chunk &chunk)
+    {
+        write_chunk(out, chunk, read_chunk_body(in, chunk));
     };
 
     if (m_version)
-    {
-        write_chunk_header(*m_version);
-        copy_chunk_body(*m_version);
-    }
+        copy_chunk(*m_version);
 
     for (auto &table : m_tables)
     {
-        auto sort_chunks = [&](auto collection)
+        auto sort_chunks = [&](auto &collection)
         {
             std::sort(collection.begin(), collection.end(),
                 [&](const auto &a, const auto &b)
@@ -180,32 +310,355 @@ void Cleaner::full_clean_up()
         };
 
         // Write table header and sort sub-chunks
-        write_chunk_header(table.header);
-        copy_chunk_body(table.header);
+        auto header = read_chunk_body(in, table.header);
+        write_chunk(out, table.header, header);
         sort_chunks(table.row_data);
         sort_chunks(table.dynamic);
 
-        // Create new coallated row data chunk
-        Chunk coallated_row_data;
-        coallated_row_data.type[0] = 'R';
-        coallated_row_data.type[1] = 'D';
-        coallated_row_data.owner_id = table.header.owner_id;
-        coallated_row_data.index = 0;
-        coallated_row_data.size_in_bytes = 0;
-        for (const auto chunk : table.row_data)
-            coallated_row_data.size_in_bytes += chunk.size_in_bytes - 1;
-        coallated_row_data.padding_in_bytes = 0;
-
-        // Write row data to new chunk
-        write_chunk_header(coallated_row_data);
-        for (const auto &chunk : table.row_data)
-            copy_chunk_body(chunk, true);
+        // NOTE: Each partition has to stay in its own chunks, so it can be dropped
+        if (is_partitioned(header))
+        {
+            for (const auto &chunk : table.row_data)
+                copy_chunk(chunk);
+        }
+        else
+        {
+            // Create new coallated row data chunk
+            Chunk coallated_row_data = table.header;
+            coallated_row_data.type[0] = 'R';
+            coallated_row_data.type[1] = 'D';
+            coallated_row_data.index = 0;
+
+            std::vector<char> row_data;
+            for (const auto &chunk : table.row_data)
+            {
+                auto data = read_chunk_body(in, chunk);
+                row_data.insert(row_data.end(), data.begin(), data.end());
+            }
+            write_chunk(out, coallated_row_data, row_data);
+        }
 
         // Write dynamic chunks in order
         for (const auto &chunk : table.dynamic)
+            copy_chunk(chunk);
+
+        // NOTE: Cleaning doesn't change any rows, so the stats and indexes are still valid
+        if (table.stats)
+            copy_chunk(*table.stats);
+        for (const auto &chunk : table.indexes)
+            copy_chunk(chunk);
+    }
+}
+
+bool Cleaner::upgrade()
+{
+    if (!m_has_been_processed)
+        process_data_base();
+
+    if (m_major_version == Config::major_version)
+    {
+        std::cout << "Cleaner: Already at version " << m_major_version << "\n";
+        return true;
+    }
+
+    if (m_major_version != 1)
+    {
+        std::cerr << "Cleaner: Don't know how to upgrade version " << m_major_version << "\n";
+        return false;
+    }
+
+    // NOTE: Version 2 widened the chunk headers, the table row count and the
+    //       dynamic data id stored in Text columns, everything else is the same
+    auto upgraded_path = m_in_path + ".upgrading";
+    {
+        std::ifstream in(m_in_path, std::ifstream::binary);
+        std::ofstream out(upgraded_path, std::ifstream::binary);
+
+        Chunk version = {};
+        version.type[0] = 'V';
+        version.type[1] = 'R';
+        write_chunk(out, version, { Config::major_version, Config::minor_version });
+
+        for (auto &table : m_tables)
+        {
+            auto header = read_chunk_body(in, table.header);
+            size_t offset = 0;
+            auto read_byte = [&]() { return (uint8_t)header[offset++]; };
+
+            // Name and column count
+            auto name_len = read_byte();
+            offset += name_len;
+            auto column_count = read_byte();
+            std::vector<char> upgraded_header(header.begin(), header.begin() + offset);
+
+            // Row count
+            int32_t row_count;
+            memcpy(&row_count, header.data() + offset, sizeof(int32_t));
+            offset += sizeof(int32_t);
+            append<int64_t>(upgraded_header, row_count);
+            upgraded_header.insert(upgraded_header.end(), header.begin() + offset, header.end());
+            write_chunk(out, table.header, upgraded_header);
+
+            // Column sizes, which are the same apart from Text
+            std::vector<std::pair<DataType::Primitive, size_t>> columns;
+            size_t row_size = Config::row_header_size;
+            for (size_t i = 0; i < column_count; i++)
+            {
+                auto column_name_len = read_byte();
+                offset += column_name_len;
+                auto primitive = static_cast<DataType::Primitive>(read_byte());
+                auto length = read_byte();
+
+                auto size = primitive == DataType::Text
+                    ? 1 : DataType::size_from_primitive(primitive) * length;
+                columns.push_back({ primitive, size });
+                row_size += 1 + size;
+            }
+
+            // Re-layout every row, widening Text ids to 32 bits
+            // NOTE: Indexes wrapped around in version 1, so keep file order for ties
+            std::stable_sort(table.row_data.begin(), table.row_data.end(),
+                [&](const auto &a, const auto &b) { return a.index < b.index; });
+
+            Chunk upgraded_row_data = table.header;
+            upgraded_row_data.type[0] = 'R';
+            upgraded_row_data.type[1] = 'D';
+            upgraded_row_data.index = 1;
+            std::vector<char> row_data;
+            for (const auto &chunk : table.row_data)
+            {
+                auto data = read_chunk_body(in, chunk);
+                for (size_t row = 0; row + row_size <= data.size(); row += row_size)
+                {
+                    auto *row_start = data.data() + row;
+                    std::vector<char> upgraded_row(row_start, row_start + Config::row_header_size);
+                    auto *entry = row_start + Config::row_header_size;
+                    for (const auto &[primitive, size] : columns)
+                    {
+                        // Null flag
+                        upgraded_row.push_back(entry[0]);
+                        if (primitive == DataType::Text)
+                            append<uint32_t>(upgraded_row, (uint8_t)entry[1]);
+                        else
+                            upgraded_row.insert(upgraded_row.end(), entry + 1, entry + 1 + size);
+                        entry += 1 + size;
+                    }
+
+                    // Keep the new row data chunks bounded, like the database does
+                    if (row_data.size() + upgraded_row.size() > Config::max_row_data_chunk_size)
+                    {
+                        write_chunk(out, upgraded_row_data, row_data);
+                        upgraded_row_data.index += 1;
+                        row_data.clear();
+                    }
+                    row_data.insert(row_data.end(), upgraded_row.begin(), upgraded_row.end());
+                }
+            }
+            if (!row_data.empty())
+                write_chunk(out, upgraded_row_data, row_data);
+
+            for (const auto &chunk : table.dynamic)
+                write_chunk(out, chunk, read_chunk_body(in, chunk));
+            if (table.stats)
+                write_chunk(out, *table.stats, read_chunk_body(in, *table.stats));
+            for (const auto &chunk : table.indexes)
+                write_chunk(out, chunk, read_chunk_body(in, chunk));
+        }
+
+        if (!out)
+        {
+            std::cerr << "Cleaner: Failed to write '" << upgraded_path << "'\n";
+            return false;
+        }
+    }
+
+    // Keep the original around, in case anything went wrong
+    auto backup_path = m_in_path + ".v" + std::to_string(m_major_version);
+    std::error_code error;
+    std::filesystem::rename(m_in_path, backup_path, error);
+    if (!error)
+        std::filesystem::rename(upgraded_path, m_in_path, error);
+    if (error)
+    {
+        std::cerr << "Cleaner: " << error.message() << "\n";
+        return false;
+    }
+
+    std::cout << "Upgraded to version " << Config::major_version
+        << ", the original was moved to '" << backup_path << "'\n";
+    return true;
+}
+
+bool Cleaner::scrub()
+{
+    auto fd = open(m_in_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("open()");
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0)
+    {
+        perror("fstat()");
+        close(fd);
+        return false;
+    }
+
+    if (DataBase::read_major_version(fd) != Config::major_version)
+    {
+        std::cerr << "Cleaner: Can only scrub version " << Config::major_version
+            << " databases, upgrade it first with 'databaseclt --upgrade'\n";
+        close(fd);
+        return false;
+    }
+
+    // The chunk being checked, which can be split across reads
+    char header[Config::chunk_header_size];
+    size_t header_filled = 0;
+    Chunk chunk {};
+    size_t data_left = 0;
+    size_t padding_left = 0;
+    uint32_t checksum = 0;
+
+    size_t position = 0;
+    size_t chunk_count = 0;
+    size_t unchecked_count = 0;
+    size_t damaged_count = 0;
+
+    auto end_chunk = [&]()
+    {
+        // NOTE: Removed chunks keep whatever was there, so aren't checked
+        if (std::string_view(chunk.type, 2) == "RM")
+            return;
+
+        chunk_count += 1;
+        if (!(chunk.flags & DB::Chunk::has_checksum_flag))
         {
-            write_chunk_header(chunk);
-            copy_chunk_body(chunk);
+            unchecked_count += 1;
+            return;
         }
+
+        checksum = Checksum::crc32c(header, 40, checksum);
+        if (checksum != chunk.checksum)
+        {
+            damaged_count += 1;
+            std::cout << "Chunk type = " << std::string_view(chunk.type, 2) << ", "
+                << "owner_id = " << chunk.owner_id << ", "
+                << "index = " << chunk.index << ", "
+                << "offset = " << chunk.offset << " doesn't match its checksum\n";
+        }
+    };
+
+    auto begin_chunk = [&]()
+    {
+        // See the header layout in chunk.hpp
+        uint64_t size_in_bytes, padding_in_bytes;
+        memcpy(chunk.type, header, 2);
+        chunk.flags = header[3];
+        memcpy(&chunk.owner_id, header + 4, sizeof(uint32_t));
+        memcpy(&chunk.index, header + 8, sizeof(uint32_t));
+        memcpy(&size_in_bytes, header + 16, sizeof(uint64_t));
+        memcpy(&padding_in_bytes, header + 24, sizeof(uint64_t));
+        memcpy(&chunk.checksum, header + 40, sizeof(uint32_t));
+        chunk.offset = position - sizeof(header);
+
+        data_left = size_in_bytes;
+        padding_left = padding_in_bytes;
+        checksum = Checksum::crc32c(nullptr, 0);
+        if (data_left == 0)
+            end_chunk();
+    };
+
+    auto scan = [&](const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            size_t count;
+            if (header_filled < sizeof(header))
+            {
+                count = std::min(sizeof(header) - header_filled, size);
+                memcpy(header + header_filled, data, count);
+                header_filled += count;
+                position += count;
+                if (header_filled == sizeof(header))
+                    begin_chunk();
+            }
+            else if (data_left > 0)
+            {
+                count = std::min(data_left, size);
+                checksum = Checksum::crc32c(data, count, checksum);
+                data_left -= count;
+                position += count;
+                if (data_left == 0)
+                    end_chunk();
+            }
+            else
+            {
+                count = std::min(padding_left, size);
+                padding_left -= count;
+                position += count;
+            }
+
+            data += count;
+            size -= count;
+            if (header_filled == sizeof(header) && data_left == 0 && padding_left == 0)
+                header_filled = 0;
+        }
+    };
+
+    // NOTE: The next read is in flight while the last one is checked, so
+    //       checking keeps up with the disk rather than waiting on it
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    AsyncIO async_io(fd);
+    std::vector<char> buffers[2];
+    buffers[0].resize(Config::scrub_read_size);
+    buffers[1].resize(Config::scrub_read_size);
+
+    size_t file_size = file_stat.st_size;
+    auto submit_read = [&](size_t offset, std::vector<char> &buffer)
+    {
+        auto size = std::min(buffer.size(), file_size - offset);
+        if (size > 0)
+            async_io.submit_reads({ { offset, buffer.data(), size } });
+        return size;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    size_t offset = 0;
+    size_t current = 0;
+    auto size = submit_read(offset, buffers[current]);
+    while (size > 0)
+    {
+        if (!async_io.wait())
+        {
+            perror("Cleaner::scrub()");
+            ok = false;
+            break;
+        }
+
+        auto next_size = submit_read(offset + size, buffers[1 - current]);
+        scan(buffers[current].data(), size);
+        offset += size;
+        current = 1 - current;
+        size = next_size;
     }
+    async_io.wait();
+    close(fd);
+
+    if (ok && header_filled != 0 && (header_filled < sizeof(header) || data_left > 0))
+    {
+        auto chunk_offset = header_filled < sizeof(header) ? position - header_filled : chunk.offset;
+        std::cout << "The file ends part way through the chunk at offset " << chunk_offset << "\n";
+        damaged_count += 1;
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto megabytes = offset / (1024.0 * 1024.0);
+    std::cout << "Scrubbed " << chunk_count << " chunks, " << megabytes << " MB in " << seconds << "s ("
+        << (seconds > 0 ? megabytes / seconds : 0) << " MB/s), "
+        << damaged_count << " damaged, " << unchecked_count << " without a checksum\n";
+    return ok && damaged_count == 0;
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <optional>
@@ -14,16 +15,29 @@ namespace DB
         void output_info();
         void full_clean_up();
 
+        // Rewrite an older database in the current format, the
+        // original is kept with a '.v<version>' suffix
+        bool upgrade();
+
+        // Read through the whole file in large sequential reads, checking each
+        // chunk against its checksum. Returns false if any don't match.
+        bool scrub();
+
     private:
         struct Chunk
         {
             size_t offset;
 
             char type[2];
-            uint8_t owner_id;
-            uint8_t index;
+            uint32_t owner_id;
+            uint32_t index;
+            uint32_t generation;
             size_t size_in_bytes;
             size_t padding_in_bytes;
+            uint8_t codec;
+            size_t raw_size_in_bytes;
+            uint8_t flags;
+            uint32_t checksum;
         };
 
         struct Table
@@ -31,14 +45,21 @@ namespace DB
             Chunk header;
             std::vector<Chunk> row_data;
             std::vector<Chunk> dynamic;
+            std::optional<Chunk> stats;
+            std::vector<Chunk> indexes;
         };
 
         void process_data_base();
+        size_t header_size() const;
+        std::vector<char> read_chunk_body(std::istream&, const Chunk&) const;
+        void write_chunk(std::ostream&, Chunk, const std::vector<char> &body) const;
         
         std::string m_in_path;
         std::string m_out_path;
         
         bool m_has_been_processed { false };
+        int m_major_version { 0 };
+        uint32_t m_generation { 0 };
         std::vector<Table> m_tables;
         std::optional<Chunk> m_version;
 
@@ -0,0 +1,162 @@
+#include "client.hpp"
+#include "protocol.hpp"
+#include <iostream>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace DB;
+
+std::shared_ptr<Client> Client::connect(const std::string &socket_path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Client: Socket path '" << socket_path << "' is too long\n";
+        return nullptr;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket()");
+        return nullptr;
+    }
+
+    if (::connect(fd, (sockaddr*)&address, sizeof(address)) < 0)
+    {
+        perror("connect()");
+        close(fd);
+        return nullptr;
+    }
+
+    return std::shared_ptr<Client>(new Client(fd));
+}
+
+Client::~Client()
+{
+    close(m_fd);
+}
+
+void Client::send(const std::string &query)
+{
+    Protocol::append_message(m_output, Protocol::MessageType::Query, query);
+    m_pending_count += 1;
+}
+
+bool Client::flush()
+{
+    size_t offset = 0;
+    while (offset < m_output.size())
+    {
+        // NOTE: The server stops reading queries while its results aren't
+        //       being read, so they're read as they come in while sending
+        pollfd poll_fd { m_fd, POLLIN | POLLOUT, 0 };
+        if (poll(&poll_fd, 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("poll()");
+            return false;
+        }
+
+        if ((poll_fd.revents & POLLIN) && !read_input())
+            return false;
+        if (!(poll_fd.revents & (POLLOUT | POLLERR | POLLHUP)))
+            continue;
+
+        auto result = ::send(m_fd, m_output.data() + offset, m_output.size() - offset,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (result < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+
+        if (result < 0)
+        {
+            perror("send()");
+            return false;
+        }
+        offset += result;
+    }
+
+    m_output.clear();
+    return true;
+}
+
+std::optional<ResultView> Client::receive()
+{
+    if (m_pending_count == 0 || !flush())
+        return std::nullopt;
+
+    for (;;)
+    {
+        auto message = Protocol::parse_message(std::string_view(m_input).substr(m_input_offset));
+        if (message)
+        {
+            auto result = message->type == Protocol::MessageType::Result
+                ? ResultView::parse(message->payload)
+                : std::nullopt;
+            if (!result)
+                std::cerr << "Client: Got a malformed result\n";
+
+            m_input_offset += message->payload.size() + Protocol::message_header_size;
+            m_pending_count -= 1;
+            return result;
+        }
+
+        if (!read_input())
+            return std::nullopt;
+    }
+}
+
+bool Client::read_input()
+{
+    // NOTE: Results already read are only dropped before reading more, and once
+    //       they're most of the buffer, so it's not shifted along for every one
+    if (m_input_offset == m_input.size())
+    {
+        m_input.clear();
+        m_input_offset = 0;
+    }
+    else if (m_input_offset > m_input.size() / 2)
+    {
+        m_input.erase(0, m_input_offset);
+        m_input_offset = 0;
+    }
+
+    char buffer[64 * 1024];
+    for (;;)
+    {
+        auto result = recv(m_fd, buffer, sizeof(buffer), 0);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+        {
+            if (result < 0)
+                perror("recv()");
+            else
+                std::cerr << "Client: Server closed the connection\n";
+            return false;
+        }
+
+        m_input.append(buffer, result);
+        return true;
+    }
+}
+
+std::optional<ResultView> Client::execute(const std::string &query)
+{
+    while (m_pending_count > 0)
+    {
+        if (!receive())
+            return std::nullopt;
+    }
+
+    send(query);
+    return receive();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "sql/resultview.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace DB
+{
+
+    // A connection to a database server
+    class Client
+    {
+    public:
+        ~Client();
+
+        Client(const Client&) = delete;
+        Client(Client&) = delete;
+
+        static std::shared_ptr<Client> connect(const std::string &socket_path);
+
+        // Queue a query without waiting for its result, so
+        // many can be sent to the server at once
+        void send(const std::string &query);
+
+        // Wait for the result of the oldest query sent.
+        // NOTE: The result is read straight out of the client's
+        //       buffer, so it's only valid until the next receive
+        std::optional<ResultView> receive();
+
+        // NOTE: Results of queries still pending are discarded
+        std::optional<ResultView> execute(const std::string &query);
+
+        inline size_t pending_count() const { return m_pending_count; }
+
+    private:
+        Client(int fd)
+            : m_fd(fd) {}
+
+        // Send every query queued, reading any results that come back meanwhile
+        bool flush();
+
+        // Read whatever the server has sent, returning false if it's gone
+        bool read_input();
+
+        int m_fd;
+        std::string m_output;
+        std::string m_input;
+        size_t m_input_offset { 0 };
+        size_t m_pending_count { 0 };
+
+    };
+
+}
@@ -3,6 +3,16 @@
 #include <iostream>
 using namespace DB;
 
+bool Column::has_name(const std::string &name) const
+{
+    if (m_name == name)
+        return true;
+
+    return m_name.size() > name.size()
+        && m_name[m_name.size() - name.size() - 1] == '.'
+        && m_name.compare(m_name.size() - name.size(), name.size(), name) == 0;
+}
+
 std::unique_ptr<Entry> Column::read(Chunk &chunk, size_t offset) const
 {
     std::unique_ptr<Entry> entry = null();
@@ -10,10 +10,16 @@ namespace DB
     class Column
     {
         friend Table;
+        friend Sql::HashAggregate;
+        friend Sql::HashJoin;
+        friend Sql::QueryPlan;
 
     public:
         inline const std::string &name() const { return m_name; }
         inline DataType data_type() const { return m_data_type; }
+
+        // True if this column is called 'name', or is 'table.name' in a joined row
+        bool has_name(const std::string &name) const;
         
         std::unique_ptr<Entry> read(Chunk &chunk, size_t offset) const;
         std::unique_ptr<Entry> null() const;
@@ -0,0 +1,145 @@
+#include "compression.hpp"
+#include <algorithm>
+#include <cstring>
+using namespace DB;
+
+static constexpr size_t min_match = 4;
+static constexpr size_t max_offset = 0xFFFF;
+static constexpr int hash_bits = 12;
+
+static uint32_t read_u32(const char *data)
+{
+    uint32_t value;
+    memcpy(&value, data, 4);
+    return value;
+}
+
+static size_t hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - hash_bits);
+}
+
+static void write_length(std::vector<char> &out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back((char)255);
+        length -= 255;
+    }
+    out.push_back((char)length);
+}
+
+static void write_sequence(std::vector<char> &out,
+    const char *literals, size_t literal_length,
+    size_t offset, size_t match_length)
+{
+    auto literal_nibble = std::min(literal_length, (size_t)15);
+    auto match_nibble = match_length ? std::min(match_length - min_match, (size_t)15) : 0;
+    out.push_back((char)((literal_nibble << 4) | match_nibble));
+
+    if (literal_length >= 15)
+        write_length(out, literal_length - 15);
+    out.insert(out.end(), literals, literals + literal_length);
+
+    // The last sequence only has literals
+    if (!match_length)
+        return;
+
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)((offset >> 8) & 0xFF));
+    if (match_length - min_match >= 15)
+        write_length(out, match_length - min_match - 15);
+}
+
+std::vector<char> Compression::compress(const char *data, size_t size)
+{
+    std::vector<char> out;
+    out.reserve(size / 2 + 16);
+
+    std::vector<size_t> table(1 << hash_bits, SIZE_MAX);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + min_match <= size)
+    {
+        auto sequence = read_u32(data + i);
+        auto &candidate = table[hash(sequence)];
+        auto match = candidate;
+        candidate = i;
+
+        if (match == SIZE_MAX || i - match > max_offset || read_u32(data + match) != sequence)
+        {
+            i += 1;
+            continue;
+        }
+
+        size_t length = min_match;
+        while (i + length < size && data[match + length] == data[i + length])
+            length += 1;
+
+        write_sequence(out, data + anchor, i - anchor, i - match, length);
+        i += length;
+        anchor = i;
+    }
+
+    write_sequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool Compression::decompress(const char *data, size_t size, char *out, size_t raw_size)
+{
+    size_t in = 0;
+    size_t pos = 0;
+    auto read_length = [&](size_t length) -> size_t
+    {
+        for (;;)
+        {
+            if (in >= size)
+                return SIZE_MAX;
+
+            auto byte = (uint8_t)data[in++];
+            length += byte;
+            if (byte != 255)
+                return length;
+        }
+    };
+
+    while (in < size)
+    {
+        auto token = (uint8_t)data[in++];
+        size_t literal_length = token >> 4;
+        if (literal_length == 15)
+            literal_length = read_length(literal_length);
+        if (literal_length > size - in || literal_length > raw_size - pos)
+            return false;
+
+        memcpy(out + pos, data + in, literal_length);
+        in += literal_length;
+        pos += literal_length;
+
+        // End of block
+        if (in == size)
+            break;
+
+        if (in + 2 > size)
+            return false;
+        size_t offset = (uint8_t)data[in] | ((uint8_t)data[in + 1] << 8);
+        in += 2;
+
+        size_t match_length = token & 0xF;
+        if (match_length == 15)
+            match_length = read_length(match_length);
+        if (match_length == SIZE_MAX)
+            return false;
+        match_length += min_match;
+
+        if (offset == 0 || offset > pos || match_length > raw_size - pos)
+            return false;
+
+        // NOTE: Matches can overlap the output, so copy byte by byte
+        for (size_t j = 0; j < match_length; j++)
+            out[pos + j] = out[pos - offset + j];
+        pos += match_length;
+    }
+
+    return pos == raw_size;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace DB::Compression
+{
+
+    enum Codec : uint8_t
+    {
+        None = 0,
+        LZ = 1,
+    };
+
+    // LZ4 style block format. Each sequence is a token byte (high nibble
+    // literal length, low nibble match length - 4, 15 meaning 'more
+    // length bytes follow'), the literals, then a 2 byte match offset.
+    // The last sequence in a block has no match.
+    std::vector<char> compress(const char *data, size_t size);
+    bool decompress(const char *data, size_t size, char *out, size_t raw_size);
+
+}
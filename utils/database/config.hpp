@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 
 // Debugging flags
 // #define DEBUG_CHUNKS
@@ -8,10 +9,34 @@
 namespace DB::Config
 {
 
-    static int constexpr major_version = 1;
+    static int constexpr major_version = 2;
     static int constexpr minor_version = 0;
 
-    static int constexpr chunk_header_size = 20;
+    static int constexpr chunk_header_size = 48;
+    static int constexpr v1_chunk_header_size = 20;
     static int constexpr row_header_size = 4;
 
+    static size_t constexpr max_row_data_chunk_size = 256 * 1024;
+    static size_t constexpr min_row_data_extent_size = 4 * 1024;
+    static bool constexpr compress_sealed_chunks = false;
+    static size_t constexpr min_compressed_chunk_size = 1024;
+    static size_t constexpr compressed_chunk_slack_divisor = 8;
+    static size_t constexpr memory_budget = 24 * 1024 * 1024;
+    static size_t constexpr min_page_cache_size = 1024 * 1024;
+    static size_t constexpr min_working_memory_size = 256 * 1024;
+    static size_t constexpr read_ahead_chunk_count = 4;
+    static unsigned constexpr io_queue_depth = 64;
+    static size_t constexpr max_write_batch_count = 256;
+    static size_t constexpr scrub_read_size = 4 * 1024 * 1024;
+    static size_t constexpr sort_memory_budget = 4 * 1024 * 1024;
+    static size_t constexpr aggregate_memory_budget = 4 * 1024 * 1024;
+
+    static int constexpr server_max_events = 64;
+    static size_t constexpr max_message_size = 64 * 1024 * 1024;
+    static size_t constexpr server_max_pending_output = 16 * 1024 * 1024;
+
+    static size_t constexpr stats_sample_size = 10000;
+    static size_t constexpr stats_histogram_buckets = 16;
+    static unsigned constexpr stats_sample_seed = 0x5747;
+
 }
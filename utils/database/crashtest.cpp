@@ -0,0 +1,427 @@
+#include "database.hpp"
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace DB;
+
+static struct option cmd_options[] =
+{
+    { "help",       no_argument,        0, 'h' },
+    { "iterations", required_argument,  0, 'i' },
+    { "seed",       required_argument,  0, 's' },
+    { "directory",  required_argument,  0, 'd' },
+    { "compress",   no_argument,        0, 'c' },
+    { "verbose",    no_argument,        0, 'v' },
+    { 0, 0, 0, 0 },
+};
+
+void show_help()
+{
+    std::cout << "usage: database_crashtest [-h] [-i count] [-s seed] [-d dir] [-c] [-v]\n";
+    std::cout << "\nRun workloads that crash or lose writes at random points, then check\n";
+    std::cout << "the database still opens and is consistent\n";
+    std::cout << "\noptional arguments:\n";
+    std::cout << "  -h, --help\t\tShow this help message and exit\n";
+    std::cout << "  -i, --iterations\tNumber of workloads to run (default 100)\n";
+    std::cout << "  -s, --seed\t\tSeed of the first workload, each one after adds one (default 1)\n";
+    std::cout << "  -d, --directory\tWhere to create the test database (default /tmp)\n";
+    std::cout << "  -c, --compress\tCompress sealed row data chunks\n";
+    std::cout << "  -v, --verbose\t\tOutput the result of every workload\n";
+}
+
+struct Options
+{
+    size_t iterations { 100 };
+    unsigned seed { 1 };
+    std::string directory { "/tmp" };
+    bool compress { false };
+    bool verbose { false };
+};
+
+enum class Fault
+{
+    // The process is killed before a write
+    Crash,
+
+    // Only the first half of a write makes it, then the process is killed
+    Tear,
+
+    // A write is lost, but the process carries on
+    Drop,
+};
+
+static const char *fault_name(Fault fault)
+{
+    switch (fault)
+    {
+        case Fault::Crash: return "crash";
+        case Fault::Tear: return "torn write";
+        case Fault::Drop: return "dropped write";
+    }
+
+    return "";
+}
+
+static constexpr int crashed_status = 42;
+static constexpr size_t setup_row_count = 50;
+static constexpr size_t workload_step_count = 200;
+
+static void run(DataBase &db, const std::string &query, const std::vector<Sql::Value> &parameters = {})
+{
+    auto result = db.execute_sql(query, parameters);
+    if (!result.good())
+        result.output_errors();
+}
+
+static std::string random_text(std::mt19937 &random, size_t max_length)
+{
+    // NOTE: Lengths vary a lot, so updates both grow and shrink text
+    std::string text(random() % (max_length + 1), ' ');
+    for (auto &c : text)
+        c = 'a' + random() % 26;
+    return text;
+}
+
+static void insert_note(DataBase &db, std::mt19937 &random, int64_t id)
+{
+    run(db, "INSERT INTO Notes (id, title, body) VALUES (?, ?, ?)",
+        { Sql::Value(id), Sql::Value(random_text(random, 32)), Sql::Value(random_text(random, 300)) });
+}
+
+static void insert_count(DataBase &db, std::mt19937 &random, int64_t id)
+{
+    run(db, "INSERT INTO Counts (id, count, amount) VALUES (?, ?, ?)",
+        { Sql::Value(id), Sql::Value((int64_t)random()), Sql::Value((float)(random() % 1000) / 10) });
+}
+
+// Some rows to start from, written without any faults
+static void set_up(const std::string &path, std::mt19937 &random, const Options &options)
+{
+    std::filesystem::remove(path);
+    auto db = DataBase::open(path);
+    db->set_compress_sealed_chunks(options.compress);
+
+    run(*db, "CREATE TABLE Notes (id Integer, title Char(32), body Text)");
+    run(*db, "CREATE TABLE Counts (id Integer, count BigInt, amount Float)");
+    for (size_t i = 0; i < setup_row_count; i++)
+    {
+        insert_note(*db, random, i);
+        insert_count(*db, random, i);
+    }
+}
+
+// A mix of inserts, updates and deletes, on rows that may or may not exist
+static void run_workload(DataBase &db, std::mt19937 &random)
+{
+    int64_t next_id = setup_row_count;
+    for (size_t step = 0; step < workload_step_count; step++)
+    {
+        auto id = (int64_t)(random() % next_id);
+        switch (random() % 6)
+        {
+            case 0:
+                insert_note(db, random, next_id++);
+                break;
+            case 1:
+                insert_count(db, random, next_id++);
+                break;
+            case 2:
+                run(db, "UPDATE Notes SET body = ? WHERE id = ?",
+                    { Sql::Value(random_text(random, 300)), Sql::Value(id) });
+                break;
+            case 3:
+                run(db, "UPDATE Counts SET count = ?, amount = ? WHERE id = ?",
+                    { Sql::Value((int64_t)random()), Sql::Value((float)(random() % 1000) / 10), Sql::Value(id) });
+                break;
+            case 4:
+                run(db, "DELETE FROM Notes WHERE id = ?", { Sql::Value(id) });
+                break;
+            case 5:
+                run(db, "DELETE FROM Counts WHERE id = ?", { Sql::Value(id) });
+                break;
+        }
+    }
+}
+
+// Run in a child process, so crashes only take it down.
+// Returns the exit status, or -1 if it was killed by a signal.
+template <typename Function>
+static int run_in_child(Function function)
+{
+    std::cout.flush();
+    auto pid = fork();
+    if (pid < 0)
+    {
+        perror("fork()");
+        exit(1);
+    }
+
+    // NOTE: Nothing is cleaned up on the way out, as after a
+    //       fault the database mustn't write anything else
+    if (pid == 0)
+    {
+        auto status = function();
+        std::cout.flush();
+        _exit(status);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+    {
+        perror("waitpid()");
+        exit(1);
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// How many writes a workload makes, so faults can be spread across all of them.
+// NOTE: This always runs the same workload, so a seed fails the same way
+//       however many iterations are run with it
+static size_t count_workload_writes(const std::string &path, const Options &options)
+{
+    std::mt19937 random(0);
+    set_up(path, random, options);
+
+    size_t write_count = 0;
+    auto db = DataBase::open(path);
+    db->set_write_hook([&](size_t, size_t size)
+    {
+        write_count += 1;
+        return size;
+    });
+    run_workload(*db, random);
+    db = nullptr;
+
+    return write_count;
+}
+
+static int run_faulty_workload(const std::string &path, Fault fault, size_t fault_at, std::mt19937 &random)
+{
+    size_t write_count = 0;
+    bool has_torn_write = false;
+
+    auto db = DataBase::open(path);
+    db->set_write_hook([&](size_t, size_t size) -> size_t
+    {
+        // NOTE: The write after a torn one never happens
+        if (has_torn_write)
+            _exit(crashed_status);
+
+        write_count += 1;
+        if (write_count != fault_at)
+            return size;
+
+        switch (fault)
+        {
+            case Fault::Crash:
+                _exit(crashed_status);
+            case Fault::Tear:
+                has_torn_write = true;
+                return size / 2;
+            case Fault::Drop:
+                return 0;
+        }
+
+        return size;
+    });
+
+    run_workload(*db, random);
+    if (has_torn_write)
+        _exit(crashed_status);
+
+    // NOTE: With a dropped write, the database is closed as normal
+    db = nullptr;
+    return 0;
+}
+
+static int check_database(const std::string &path, unsigned seed)
+{
+    auto db = DataBase::open(path);
+    if (!db)
+        return 2;
+
+    auto problems = db->check_consistency();
+    for (const auto &problem : problems)
+        std::cout << "    seed " << seed << ": " << problem << "\n";
+
+    // Every row has to be readable too
+    for (const auto &table : db->tables())
+    {
+        auto result = db->execute_sql("SELECT * FROM " + table.name());
+        if (!result.good())
+        {
+            std::cout << "    seed " << seed << ": Can't read '" << table.name() << "'\n";
+            return 1;
+        }
+    }
+
+    // NOTE: Damage only a checksum catches is still reported by the
+    //       database, so it has to be counted here too
+    auto checksum_failures = db->io_stats().checksum_failures;
+    if (checksum_failures > 0)
+        std::cout << "    seed " << seed << ": Checksum failures: " << checksum_failures << "\n";
+
+    return problems.empty() && checksum_failures == 0 ? 0 : 1;
+}
+
+// An incremental snapshot applied to the snapshot it was taken since has to
+// give the same rows as the database, including those in chunks that moved
+static bool check_incremental_snapshot(const std::string &path, const Options &options)
+{
+    auto full_path = path + ".full";
+    auto incremental_path = path + ".incremental";
+
+    std::mt19937 random(0);
+    set_up(path, random, options);
+    auto db = DataBase::open(path);
+    auto since_generation = db->snapshot(full_path);
+    if (!since_generation)
+        return false;
+
+    // NOTE: Text too long for where it was has to move to the end of the file
+    run_workload(*db, random);
+    run(*db, "UPDATE Notes SET body = ?", { Sql::Value(std::string(4000, 'x')) });
+
+    bool matches = db->snapshot(incremental_path, since_generation)
+        && DataBase::apply_snapshot(full_path, incremental_path);
+    if (matches)
+    {
+        auto restored = DataBase::open(full_path);
+        matches = restored && restored->check_consistency().empty();
+        for (size_t i = 0; matches && i < db->tables().size(); i++)
+        {
+            auto query = "SELECT * FROM " + db->tables()[i].name();
+            matches = db->execute_sql(query).encode() == restored->execute_sql(query).encode();
+        }
+    }
+
+    db = nullptr;
+    std::filesystem::remove(full_path);
+    std::filesystem::remove(incremental_path);
+    return matches;
+}
+
+// Conditions a literal decides are folded when they're parsed, which
+// mustn't free the parameters a statement still binds values to
+static bool check_folded_parameters(const std::string &path, const Options &options)
+{
+    std::mt19937 random(0);
+    set_up(path, random, options);
+    auto db = DataBase::open(path);
+
+    auto count_rows = [&](const std::string &condition) -> long
+    {
+        auto result = db->execute_sql("SELECT * FROM Counts WHERE " + condition, { Sql::Value((int64_t)1) });
+        return result.good() ? std::distance(result.begin(), result.end()) : -1;
+    };
+
+    return count_rows("1 = 0 AND id = ?") == 0
+        && count_rows("1 = 1 OR id = ?") == (long)setup_row_count;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (;;)
+    {
+        int option_index;
+        int c = getopt_long(argc, argv, "hi:s:d:cv",
+            cmd_options, &option_index);
+
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'h':
+                show_help();
+                return 0;
+            case 'i':
+                options.iterations = std::stoul(optarg);
+                break;
+            case 's':
+                options.seed = std::stoul(optarg);
+                break;
+            case 'd':
+                options.directory = optarg;
+                break;
+            case 'c':
+                options.compress = true;
+                break;
+            case 'v':
+                options.verbose = true;
+                break;
+            default:
+                show_help();
+                return 1;
+        }
+    }
+
+    auto path = options.directory + "/database_crashtest_" + std::to_string(getpid()) + ".db";
+    auto snapshot_matches = check_incremental_snapshot(path, options);
+    auto folded_parameters_bind = check_folded_parameters(path, options);
+    auto workload_write_count = count_workload_writes(path, options);
+
+    struct Results
+    {
+        size_t consistent { 0 };
+        size_t inconsistent { 0 };
+        size_t failed_to_open { 0 };
+    };
+    Results results[3];
+
+    for (size_t iteration = 0; iteration < options.iterations; iteration++)
+    {
+        auto seed = options.seed + (unsigned)iteration;
+        std::mt19937 random(seed);
+        set_up(path, random, options);
+
+        auto fault = (Fault)(random() % 3);
+        auto fault_at = 1 + random() % workload_write_count;
+        auto status = run_in_child([&]()
+        {
+            return run_faulty_workload(path, fault, fault_at, random);
+        });
+        if (status != 0 && status != crashed_status)
+        {
+            std::cout << "    seed " << seed << ": The workload failed before the fault\n";
+            results[(int)fault].inconsistent += 1;
+            continue;
+        }
+
+        status = run_in_child([&]() { return check_database(path, seed); });
+        auto &result = results[(int)fault];
+        switch (status)
+        {
+            case 0: result.consistent += 1; break;
+            case 1: result.inconsistent += 1; break;
+            default: result.failed_to_open += 1; break;
+        }
+
+        if (options.verbose || status != 0)
+        {
+            std::cout << "seed " << seed << ": " << fault_name(fault) << " at write "
+                << fault_at << " of " << workload_write_count << ", "
+                << (status == 0 ? "consistent" : status == 1 ? "inconsistent" : "failed to open") << "\n";
+        }
+    }
+    std::filesystem::remove(path);
+
+    bool all_consistent = snapshot_matches && folded_parameters_bind;
+    std::cout << "\n";
+    for (auto fault : { Fault::Crash, Fault::Tear, Fault::Drop })
+    {
+        const auto &result = results[(int)fault];
+        std::cout << fault_name(fault) << ": " << result.consistent << " consistent, "
+            << result.inconsistent << " inconsistent, " << result.failed_to_open << " failed to open\n";
+        all_consistent &= result.inconsistent == 0 && result.failed_to_open == 0;
+    }
+    std::cout << "incremental snapshot: " << (snapshot_matches ? "matches" : "doesn't match") << "\n";
+    std::cout << "folded parameters: " << (folded_parameters_bind ? "bound" : "not bound") << "\n";
+
+    return all_consistent ? 0 : 1;
+}
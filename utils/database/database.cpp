@@ -1,36 +1,44 @@
 #include "config.hpp"
 #include "chunk.hpp"
+#include "checksum.hpp"
+#include "compression.hpp"
 #include "database.hpp"
 #include "sql/parser.hpp"
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <fstream>
-#include <filesystem>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace DB;
 
-std::shared_ptr<Chunk> DataBase::new_chunk(std::string_view type, uint8_t owner_id, uint8_t index)
+std::shared_ptr<Chunk> DataBase::new_chunk(std::string_view type,
+    uint32_t owner_id, uint32_t index, size_t reserve_in_bytes)
 {
     auto chunk = std::shared_ptr<Chunk>(new Chunk(*this));
     memcpy(chunk->m_type, type.data(), 2);
     chunk->m_owner_id = owner_id;
     chunk->m_index = index;
     chunk->m_header_offset = m_end_of_data_pointer;
-    write_byte(chunk->m_header_offset + 0, type[0]);
-    write_byte(chunk->m_header_offset + 1, type[1]);
-    write_byte(chunk->m_header_offset + 2, owner_id);
-    write_byte(chunk->m_header_offset + 3, index);
-    write_int(chunk->m_header_offset + 4, 0);
-    write_int(chunk->m_header_offset + 8, 0);
-    write_int(chunk->m_header_offset + 12, 0);
-    write_int(chunk->m_header_offset + 16, 0);
-
     chunk->m_data_offset = chunk->m_header_offset + Config::chunk_header_size;
+    chunk->m_padding_in_bytes = reserve_in_bytes;
+    write_chunk_header(*chunk);
+
+    // NOTE: The reserved space has to exist in the file, otherwise
+    //       the next chunk would be placed inside of it on reload
+    if (reserve_in_bytes)
+        truncate(chunk->m_data_offset + reserve_in_bytes);
+
 #ifdef DEBUG_CHUNKS
     std::cout << "New chunk { type = " << type <<
         ", header_offset = " << chunk->m_header_offset <<
         ", data_offset = " << chunk->m_data_offset <<
-        ", owner = " << (int)chunk->m_owner_id << " }\n";
+        ", owner = " << chunk->m_owner_id << " }\n";
 #endif
 
     m_chunks.push_back(chunk);
@@ -38,49 +46,287 @@ std::shared_ptr<Chunk> DataBase::new_chunk(std::string_view type, uint8_t owner_
     return m_chunks.back();
 }
 
+void DataBase::write_chunk_header(Chunk &chunk)
+{
+    // NOTE: The whole header is written at once, so reserved fields are zeroed
+    chunk.m_generation = m_generation;
+    std::string header(Config::chunk_header_size, '\0');
+    chunk.encode_header(header.data());
+
+    auto checksum = chunk.stored_checksum();
+    memcpy(header.data() + Chunk::checksum_offset, &checksum, sizeof(checksum));
+    write_string(chunk.m_header_offset, header);
+}
+
+void DataBase::seal_chunk(Chunk &chunk)
+{
+    if (!m_compress_sealed_chunks)
+        return;
+
+    // Only row data is worth compressing, small chunks are left alone as
+    // the cost of decompressing them outweighs the bytes saved
+    if (chunk.type() != "RD" || chunk.is_compressed())
+        return;
+    if (chunk.size_in_bytes() < Config::min_compressed_chunk_size)
+        return;
+
+    // NOTE: Otherwise a damaged chunk would get a new checksum that matches
+    chunk.verify_checksum();
+    std::vector<char> data(chunk.size_in_bytes());
+    read_string(chunk.m_data_offset, data.data(), data.size());
+
+    auto compressed = Compression::compress(data.data(), data.size());
+    if (compressed.size() >= data.size())
+        return;
+
+    write_compressed(chunk, compressed, data.size());
+}
+
+void DataBase::relocate_chunk(Chunk &chunk)
+{
+    // NOTE: The old header keeps its sizes so the space is skipped over on load,
+    //       and its generation is bumped so incremental snapshots see it's removed
+    chunk.mark_modified();
+    write_string(chunk.m_header_offset, "RM");
+
+    chunk.m_header_offset = m_end_of_data_pointer;
+    chunk.m_data_offset = chunk.m_header_offset + Config::chunk_header_size;
+    chunk.m_size_in_bytes = 0;
+    chunk.m_padding_in_bytes = 0;
+    chunk.m_checksum = Checksum::crc32c(nullptr, 0);
+    chunk.m_checksummed_size = 0;
+    chunk.m_is_checksum_stale = false;
+    write_chunk_header(chunk);
+
+    for (const auto &it : m_chunks)
+    {
+        if (it.get() == &chunk)
+            m_active_chunk = it;
+    }
+}
+
+std::vector<char> DataBase::load_compressed_chunk(Chunk &chunk)
+{
+    std::vector<char> compressed(chunk.m_size_in_bytes);
+    read_string(chunk.m_data_offset, compressed.data(), compressed.size());
+    if (!chunk.m_has_been_verified)
+        check_checksum(chunk, compressed.data(), compressed.size());
+
+    return decompress_chunk(chunk, compressed.data(), compressed.size());
+}
+
+std::vector<char> DataBase::decompress_chunk(Chunk &chunk, const char *compressed, size_t size)
+{
+    std::vector<char> data(chunk.m_raw_size_in_bytes);
+    if (Compression::decompress(compressed, size, data.data(), data.size()))
+        return data;
+
+    // NOTE: A chunk that's failed its checksum has already been reported
+    if (!chunk.m_has_failed_checksum)
+    {
+        std::cerr << "DataBase: " << chunk << " can't be decompressed\n";
+        chunk.m_has_failed_checksum = true;
+        m_io_stats.checksum_failures += 1;
+    }
+
+    std::fill(data.begin(), data.end(), 0);
+    return data;
+}
+
+void DataBase::store_compressed(Chunk &chunk, const std::vector<char> &data)
+{
+    auto compressed = Compression::compress(data.data(), data.size());
+    auto space_available = chunk.m_size_in_bytes + chunk.m_padding_in_bytes;
+    if (!chunk.is_active() && compressed.size() > space_available)
+        relocate_chunk(chunk);
+
+    write_compressed(chunk, compressed, data.size());
+}
+
+void DataBase::write_compressed(Chunk &chunk, const std::vector<char> &compressed, size_t raw_size)
+{
+    write_string(chunk.m_data_offset, std::string(compressed.data(), compressed.size()));
+    if (chunk.is_active())
+    {
+        // The active chunk is at the end of the file, so give back any space we've
+        // freed. Some slack is kept, so small updates can be written back in place.
+        chunk.m_padding_in_bytes = compressed.size() / Config::compressed_chunk_slack_divisor;
+        truncate(chunk.m_data_offset + compressed.size() + chunk.m_padding_in_bytes);
+    }
+    else
+    {
+        chunk.m_padding_in_bytes = chunk.m_size_in_bytes + chunk.m_padding_in_bytes - compressed.size();
+    }
+
+    chunk.m_size_in_bytes = compressed.size();
+    chunk.m_codec = Compression::LZ;
+    chunk.m_raw_size_in_bytes = raw_size;
+    chunk.m_flags |= Chunk::has_checksum_flag;
+    chunk.m_checksum = Checksum::crc32c(compressed.data(), compressed.size());
+    chunk.m_checksummed_size = compressed.size();
+    chunk.m_is_checksum_stale = false;
+    write_chunk_header(chunk);
+}
+
+void DataBase::check_checksum(Chunk &chunk, const char *stored, size_t size)
+{
+    auto stored_checksum = chunk.m_checksum;
+    chunk.m_checksum = Checksum::crc32c(stored, size);
+    chunk.m_checksummed_size = size;
+    chunk.m_is_checksum_stale = false;
+    chunk.m_has_been_verified = true;
+
+    if ((chunk.m_flags & Chunk::has_checksum_flag) && chunk.stored_checksum() != stored_checksum)
+    {
+        // NOTE: The checksum is left as it is, so it can't be made to match the damaged data
+        std::cerr << "DataBase: " << chunk << " doesn't match its checksum\n";
+        chunk.m_has_failed_checksum = true;
+        m_io_stats.checksum_failures += 1;
+    }
+}
+
+void DataBase::mark_checksum_changed(Chunk &chunk)
+{
+    if (chunk.m_is_checksum_changed)
+        return;
+
+    chunk.m_is_checksum_changed = true;
+    m_checksum_changed_chunks.push_back(&chunk);
+}
+
+void DataBase::write_checksums()
+{
+    // NOTE: Chunks are never destroyed before the database is, so these are still valid
+    std::vector<char> buffer;
+    for (auto *chunk : m_checksum_changed_chunks)
+    {
+        chunk->m_is_checksum_changed = false;
+        if (chunk->m_has_been_dropped || chunk->is_compressed())
+            continue;
+
+        // NOTE: Only the header may have changed, the data still has to be checked first
+        chunk->verify_checksum();
+        if (chunk->m_has_failed_checksum)
+            continue;
+
+        auto size = chunk->m_size_in_bytes;
+        if (chunk->m_is_checksum_stale || chunk->m_checksummed_size > size)
+        {
+            chunk->m_checksum = Checksum::crc32c(nullptr, 0);
+            chunk->m_checksummed_size = 0;
+            chunk->m_is_checksum_stale = false;
+        }
+
+        // Read what the checksum doesn't cover yet, from the cache if it's there
+        if (chunk->m_checksummed_size < size)
+        {
+            auto offset = chunk->m_checksummed_size;
+            const auto *data = m_page_cache.find(*chunk, offset, size - offset);
+            if (!data)
+            {
+                buffer.resize(size - offset);
+                read(chunk->m_data_offset + offset, buffer.data(), buffer.size());
+                data = buffer.data();
+            }
+
+            chunk->m_checksum = Checksum::crc32c(data, size - offset, chunk->m_checksum);
+            chunk->m_checksummed_size = size;
+        }
+
+        if (!(chunk->m_flags & Chunk::has_checksum_flag))
+        {
+            chunk->m_flags |= Chunk::has_checksum_flag;
+            write_byte(chunk->m_header_offset + Chunk::flags_offset, chunk->m_flags);
+        }
+        write_int(chunk->m_header_offset + Chunk::checksum_offset, chunk->stored_checksum());
+    }
+
+    m_checksum_changed_chunks.clear();
+}
+
 void DataBase::check_is_active_chunk(Chunk *chunk)
 {
     // NOTE: We have to be the active chunk to append data
     assert (m_active_chunk.get() == chunk);
 }
 
-std::shared_ptr<DataBase> DataBase::open(const std::string& path)
+int DataBase::read_major_version(int fd)
 {
-    FILE *file;
+    // NOTE: The version chunk is always written first. Its v1 header
+    //       has the chunk size where v2 has the owner id, which is always
+    //       zero for the version chunk, so the two can be told apart.
+    char header[Config::v1_chunk_header_size + 1];
+    auto size = pread(fd, header, sizeof(header), 0);
 
-    if (!std::filesystem::exists(path))
-        file = fopen(path.c_str(), "w+b");
-    else
-        file = fopen(path.c_str(), "r+b");
+    // A new database
+    if (size == 0)
+        return Config::major_version;
+
+    if (size < (ssize_t)sizeof(header) || std::string_view(header, 2) != "VR")
+        return 0;
+
+    uint32_t v1_size;
+    memcpy(&v1_size, header + 4, sizeof(uint32_t));
+    if (v1_size != 0)
+        return (uint8_t)header[Config::v1_chunk_header_size];
+
+    uint8_t version = 0;
+    if (pread(fd, &version, 1, Config::chunk_header_size) != 1)
+        return 0;
+    return version;
+}
+
+std::shared_ptr<DataBase> DataBase::open(const std::string& path)
+{
+    auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror("open()");
+        return nullptr;
+    }
 
-    if (!file)
+    auto version = read_major_version(fd);
+    if (version != Config::major_version)
     {
-        perror("fopen()");
+        std::cerr << "DataBase: '" << path << "' is version " << version
+            << ", but version " << Config::major_version << " is required. "
+            << "Upgrade it with 'databaseclt --upgrade " << path << "'\n";
+        close(fd);
         return nullptr;
     }
 
-    return std::shared_ptr<DataBase>(new DataBase(file));
+    return std::shared_ptr<DataBase>(new DataBase(fd));
 }
 
-DataBase::DataBase(FILE *file)
-    : m_file(file)
+DataBase::DataBase(int fd)
+    : m_fd(fd)
+    , m_async_io(fd)
+    , m_memory_budget(Config::memory_budget)
+    , m_page_cache(*this, m_memory_budget)
 {
     // Find file length
-    fseek(m_file, 0L, SEEK_END);
-    m_end_of_data_pointer = ftell(m_file);
-    rewind(m_file);
+    struct stat file_stat;
+    if (fstat(m_fd, &file_stat) < 0)
+        perror("fstat()");
+    m_end_of_data_pointer = file_stat.st_size;
 
     // Load existing chunks
+    std::vector<std::shared_ptr<Chunk>> zone_maps;
+    std::vector<std::shared_ptr<Chunk>> indexes;
     size_t offset = 0;
     while (offset < m_end_of_data_pointer)
     {
         auto chunk = std::shared_ptr<Chunk>(new Chunk(*this, offset));
+        m_generation = std::max(m_generation, chunk->generation());
         offset += chunk->header_size() +
-            chunk->size_in_bytes() +
+            chunk->stored_size_in_bytes() +
             chunk->padding_in_bytes();
 
         if (chunk->type() == "RM")
         {
+            // Nothing can be appended to a chunk that's not at the end of the file
+            m_active_chunk = nullptr;
+
 #ifdef DEBUG_CHUNKS
             std::cout << "Dropped chunk " <<
                 "at: " << chunk->data_offset() <<
@@ -118,15 +364,71 @@ DataBase::DataBase(FILE *file)
 
             table->add_dynamic_data(chunk);
         }
+        else if (chunk->type() == "ST")
+        {
+            // Stats
+            auto *table = find_owner(chunk->owner_id());
+            assert (table);
+
+            table->load_stats(chunk);
+        }
+        else if (chunk->type() == "TI")
+        {
+            // Trigram Index, loaded once all the
+            // rows are, in case it has to be rebuilt
+            indexes.push_back(chunk);
+        }
+        else if (chunk->type() == "ZM")
+        {
+            // Zone Maps, these are only valid until the next
+            // write, so are discarded once loaded
+            zone_maps.push_back(chunk);
+            continue;
+        }
 
         m_chunks.push_back(chunk);
         m_active_chunk = chunk;
     }
 
+    for (auto it = zone_maps.rbegin(); it != zone_maps.rend(); ++it)
+    {
+        auto &chunk = *it;
+        auto *table = find_owner(chunk->owner_id());
+        if (table)
+            table->load_zone_maps(*chunk);
+        discard_chunk(*chunk);
+    }
+
+    for (const auto &chunk : indexes)
+    {
+        auto *table = find_owner(chunk->owner_id());
+        assert (table);
+
+        table->load_index(chunk);
+    }
+
     if (!m_version_chunk)
         write_version_chunk();
 }
 
+void DataBase::discard_chunk(Chunk &chunk)
+{
+    auto end_of_chunk = chunk.data_offset() +
+        chunk.stored_size_in_bytes() + chunk.padding_in_bytes();
+
+    // If it's the last chunk, we can give the space back
+    if (end_of_chunk == m_end_of_data_pointer)
+    {
+        // NOTE: It may have been cached while its checksum was checked
+        m_page_cache.evict(chunk);
+        truncate(chunk.m_header_offset);
+        chunk.m_has_been_dropped = true;
+        return;
+    }
+
+    chunk.drop();
+}
+
 void DataBase::write_version_chunk()
 {
     m_version_chunk = new_chunk("VR", 0, 0);
@@ -135,24 +437,114 @@ void DataBase::write_version_chunk()
 }
 
 SqlResult DataBase::execute_sql(const std::string &query)
+{
+    return execute_sql(query, {});
+}
+
+SqlResult DataBase::execute_sql(const std::string &query, const std::vector<Sql::Value> &parameters,
+    QueryTimings *timings)
 {
 #ifdef DEBUG_SQL
     std::cout << "DataBase: Executing SQL '" << query << "'\n";
 #endif
-    
+
+    using Clock = std::chrono::steady_clock;
+    auto nanoseconds_since = [](Clock::time_point start) -> uint64_t
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    };
+
+    auto start = Clock::now();
+    Sql::Parser parser(query);
+    auto statement = parser.run();
+    if (timings)
+        *timings = { nanoseconds_since(start), 0, 0 };
+    if (!parser.good())
+        return parser.errors_as_result();
+
+    start = Clock::now();
+    auto bind_result = statement->bind(parameters);
+    if (timings)
+        timings->plan_in_nanoseconds = nanoseconds_since(start);
+    if (!bind_result.good())
+        return bind_result;
+
+    // NOTE: Statements add the time spent planning while executing
+    start = Clock::now();
+    auto bind_time = timings ? timings->plan_in_nanoseconds : 0;
+    m_query_timings = timings;
+    auto result = statement->execute(*this);
+    flush();
+    m_query_timings = nullptr;
+    if (timings)
+    {
+        auto planning_time = timings->plan_in_nanoseconds - bind_time;
+        timings->execute_in_nanoseconds = nanoseconds_since(start) - planning_time;
+    }
+    return result;
+}
+
+void DataBase::add_plan_time(uint64_t nanoseconds)
+{
+    if (m_query_timings)
+        m_query_timings->plan_in_nanoseconds += nanoseconds;
+}
+
+void DataBase::begin_batch()
+{
+    begin_write_batch();
+}
+
+void DataBase::end_batch()
+{
+    flush();
+    end_write_batch();
+}
+
+SqlResult DataBase::execute_many(const std::string &query,
+    const std::vector<std::vector<Sql::Value>> &rows_of_parameters)
+{
+#ifdef DEBUG_SQL
+    std::cout << "DataBase: Executing SQL '" << query << "' "
+        << rows_of_parameters.size() << " times\n";
+#endif
+
     Sql::Parser parser(query);
     auto statement = parser.run();
     if (!parser.good())
         return parser.errors_as_result();
 
-    return statement->execute(*this);
+    switch (statement->type())
+    {
+        case Sql::Statement::Insert:
+        case Sql::Statement::Update:
+        case Sql::Statement::Delete:
+            break;
+        default:
+            return SqlResult::error("Only INSERT, UPDATE and DELETE can be run many times");
+    }
+
+    auto result = SqlResult::ok();
+    begin_write_batch();
+    for (const auto &parameters : rows_of_parameters)
+    {
+        result = statement->bind(parameters);
+        if (result.good())
+            result = statement->execute(*this);
+        if (!result.good())
+            break;
+    }
+
+    flush();
+    end_write_batch();
+    return result;
 }
 
-uint8_t DataBase::generate_table_id()
+uint32_t DataBase::generate_table_id()
 {
-    uint8_t max_id = 0;
+    uint32_t max_id = 0;
     for (const auto &table : m_tables)
-        max_id = std::max(max_id, (uint8_t)table.id());
+        max_id = std::max(max_id, table.id());
 
     return max_id + 1;
 }
@@ -163,71 +555,189 @@ void DataBase::check_size(size_t size)
         m_end_of_data_pointer = size;
 }
 
+void DataBase::truncate(size_t size)
+{
+    if (!m_write_batch.empty())
+        submit_write_batch();
+    if (ftruncate(m_fd, size) < 0)
+        perror("ftruncate()");
+
+    m_end_of_data_pointer = size;
+}
+
+void DataBase::write(size_t offset, const char *data, size_t size)
+{
+    check_size(offset + size);
+    if (m_write_batch_depth > 0)
+    {
+        // Writes in a batch can land in any order, so they can't overlap
+        for (auto &[pending_offset, pending_data] : m_write_batch)
+        {
+            if (offset < pending_offset + pending_data.size() && pending_offset < offset + size)
+            {
+                // NOTE: Rewriting part of a pending write, like a chunk
+                //       header's size, can just update it instead
+                if (offset >= pending_offset && offset + size <= pending_offset + pending_data.size())
+                {
+                    memcpy(pending_data.data() + (offset - pending_offset), data, size);
+                    return;
+                }
+
+                submit_write_batch();
+                break;
+            }
+        }
+
+        // NOTE: Long batches are sent on in parts, so checking for
+        //       overlaps stays cheap and memory use is bounded
+        m_write_batch.push_back({ offset, std::string(data, size) });
+        if (m_write_batch.size() >= Config::max_write_batch_count)
+            submit_write_batch();
+        return;
+    }
+
+    if (m_write_hook)
+        size = m_write_hook(offset, size);
+
+    m_io_stats.writes += 1;
+    m_io_stats.bytes_written += size;
+    size_t done = 0;
+    while (done < size)
+    {
+        auto result = pwrite(m_fd, data + done, size - done, offset + done);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0)
+        {
+            perror("pwrite()");
+            return;
+        }
+        done += result;
+    }
+}
+
 void DataBase::write_byte(size_t offset, char byte)
 {
-    check_size(offset + 1);
-    fseek(m_file, offset, SEEK_SET);
-    fwrite(&byte, 1, 1, m_file);
-    fflush(m_file);
+    write(offset, &byte, 1);
 }
 
 void DataBase::write_int(size_t offset, int i)
 {
-    check_size(offset + 4);
-    fseek(m_file, offset, SEEK_SET);
-    fwrite((char*)(&i), 1, 4, m_file);
-    fflush(m_file);
+    write(offset, (char*)(&i), 4);
 }
 
 void DataBase::write_long(size_t offset, int64_t l)
 {
-    check_size(offset + 8);
-    fseek(m_file, offset, SEEK_SET);
-    fwrite((char*)(&l), 1, 8, m_file);
-    fflush(m_file);
+    write(offset, (char*)(&l), 8);
 }
 
 void DataBase::write_string(size_t offset, const std::string& str)
 {
-    check_size(offset + str.size());
-    fseek(m_file, offset, SEEK_SET);
-    fwrite(str.data(), 1, str.size(), m_file);
-    fflush(m_file);
+    write(offset, str.data(), str.size());
+}
+
+void DataBase::begin_write_batch()
+{
+    m_write_batch_depth += 1;
+}
+
+void DataBase::end_write_batch()
+{
+    assert (m_write_batch_depth > 0);
+    m_write_batch_depth -= 1;
+    if (m_write_batch_depth == 0 && !m_write_batch.empty())
+        submit_write_batch();
+}
+
+void DataBase::submit_write_batch()
+{
+    std::vector<AsyncIO::Request> requests;
+    for (auto &[offset, data] : m_write_batch)
+    {
+        auto size = m_write_hook ? m_write_hook(offset, data.size()) : data.size();
+        if (size == 0)
+            continue;
+
+        requests.push_back({ offset, data.data(), size });
+        m_io_stats.bytes_written += size;
+    }
+    m_io_stats.writes += 1;
+
+    m_async_io.submit_writes(requests);
+    if (!m_async_io.wait())
+        perror("DataBase::submit_write_batch()");
+    m_write_batch.clear();
+}
+
+void DataBase::submit_reads(const std::vector<AsyncIO::Request> &requests)
+{
+    // NOTE: Reads have to see anything still waiting to be written
+    if (!m_write_batch.empty())
+        submit_write_batch();
+
+    m_io_stats.reads += 1;
+    for (const auto &request : requests)
+        m_io_stats.bytes_read += request.size;
+    m_async_io.submit_reads(requests);
 }
 
 void DataBase::flush()
 {
-    fflush(m_file);
+    m_page_cache.flush();
+    write_checksums();
+}
+
+void DataBase::read(size_t offset, char *data, size_t size)
+{
+    if (!m_write_batch.empty())
+        submit_write_batch();
+
+    m_io_stats.reads += 1;
+    m_io_stats.bytes_read += size;
+    size_t done = 0;
+    while (done < size)
+    {
+        auto result = pread(m_fd, data + done, size - done, offset + done);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0)
+            perror("pread()");
+        if (result <= 0)
+        {
+            // NOTE: Past the end of the file reads as zeros
+            memset(data + done, 0, size - done);
+            return;
+        }
+        done += result;
+    }
 }
 
 uint8_t DataBase::read_byte(size_t offset)
 {
     uint8_t byte;
-    fseek(m_file, offset, SEEK_SET);
-    fread(&byte, 1, 1, m_file);
+    read(offset, (char*)&byte, 1);
     return byte;
 }
 
 int DataBase::read_int(size_t offset)
 {
     int i;
-    fseek(m_file, offset, SEEK_SET);
-    fread(&i, 1, sizeof(int), m_file);
+    read(offset, (char*)&i, sizeof(int));
     return i;
 }
 
 int64_t DataBase::read_long(size_t offset)
 {
     int64_t l;
-    fseek(m_file, offset, SEEK_SET);
-    fread(&l, 1, sizeof(int64_t), m_file);
+    read(offset, (char*)&l, sizeof(int64_t));
     return l;
 }
 
 void DataBase::read_string(size_t offset, char *str, size_t len)
 {
-    fseek(m_file, offset, SEEK_SET);
-    fread(str, 1, len, m_file);
+    read(offset, str, len);
 }
 
 Table &DataBase::construct_table(Table::Constructor constructor)
@@ -236,7 +746,7 @@ Table &DataBase::construct_table(Table::Constructor constructor)
     return m_tables.back();
 }
 
-Table *DataBase::find_owner(uint8_t owner_id)
+Table *DataBase::find_owner(uint32_t owner_id)
 {
     for (auto &table : m_tables)
     {
@@ -278,8 +788,352 @@ bool DataBase::drop_table(const std::string &name)
     return true;
 }
 
+// Incremental snapshots are the regions of the file that have changed
+// since the snapshot they're from, each stored after this header as an
+// offset and a size followed by the data
+struct IncrementalSnapshotHeader
+{
+    char magic[8];
+    uint32_t since_generation;
+    uint32_t generation;
+    uint64_t file_size;
+    uint64_t region_count;
+};
+
+static constexpr char incremental_snapshot_magic[8] = { 'D', 'B', 'D', 'E', 'L', 'T', 'A', '1' };
+
+static bool write_all(int fd, const char *data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto result = ::write(fd, data + done, size - done);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0)
+        {
+            perror("write()");
+            return false;
+        }
+        done += result;
+    }
+
+    return true;
+}
+
+static bool read_all(int fd, char *data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto result = ::read(fd, data + done, size - done);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+        {
+            if (result < 0)
+                perror("read()");
+            return false;
+        }
+        done += result;
+    }
+
+    return true;
+}
+
+std::optional<uint32_t> DataBase::snapshot(const std::string &path, std::optional<uint32_t> since_generation)
+{
+    if (since_generation && *since_generation >= m_generation)
+    {
+        std::cerr << "DataBase: There's no snapshot with generation " << *since_generation << "\n";
+        return std::nullopt;
+    }
+
+    // NOTE: Everything has to be on disk for the copy to be consistent
+    flush();
+
+    auto out_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0)
+    {
+        perror("open()");
+        return std::nullopt;
+    }
+
+    auto ok = since_generation
+        ? write_incremental_snapshot(out_fd, *since_generation)
+        : copy_file_to(out_fd);
+    if (ok && fsync(out_fd) < 0)
+    {
+        perror("fsync()");
+        ok = false;
+    }
+    close(out_fd);
+
+    if (!ok)
+        return std::nullopt;
+
+    // Anything written from now on is part of the next snapshot
+    auto generation = m_generation;
+    // NOTE: Only the header changes, so the checksum has to be checked before it does
+    m_generation += 1;
+    m_version_chunk->verify_checksum();
+    m_version_chunk->mark_modified();
+    mark_checksum_changed(*m_version_chunk);
+    return generation;
+}
+
+bool DataBase::copy_file_to(int out_fd)
+{
+    // A copy on write clone is instant, but only some filesystems support it
+    if (ioctl(out_fd, FICLONE, m_fd) == 0)
+        return true;
+
+    loff_t in_offset = 0;
+    loff_t out_offset = 0;
+    auto size = (loff_t)m_end_of_data_pointer;
+    while (in_offset < size)
+    {
+        auto copied = copy_file_range(m_fd, &in_offset, out_fd, &out_offset, size - in_offset, 0);
+        if (copied < 0 && errno == EINTR)
+            continue;
+        if (copied <= 0)
+            break;
+    }
+
+    // Otherwise, copy what's left by hand
+    std::vector<char> buffer(1024 * 1024);
+    while (in_offset < size)
+    {
+        auto count = std::min((loff_t)buffer.size(), size - in_offset);
+        read(in_offset, buffer.data(), count);
+        if (pwrite(out_fd, buffer.data(), count, out_offset) != count)
+        {
+            perror("pwrite()");
+            return false;
+        }
+
+        in_offset += count;
+        out_offset += count;
+    }
+
+    // NOTE: Keep any space reserved at the end of the file
+    if (ftruncate(out_fd, size) < 0)
+    {
+        perror("ftruncate()");
+        return false;
+    }
+
+    return true;
+}
+
+bool DataBase::write_incremental_snapshot(int out_fd, uint32_t since_generation)
+{
+    // Find every chunk modified since, including any that have been removed
+    std::vector<std::pair<size_t, size_t>> regions;
+    size_t offset = 0;
+    while (offset < m_end_of_data_pointer)
+    {
+        Chunk chunk(*this, offset);
+        auto size = chunk.header_size() + chunk.stored_size_in_bytes();
+        if (chunk.generation() > since_generation)
+            regions.push_back({ offset, size });
+
+        offset += size + chunk.padding_in_bytes();
+    }
+
+    IncrementalSnapshotHeader header;
+    memcpy(header.magic, incremental_snapshot_magic, sizeof(header.magic));
+    header.since_generation = since_generation;
+    header.generation = m_generation;
+    header.file_size = m_end_of_data_pointer;
+    header.region_count = regions.size();
+    if (!write_all(out_fd, (const char*)&header, sizeof(header)))
+        return false;
+
+    std::vector<char> buffer;
+    for (const auto &[region_offset, region_size] : regions)
+    {
+        uint64_t region[2] = { region_offset, region_size };
+        buffer.resize(region_size);
+        read(region_offset, buffer.data(), buffer.size());
+
+        if (!write_all(out_fd, (const char*)region, sizeof(region)) ||
+            !write_all(out_fd, buffer.data(), buffer.size()))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The newest generation of any chunk in the file
+static std::optional<uint32_t> read_file_generation(int fd)
+{
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0)
+    {
+        perror("fstat()");
+        return std::nullopt;
+    }
+
+    uint32_t generation = 0;
+    size_t offset = 0;
+    while (offset < (size_t)file_stat.st_size)
+    {
+        char header[Config::chunk_header_size];
+        if (pread(fd, header, sizeof(header), offset) != sizeof(header))
+            return std::nullopt;
+
+        uint32_t chunk_generation;
+        uint64_t size, padding;
+        memcpy(&chunk_generation, header + 12, sizeof(uint32_t));
+        memcpy(&size, header + 16, sizeof(uint64_t));
+        memcpy(&padding, header + 24, sizeof(uint64_t));
+
+        generation = std::max(generation, chunk_generation);
+        offset += sizeof(header) + size + padding;
+    }
+
+    return generation;
+}
+
+bool DataBase::apply_snapshot(const std::string &path, const std::string &incremental_path)
+{
+    auto in_fd = ::open(incremental_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0)
+    {
+        perror("open()");
+        return false;
+    }
+
+    auto fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("open()");
+        close(in_fd);
+        return false;
+    }
+
+    auto apply = [&]()
+    {
+        IncrementalSnapshotHeader header;
+        if (!read_all(in_fd, (char*)&header, sizeof(header)) ||
+            memcmp(header.magic, incremental_snapshot_magic, sizeof(header.magic)) != 0)
+        {
+            std::cerr << "DataBase: '" << incremental_path << "' is not an incremental snapshot\n";
+            return false;
+        }
+
+        // It can only be applied to the snapshot it was made from
+        auto generation = read_file_generation(fd);
+        if (read_major_version(fd) != Config::major_version || generation != header.since_generation)
+        {
+            std::cerr << "DataBase: '" << path << "' is not the snapshot with generation "
+                << header.since_generation << "\n";
+            return false;
+        }
+
+        if (ftruncate(fd, header.file_size) < 0)
+        {
+            perror("ftruncate()");
+            return false;
+        }
+
+        std::vector<char> buffer;
+        for (uint64_t i = 0; i < header.region_count; i++)
+        {
+            uint64_t region[2];
+            if (!read_all(in_fd, (char*)region, sizeof(region)))
+                return false;
+
+            buffer.resize(region[1]);
+            if (!read_all(in_fd, buffer.data(), buffer.size()))
+                return false;
+            if (pwrite(fd, buffer.data(), buffer.size(), region[0]) != (ssize_t)buffer.size())
+            {
+                perror("pwrite()");
+                return false;
+            }
+        }
+
+        if (fsync(fd) < 0)
+        {
+            perror("fsync()");
+            return false;
+        }
+
+        return true;
+    };
+
+    auto ok = apply();
+    close(fd);
+    close(in_fd);
+    return ok;
+}
+
+void DataBase::set_memory_budget(size_t limit_in_bytes)
+{
+    m_memory_budget.set_limit(limit_in_bytes);
+    m_page_cache.shrink_to_fit();
+}
+
+MemoryBudget::Reservation DataBase::reserve_memory(size_t wanted_in_bytes)
+{
+    auto reservation = m_memory_budget.reserve(wanted_in_bytes);
+    m_page_cache.shrink_to_fit();
+    return reservation;
+}
+
+DataBase::MemoryStats DataBase::memory_stats() const
+{
+    MemoryStats stats;
+    stats.budget_in_bytes = m_memory_budget.limit_in_bytes();
+    stats.reserved_in_bytes = m_memory_budget.reserved_in_bytes();
+    stats.page_cache_in_bytes = m_page_cache.size_in_bytes();
+    stats.dirty_in_bytes = m_page_cache.dirty_in_bytes();
+    stats.hits = m_page_cache.hits();
+    stats.misses = m_page_cache.misses();
+    stats.evictions = m_page_cache.evictions();
+    stats.spilled_in_bytes = m_memory_budget.spilled_in_bytes();
+    return stats;
+}
+
+std::vector<std::string> DataBase::check_consistency()
+{
+    std::vector<std::string> problems;
+    for (auto &table : m_tables)
+        table.check_consistency(problems);
+
+    return problems;
+}
+
 DataBase::~DataBase()
 {
-    if (m_file)
-        fclose(m_file);
+    // NOTE: Nothing can still be reading into the page cache once it's gone
+    m_async_io.wait();
+    m_page_cache.flush();
+    for (auto &table : m_tables)
+    {
+        table.write_zone_maps();
+        table.write_indexes();
+    }
+    write_checksums();
+
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+std::ostream &operator <<(std::ostream &stream, const DataBase::MemoryStats &stats)
+{
+    stream << "Memory budget: " << stats.budget_in_bytes << " bytes, "
+        << stats.reserved_in_bytes << " reserved by queries\n";
+    stream << "Page cache: " << stats.page_cache_in_bytes << " bytes, "
+        << stats.dirty_in_bytes << " dirty\n";
+    stream << "Page cache hits: " << stats.hits << ", misses: " << stats.misses
+        << ", evictions: " << stats.evictions << "\n";
+    stream << "Spilled: " << stats.spilled_in_bytes << " bytes\n";
+    return stream;
 }
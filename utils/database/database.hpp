@@ -1,6 +1,12 @@
 #pragma once
+#include "config.hpp"
 #include "table.hpp"
+#include "pagecache.hpp"
+#include "memorybudget.hpp"
+#include "asyncio.hpp"
 #include "sql/sql.hpp"
+#include "sql/value.hpp"
+#include <functional>
 #include <iostream>
 #include <optional>
 #include <string>
@@ -12,6 +18,7 @@ namespace DB
     {
         friend Chunk;
         friend DynamicData;
+        friend PageCache;
         friend Table;
         friend IntegerEntry;
         friend TextEntry;
@@ -25,43 +32,174 @@ namespace DB
 
         static std::shared_ptr<DataBase> open(const std::string &path);
 
+        // The format version of an open database file, 0 if it's not a database
+        static int read_major_version(int fd);
+
         Table &construct_table(Table::Constructor);
         Table *get_table(const std::string &name);
+        inline std::vector<Table> &tables() { return m_tables; }
         bool drop_table(const std::string &name);
 
         SqlResult execute_sql(const std::string &query);
 
+        // How long each part of running a query took. Planning is binding its
+        // parameters and choosing how to read its rows, which isn't counted
+        // towards executing it.
+        struct QueryTimings
+        {
+            uint64_t parse_in_nanoseconds { 0 };
+            uint64_t plan_in_nanoseconds { 0 };
+            uint64_t execute_in_nanoseconds { 0 };
+        };
+
+        // Run a query with its '?' parameters bound to the given values,
+        // filling in how long each part took if given timings
+        SqlResult execute_sql(const std::string &query, const std::vector<Sql::Value> &parameters,
+            QueryTimings *timings = nullptr);
+
+        // Called by statements with the time taken choosing how to run them
+        void add_plan_time(uint64_t nanoseconds);
+
+        // Run an INSERT, UPDATE or DELETE once for each set of parameters,
+        // parsing it once and writing everything back together at the end.
+        // NOTE: Nothing is rolled back, so if one fails the ones before it are kept
+        SqlResult execute_many(const std::string &query,
+            const std::vector<std::vector<Sql::Value>> &rows_of_parameters);
+
+        // Queue up the writes of the queries run until end_batch, so they're
+        // all written back together at the end, as with execute_many.
+        // NOTE: Nothing is rolled back, a query that fails doesn't undo those before it
+        void begin_batch();
+        void end_batch();
+
+        // Compress row data chunks once they're no longer being appended to
+        inline void set_compress_sealed_chunks(bool enabled) { m_compress_sealed_chunks = enabled; }
+        inline const PageCache &page_cache() const { return m_page_cache; }
+
+        // Counts of the reads and writes made to the database file
+        struct IOStats
+        {
+            size_t reads { 0 };
+            size_t writes { 0 };
+            size_t bytes_read { 0 };
+            size_t bytes_written { 0 };
+            // NOTE: Also counts compressed chunks that can't be decompressed
+            size_t checksum_failures { 0 };
+        };
+
+        inline const IOStats &io_stats() const { return m_io_stats; }
+
+        // Bound the memory used by the page cache and by queries together
+        void set_memory_budget(size_t limit_in_bytes);
+
+        // Working memory for a query, taken from the page cache's share
+        // of the budget until the reservation is destroyed
+        MemoryBudget::Reservation reserve_memory(size_t wanted_in_bytes);
+
+        struct MemoryStats
+        {
+            size_t budget_in_bytes;
+            size_t reserved_in_bytes;
+            size_t page_cache_in_bytes;
+            size_t dirty_in_bytes;
+            size_t hits;
+            size_t misses;
+            size_t evictions;
+            size_t spilled_in_bytes;
+        };
+
+        MemoryStats memory_stats() const;
+
+        // Called before each write to the database file with its offset and size,
+        // returning how many bytes of it to actually write. This is for testing
+        // what survives a crash, the hook can drop or tear writes, or end the process.
+        using WriteHook = std::function<size_t(size_t offset, size_t size)>;
+        inline void set_write_hook(WriteHook hook) { m_write_hook = std::move(hook); }
+
+        // Check each table's rows agree with its header and
+        // point at text that exists, returning any problems found
+        std::vector<std::string> check_consistency();
+
+        // Write a consistent copy of the database to path, returning its generation.
+        // Given the generation of an earlier snapshot, only the chunks changed since
+        // then are written, which apply_snapshot can apply to a copy of that snapshot.
+        std::optional<uint32_t> snapshot(const std::string &path,
+            std::optional<uint32_t> since_generation = std::nullopt);
+        static bool apply_snapshot(const std::string &path, const std::string &incremental_path);
+        inline uint32_t generation() const { return m_generation; }
+
     private:
-        explicit DataBase(FILE *file);
+        explicit DataBase(int fd);
 
-        std::shared_ptr<Chunk> new_chunk(std::string_view type, uint8_t owner_id, uint8_t index);
+        std::shared_ptr<Chunk> new_chunk(std::string_view type,
+            uint32_t owner_id, uint32_t index, size_t reserve_in_bytes = 0);
+        void write_chunk_header(Chunk&);
         void check_is_active_chunk(Chunk *chunk);
-        uint8_t generate_table_id();
-        Table *find_owner(uint8_t owner_id);
+        void seal_chunk(Chunk&);
+        void relocate_chunk(Chunk&);
+        void discard_chunk(Chunk&);
+        std::vector<char> load_compressed_chunk(Chunk&);
+
+        // A chunk that can't be decompressed is reported as damaged and read as zeros
+        std::vector<char> decompress_chunk(Chunk&, const char *compressed, size_t size);
+        void store_compressed(Chunk&, const std::vector<char> &data);
+        void write_compressed(Chunk&, const std::vector<char> &compressed, size_t raw_size);
+
+        // Checksums are checked against the stored data the first time it's read,
+        // and those changed since the last flush are written to their headers
+        void check_checksum(Chunk&, const char *stored, size_t size);
+        void mark_checksum_changed(Chunk&);
+        void write_checksums();
+        uint32_t generate_table_id();
+        Table *find_owner(uint32_t owner_id);
 
         void check_size(size_t);
+        void truncate(size_t size);
+        void write(size_t offset, const char *data, size_t size);
         void write_byte(size_t offset, char);
         void write_int(size_t offset, int);
         void write_long(size_t offset, int64_t);
         void write_string(size_t offset, const std::string&);
         void write_version_chunk();
         void flush();
+        bool copy_file_to(int out_fd);
+        bool write_incremental_snapshot(int out_fd, uint32_t since_generation);
 
+        // While batching, writes are queued up and submitted together
+        void begin_write_batch();
+        void end_write_batch();
+        void submit_write_batch();
+        void submit_reads(const std::vector<AsyncIO::Request>&);
+
+        void read(size_t offset, char *data, size_t size);
         uint8_t read_byte(size_t offset);
         int read_int(size_t offset);
         int64_t read_long(size_t offset);
         void read_string(size_t offset, char *str, size_t len);
 
-        FILE *m_file;
+        int m_fd;
         size_t m_end_of_data_pointer;
+        uint32_t m_generation { 0 };
+        AsyncIO m_async_io;
+        int m_write_batch_depth { 0 };
+        std::vector<std::pair<size_t, std::string>> m_write_batch;
 
         std::vector<Table> m_tables;
         std::vector<std::shared_ptr<Chunk>> m_chunks;
         std::shared_ptr<Chunk> m_active_chunk { nullptr };
         std::shared_ptr<Chunk> m_version_chunk { nullptr };
+        std::vector<Chunk*> m_checksum_changed_chunks;
+        QueryTimings *m_query_timings { nullptr };
+
+        MemoryBudget m_memory_budget;
+        PageCache m_page_cache;
+        IOStats m_io_stats;
+        WriteHook m_write_hook;
+        bool m_compress_sealed_chunks { Config::compress_sealed_chunks };
 
     };
 
 }
 
 std::ostream &operator <<(std::ostream&, const DB::Chunk&);
+std::ostream &operator <<(std::ostream&, const DB::DataBase::MemoryStats&);
@@ -10,21 +10,23 @@ void DynamicData::set(const std::vector<char> &data)
 
     auto &db = m_chunk->m_db;
 
+    // NOTE: This has to be checked while its size still matches the checksum
+    m_chunk->verify_checksum();
+
     // Remove padding and make it part of the total size
     m_chunk->m_size_in_bytes += m_chunk->m_padding_in_bytes;
     m_chunk->m_padding_in_bytes = 0;
 
-    // If this new data does not fit the current chunk, make a new one
+    // If this new data does not fit the current chunk, move it to the end of the file.
+    // NOTE: The chunk is relocated rather than replaced, as the table keeps hold of it
     if (!m_chunk->is_active() && data.size() > m_chunk->size_in_bytes())
     {
-        auto new_chunk = db.new_chunk("DY", m_chunk->owner_id(), m_chunk->index());
-        m_chunk->drop();
-        m_chunk = new_chunk;
+        db.m_page_cache.evict(*m_chunk);
+        db.relocate_chunk(*m_chunk);
     }
 
     // Copy data into chunk
-    for (size_t i = 0; i < data.size(); i++)
-        m_chunk->write_byte(i, data[i]);
+    m_chunk->write_string(0, std::string(data.data(), data.size()));
 
     // Shrink chunk to fit
     m_chunk->shrink_to(data.size());
@@ -34,14 +36,11 @@ std::vector<char> DynamicData::read()
 {
     assert (m_chunk);
 
-    std::vector<char> buffer(m_chunk->size_in_bytes());
-    for (size_t i = 0; i < buffer.size(); i++)
-        buffer[i] = m_chunk->read_byte(i);
-
-    return buffer;
+    auto data = m_chunk->read_string(0, m_chunk->size_in_bytes());
+    return std::vector<char>(data.begin(), data.end());
 }
 
-int DynamicData::id() const
+uint32_t DynamicData::id() const
 {
     return m_chunk->index();
 }
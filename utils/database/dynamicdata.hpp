@@ -11,7 +11,7 @@ namespace DB
         DynamicData(std::shared_ptr<Chunk> chunk)
             : m_chunk(chunk) {}
 
-        int id() const;
+        uint32_t id() const;
         void set(const std::vector<char> &data);
         std::vector<char> read();
 
@@ -24,7 +24,7 @@ DataType DataType::char_(int size)
 
 DataType DataType::text()
 {
-    return DataType(Text, 1, 1);
+    return DataType(Text, 4, 1);
 }
 
 DataType DataType::big_int()
@@ -45,7 +45,7 @@ int DataType::size_from_primitive(Primitive primitive)
         case BigInt: return 8;
         case Float: return 4;
         case Char: return 1;
-        case Text: return 1;
+        case Text: return 4;
         default: assert (false);
     }
 }
@@ -72,7 +72,7 @@ std::string Entry::as_string() const
 {
     auto trim = [&](auto str)
     {
-        return std::string(str.data(), strlen(str.data()));
+        return std::string(str.data(), strnlen(str.data(), str.size()));
     };
 
     auto type = m_data_type.primitive();
@@ -88,49 +88,54 @@ void Entry::read(Chunk &chunk, size_t offset)
 {
     m_is_null = chunk.read_byte(offset);
     read_data(chunk, offset + 1);
+    m_is_dirty = false;
 }
 
 void Entry::write(Chunk &chunk, size_t offset)
 {
     chunk.write_byte(offset, m_is_null);
     write_data(chunk, offset + 1);
+    m_is_dirty = false;
 }
 
 template <typename T, DataType::Primitive primitive>
 void TemplateEntry<T, primitive>::set(std::unique_ptr<Entry> entry)
 {
+    T t;
     switch (entry->data_type().primitive())
     {
         case DataType::Integer:
-            m_t = (T)static_cast<IntegerEntry&>(*entry).data();
+            t = (T)static_cast<IntegerEntry&>(*entry).data();
             break;
         case DataType::BigInt:
-            m_t = (T)static_cast<BigIntEntry&>(*entry).data();
+            t = (T)static_cast<BigIntEntry&>(*entry).data();
             break;
         case DataType::Float:
-            m_t = (T)static_cast<FloatEntry&>(*entry).data();
+            t = (T)static_cast<FloatEntry&>(*entry).data();
             break;
         default:
             assert (false);
     }
 
+    if (!m_is_null && t == m_t)
+        return;
+
+    m_t = t;
     m_is_null = false;
+    m_is_dirty = true;
 }
 
 template <typename T, DataType::Primitive primitive>
 void TemplateEntry<T, primitive>::read_data(Chunk &chunk, size_t offset)
 {
-    char *bytes = (char*)&m_t;
-    for (int i = 0; i < (int)sizeof(T); i++)
-        bytes[i] = chunk.read_byte(offset + i);
+    auto bytes = chunk.read_string(offset, sizeof(T));
+    memcpy(&m_t, bytes.data(), sizeof(T));
 }
 
 template <typename T, DataType::Primitive primitive>
 void TemplateEntry<T, primitive>::write_data(Chunk &chunk, size_t offset)
 {
-    char *bytes = (char*)&m_t;
-    for (int i = 0; i < (int)sizeof(T); i++)
-        chunk.write_byte(offset + i, bytes[i]);
+    chunk.write_string(offset, std::string((const char*)&m_t, sizeof(T)));
 }
 
 void CharEntry::set(std::unique_ptr<Entry> to)
@@ -140,9 +145,14 @@ void CharEntry::set(std::unique_ptr<Entry> to)
     auto other_str = static_cast<CharEntry&>(*to).data();
     assert ((int)other_str.size() <= m_size);
 
-    memset(m_c.data(), 0, m_size);
-    memcpy(m_c.data(), other_str.data(), other_str.size());
+    std::vector<char> c(m_size, '\0');
+    memcpy(c.data(), other_str.data(), other_str.size());
+    if (!m_is_null && c == m_c)
+        return;
+
+    m_c = std::move(c);
     m_is_null = false;
+    m_is_dirty = true;
 }
 
 void CharEntry::read_data(Chunk &chunk, size_t offset)
@@ -170,30 +180,27 @@ TextEntry::~TextEntry() {}
 
 void TextEntry::set(std::unique_ptr<Entry> to)
 {
+    // NOTE: The text is copied, so each entry keeps its own blob
+    std::string text;
     auto to_type = to->data_type().primitive();
     if (to_type == DataType::Text)
-    {
-        auto &other_text = static_cast<TextEntry&>(*to);
-        m_dynamic_data = std::move(other_text.m_dynamic_data);
-        m_text = other_text.m_text;
-    }
+        text = static_cast<TextEntry&>(*to).m_text;
     else if (to_type == DataType::Char)
-    {
-        auto &other_text = static_cast<CharEntry&>(*to);
-        m_dynamic_data = nullptr;
-        m_text = other_text.data();
-    }
+        text = static_cast<CharEntry&>(*to).data();
     else
-    {
         assert (false);
-    }
 
+    if (!m_is_null && text == m_text)
+        return;
+
+    m_text = std::move(text);
     m_is_null = false;
+    m_is_dirty = true;
 }
 
 void TextEntry::read_data(Chunk &chunk, size_t offset)
 {
-    auto id = chunk.read_byte(offset);
+    auto id = (uint32_t)chunk.read_int(offset);
     auto *table = chunk.db().find_owner(chunk.owner_id());
     assert (table);
 
@@ -208,6 +215,17 @@ void TextEntry::read_data(Chunk &chunk, size_t offset)
 
 void TextEntry::write_data(Chunk &chunk, size_t offset)
 {
+    // NOTE: The blob is only rewritten when the text has changed
+    if (m_dynamic_data && !m_is_dirty)
+        return;
+
+    // NOTE: Null text doesn't need a blob, and no dynamic data has the id 0
+    if (m_is_null && !m_dynamic_data)
+    {
+        chunk.write_int(offset, 0);
+        return;
+    }
+
     if (!m_dynamic_data)
     {
         auto *table = chunk.db().find_owner(chunk.owner_id());
@@ -219,7 +237,7 @@ void TextEntry::write_data(Chunk &chunk, size_t offset)
     memcpy(buffer.data(), m_text.data(), m_text.size());
     m_dynamic_data->set(buffer);
 
-    chunk.write_byte(offset, m_dynamic_data->id());
+    chunk.write_int(offset, m_dynamic_data->id());
 }
 
 std::ostream &operator<< (std::ostream &stream, const DB::Entry& entry)
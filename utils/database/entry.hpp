@@ -68,12 +68,17 @@ namespace DB
         std::string as_string() const;
         inline bool is_null() const { return m_is_null; }
 
+        // Changed since it was last read or written, setting
+        // an entry to the value it already has doesn't count
+        inline bool is_dirty() const { return m_is_dirty; }
+
     protected:
         Entry(DataType data_type, bool is_null = false)
             : m_is_null(is_null)
             , m_data_type(data_type) {}
 
         bool m_is_null;
+        bool m_is_dirty { true };
 
     private:
 
@@ -164,6 +169,7 @@ namespace DB
         virtual void read_data(Chunk &chunk, size_t offset) override;
         virtual void write_data(Chunk &chunk, size_t offset) override;
 
+        // NOTE: The blob is kept when the text changes, and rewritten in place
         std::unique_ptr<DynamicData> m_dynamic_data { nullptr };
         std::string m_text;
 
@@ -6,10 +6,16 @@ namespace DB
     class DataBase;
     class Chunk;
     class DynamicData;
+    class PageCache;
+    class MemoryBudget;
     class Table;
     class Column;
     class Row;
     class Entry;
+    class DataType;
+    class ZoneMap;
+    class TableStats;
+    class SqlResult;
 
     namespace Sql
     {
@@ -21,10 +27,19 @@ namespace DB
         class InsertStatement;
         class CreateTableStatement;
         class CreateTableIfNotExistsStatement;
+        class CreateIndexStatement;
         class UpdateStatement;
         class DeleteStatement;
         class Value;
         class ValueNode;
+        class SpillFile;
+        class Sorter;
+        class HashAggregate;
+        class HashJoin;
+        class QueryPlan;
+        class ExplainStatement;
+        class AnalyzeStatement;
+        class Planner;
 
     };
 
@@ -1,26 +1,74 @@
 #include "database.hpp"
 #include "cleaner.hpp"
 #include "prompt.hpp"
+#include "server.hpp"
+#include "client.hpp"
+#include <fstream>
 #include <iostream>
 #include <cassert>
+#include <optional>
 #include <getopt.h>
+#include <unistd.h>
 using namespace DB;
 
 static struct option cmd_options[] =
 {
     { "help",       no_argument,        0, 'h' },
     { "clean",      no_argument,        0, 'c' },
-    { "info",       no_argument,        0, 'i' }
+    { "info",       no_argument,        0, 'i' },
+    { "upgrade",    no_argument,        0, 'u' },
+    { "scrub",      no_argument,        0, 'r' },
+    { "snapshot",   required_argument,  0, 's' },
+    { "since",      required_argument,  0, 'g' },
+    { "apply",      required_argument,  0, 'a' },
+    { "serve",      required_argument,  0, 'S' },
+    { "connect",    no_argument,        0, 'C' },
+    { "stats",      no_argument,        0, 'm' },
+    { "memory",     required_argument,  0, 'M' },
+    { "file",       required_argument,  0, 'f' },
+    { 0, 0, 0, 0 },
 };
 
 void show_help()
 {
-    std::cout << "usage: database [-h] [-c] [-i] <file>\n";
+    std::cout << "usage: database [-h] [-c] [-i] [-u] [-r] [-s path [-g generation]] [-a path] [-S socket] [-C] [-m] [-M megabytes] [-f script] <file>\n";
     std::cout << "\nManage databases\n";
     std::cout << "\noptional arguments:\n";
     std::cout << "  -h, --help\t\tShow this help message and exit\n";
     std::cout << "  -c, --clean\t\tClean up the database\n";
     std::cout << "  -i, --info\t\tOutput the internal structure\n";
+    std::cout << "  -u, --upgrade\t\tUpgrade the database to the current format\n";
+    std::cout << "  -r, --scrub\t\tCheck every chunk against its checksum\n";
+    std::cout << "  -s, --snapshot\tCopy the database to path, outputting its generation\n";
+    std::cout << "  -g, --since\t\tOnly snapshot what's changed since the given generation\n";
+    std::cout << "  -a, --apply\t\tApply an incremental snapshot from path to the database\n";
+    std::cout << "  -S, --serve\t\tServe queries to clients over a UNIX socket at the given path\n";
+    std::cout << "  -C, --connect\t\tRun queries on the server listening on the socket <file>\n";
+    std::cout << "  -m, --stats\t\tOutput memory and page cache statistics on exit\n";
+    std::cout << "  -M, --memory\t\tLimit the memory used for caching and queries\n";
+    std::cout << "  -f, --file\t\tRun a script of ';' separated statements, stdin is run as one if it's not a terminal\n";
+}
+
+// Run a script if given one or if stdin is piped in, otherwise prompt for queries
+static bool run_prompt(Prompt &prompt, const std::string &script_path)
+{
+    if (!script_path.empty())
+    {
+        std::ifstream script(script_path);
+        if (!script)
+        {
+            perror("open()");
+            return false;
+        }
+
+        return prompt.run_script(script);
+    }
+
+    if (!isatty(STDIN_FILENO))
+        return prompt.run_script(std::cin);
+
+    prompt.run();
+    return true;
 }
 
 int main(int argc, char *argv[])
@@ -30,13 +78,25 @@ int main(int argc, char *argv[])
         Default,
         Clean,
         Info,
+        Upgrade,
+        Scrub,
+        Snapshot,
+        Apply,
+        Serve,
+        Connect,
     };
     
     auto mode = Mode::Default;
+    std::string snapshot_path;
+    std::optional<uint32_t> since_generation;
+    std::string socket_path;
+    bool output_stats = false;
+    std::optional<size_t> memory_budget;
+    std::string script_path;
     for (;;)
     {
         int option_index;
-        int c = getopt_long(argc, argv, "hci",
+        int c = getopt_long(argc, argv, "hciurs:g:a:S:CmM:f:",
             cmd_options, &option_index);
 
         if (c == -1)
@@ -68,10 +128,58 @@ int main(int argc, char *argv[])
                     return 1;
                 mode = Mode::Info;
                 break;
+            case 'u':
+                if (mode_already_set())
+                    return 1;
+                mode = Mode::Upgrade;
+                break;
+            case 'r':
+                if (mode_already_set())
+                    return 1;
+                mode = Mode::Scrub;
+                break;
+            case 's':
+                if (mode_already_set())
+                    return 1;
+                mode = Mode::Snapshot;
+                snapshot_path = optarg;
+                break;
+            case 'g':
+                since_generation = std::stoul(optarg);
+                break;
+            case 'a':
+                if (mode_already_set())
+                    return 1;
+                mode = Mode::Apply;
+                snapshot_path = optarg;
+                break;
+            case 'S':
+                if (mode_already_set())
+                    return 1;
+                mode = Mode::Serve;
+                socket_path = optarg;
+                break;
+            case 'C':
+                if (mode_already_set())
+                    return 1;
+                mode = Mode::Connect;
+                break;
+            case 'm':
+                output_stats = true;
+                break;
+            case 'M':
+                memory_budget = std::stoul(optarg) * 1024 * 1024;
+                break;
+            case 'f':
+                script_path = optarg;
+                break;
         }
     }
 
-    if (optind != argc - 1)
+    if (optind != argc - 1 || (since_generation && mode != Mode::Snapshot) ||
+        (output_stats && mode != Mode::Default) ||
+        (memory_budget && mode != Mode::Default && mode != Mode::Serve) ||
+        (!script_path.empty() && mode != Mode::Default && mode != Mode::Connect))
     {
         show_help();
         return 1;
@@ -82,8 +190,16 @@ int main(int argc, char *argv[])
     {
         case Mode::Default:
         {
-            Prompt prompt(db_path);
-            prompt.run();
+            auto db = DataBase::open(db_path);
+            if (!db)
+                return 1;
+            if (memory_budget)
+                db->set_memory_budget(*memory_budget);
+
+            Prompt prompt(db);
+            prompt.set_output_stats(output_stats);
+            if (!run_prompt(prompt, script_path))
+                return 1;
             break;
         }
         case Mode::Clean:
@@ -98,6 +214,64 @@ int main(int argc, char *argv[])
             cleaner.output_info();
             break;
         }
+        case Mode::Upgrade:
+        {
+            Cleaner cleaner(db_path);
+            if (!cleaner.upgrade())
+                return 1;
+            break;
+        }
+        case Mode::Scrub:
+        {
+            Cleaner cleaner(db_path);
+            if (!cleaner.scrub())
+                return 1;
+            break;
+        }
+        case Mode::Snapshot:
+        {
+            auto db = DataBase::open(db_path);
+            if (!db)
+                return 1;
+
+            auto generation = db->snapshot(snapshot_path, since_generation);
+            if (!generation)
+                return 1;
+            std::cout << *generation << "\n";
+            break;
+        }
+        case Mode::Apply:
+        {
+            if (!DataBase::apply_snapshot(db_path, snapshot_path))
+                return 1;
+            break;
+        }
+        case Mode::Serve:
+        {
+            auto db = DataBase::open(db_path);
+            if (!db)
+                return 1;
+            if (memory_budget)
+                db->set_memory_budget(*memory_budget);
+
+            auto server = Server::listen(db, socket_path);
+            if (!server)
+                return 1;
+
+            server->run();
+            break;
+        }
+        case Mode::Connect:
+        {
+            auto client = Client::connect(db_path);
+            if (!client)
+                return 1;
+
+            Prompt prompt(client);
+            if (!run_prompt(prompt, script_path))
+                return 1;
+            break;
+        }
     }
     return 0;
 }
@@ -0,0 +1,47 @@
+#include "memorybudget.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <cassert>
+using namespace DB;
+
+MemoryBudget::Reservation::Reservation(Reservation &&other)
+    : m_budget(other.m_budget)
+    , m_size_in_bytes(other.m_size_in_bytes)
+{
+    other.m_budget = nullptr;
+    other.m_size_in_bytes = 0;
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    if (!m_budget)
+        return;
+
+    assert (m_budget->m_reserved_in_bytes >= m_size_in_bytes);
+    m_budget->m_reserved_in_bytes -= m_size_in_bytes;
+}
+
+void MemoryBudget::Reservation::count_spill(size_t size_in_bytes)
+{
+    if (m_budget)
+        m_budget->m_spilled_in_bytes += size_in_bytes;
+}
+
+MemoryBudget::Reservation MemoryBudget::reserve(size_t wanted_in_bytes)
+{
+    auto used = m_reserved_in_bytes + Config::min_page_cache_size;
+    auto available = m_limit_in_bytes > used ? m_limit_in_bytes - used : 0;
+
+    // NOTE: A query always gets enough to make progress, even over the limit
+    auto size = std::max(std::min(wanted_in_bytes, available), Config::min_working_memory_size);
+    m_reserved_in_bytes += size;
+    return Reservation(*this, size);
+}
+
+size_t MemoryBudget::page_cache_capacity() const
+{
+    if (m_limit_in_bytes < m_reserved_in_bytes + Config::min_page_cache_size)
+        return Config::min_page_cache_size;
+
+    return m_limit_in_bytes - m_reserved_in_bytes;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "forward.hpp"
+#include <cstddef>
+
+namespace DB
+{
+
+    // One limit on the memory a database uses, shared by the page cache
+    // and the working memory of queries, such as sorting and aggregating.
+    // Queries reserve their working memory while they run, the page cache
+    // gets whatever isn't reserved.
+    // NOTE: The page cache always keeps a minimum, so a query may be given
+    //       less than it asked for, and spill to disk sooner
+    class MemoryBudget
+    {
+    public:
+        // Memory reserved until this is destroyed
+        class Reservation
+        {
+            friend MemoryBudget;
+
+        public:
+            Reservation(const Reservation&) = delete;
+            Reservation(Reservation&&);
+            ~Reservation();
+
+            inline size_t size_in_bytes() const { return m_size_in_bytes; }
+
+            // Count bytes written to disk by the query for lack of memory
+            void count_spill(size_t size_in_bytes);
+
+        private:
+            Reservation(MemoryBudget &budget, size_t size_in_bytes)
+                : m_budget(&budget)
+                , m_size_in_bytes(size_in_bytes) {}
+
+            MemoryBudget *m_budget;
+            size_t m_size_in_bytes;
+
+        };
+
+        explicit MemoryBudget(size_t limit_in_bytes)
+            : m_limit_in_bytes(limit_in_bytes) {}
+
+        MemoryBudget(const MemoryBudget&) = delete;
+        MemoryBudget(MemoryBudget&) = delete;
+
+        Reservation reserve(size_t wanted_in_bytes);
+
+        inline void set_limit(size_t limit_in_bytes) { m_limit_in_bytes = limit_in_bytes; }
+        inline size_t limit_in_bytes() const { return m_limit_in_bytes; }
+        inline size_t reserved_in_bytes() const { return m_reserved_in_bytes; }
+        size_t page_cache_capacity() const;
+
+        inline size_t spilled_in_bytes() const { return m_spilled_in_bytes; }
+
+    private:
+        size_t m_limit_in_bytes;
+        size_t m_reserved_in_bytes { 0 };
+        size_t m_spilled_in_bytes { 0 };
+
+    };
+
+}
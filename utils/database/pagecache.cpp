@@ -0,0 +1,231 @@
+#include "pagecache.hpp"
+#include "database.hpp"
+#include "chunk.hpp"
+#include "memorybudget.hpp"
+#include <cassert>
+#include <cstring>
+using namespace DB;
+
+std::vector<char> &PageCache::data(Chunk &chunk)
+{
+    auto it = m_page_map.find(&chunk);
+    if (it != m_page_map.end())
+    {
+        m_hits += 1;
+        if (it->second->is_loading)
+            finish_loading();
+
+        m_pages.splice(m_pages.begin(), m_pages, it->second);
+        return it->second->data;
+    }
+
+    m_misses += 1;
+    m_pages.push_front({ &chunk, m_db.load_compressed_chunk(chunk), false, false, {} });
+    m_page_map[&chunk] = m_pages.begin();
+    m_size_in_bytes += m_pages.front().data.size();
+    shrink_to_fit();
+
+    return m_pages.front().data;
+}
+
+void PageCache::mark_dirty(Chunk &chunk)
+{
+    auto it = m_page_map.find(&chunk);
+    assert (it != m_page_map.end());
+    it->second->is_dirty = true;
+}
+
+void PageCache::resize(Chunk &chunk, size_t size)
+{
+    auto &page_data = data(chunk);
+    m_size_in_bytes -= page_data.size();
+    page_data.resize(size, (char)0xCD);
+    m_size_in_bytes += page_data.size();
+    mark_dirty(chunk);
+}
+
+void PageCache::evict(Chunk &chunk)
+{
+    auto it = m_page_map.find(&chunk);
+    if (it == m_page_map.end())
+        return;
+
+    // NOTE: The read has to finish before its buffer is freed
+    if (it->second->is_loading)
+        finish_loading();
+
+    m_size_in_bytes -= it->second->data.size();
+    m_pages.erase(it->second);
+    m_page_map.erase(it);
+}
+
+void PageCache::write_back(Page &page)
+{
+    if (!page.is_dirty)
+        return;
+
+    m_db.store_compressed(*page.chunk, page.data);
+    page.is_dirty = false;
+}
+
+void PageCache::shrink_to_fit()
+{
+    // NOTE: Always keep the most recently used page, even
+    //       if it's bigger than the whole cache
+    auto capacity = m_budget.page_cache_capacity();
+    while (m_size_in_bytes > capacity && m_pages.size() > 1)
+    {
+        auto &page = m_pages.back();
+        if (page.is_loading)
+            finish_loading();
+        write_back(page);
+
+        m_size_in_bytes -= page.data.size();
+        m_page_map.erase(page.chunk);
+        m_pages.pop_back();
+        m_evictions += 1;
+    }
+}
+
+size_t PageCache::dirty_in_bytes() const
+{
+    size_t size = 0;
+    for (const auto &page : m_pages)
+    {
+        if (page.is_dirty)
+            size += page.data.size();
+    }
+
+    return size;
+}
+
+void PageCache::flush()
+{
+    // NOTE: Dirty pages are written back as one batch
+    m_db.begin_write_batch();
+    for (auto &page : m_pages)
+        write_back(page);
+    m_db.end_write_batch();
+}
+
+void PageCache::read_ahead(const std::vector<Chunk*> &chunks)
+{
+    std::vector<AsyncIO::Request> requests;
+    for (auto *chunk : chunks)
+    {
+        if (m_page_map.find(chunk) != m_page_map.end())
+            continue;
+
+        m_pages.push_front({ chunk, {}, false, true, {} });
+        m_page_map[chunk] = m_pages.begin();
+
+        auto &page = m_pages.front();
+        auto &buffer = chunk->is_compressed() ? page.compressed : page.data;
+        buffer.resize(chunk->stored_size_in_bytes());
+        m_size_in_bytes += chunk->size_in_bytes();
+        m_loading_count += 1;
+        requests.push_back({ chunk->data_offset(), buffer.data(), buffer.size() });
+    }
+
+    if (requests.empty())
+        return;
+
+    m_db.submit_reads(requests);
+    shrink_to_fit();
+}
+
+void PageCache::load(Chunk &chunk)
+{
+    auto it = m_page_map.find(&chunk);
+    if (it != m_page_map.end())
+    {
+        if (it->second->is_loading)
+            finish_loading();
+        return;
+    }
+
+    // NOTE: A single read is quicker done straight away than through the
+    //       async queue, this is only for uncompressed chunks so what's stored is the data
+    assert (!chunk.is_compressed());
+    std::vector<char> data(chunk.stored_size_in_bytes());
+    m_db.read(chunk.data_offset(), data.data(), data.size());
+    m_db.check_checksum(chunk, data.data(), data.size());
+
+    m_pages.push_front({ &chunk, std::move(data), false, false, {} });
+    m_page_map[&chunk] = m_pages.begin();
+    m_size_in_bytes += m_pages.front().data.size();
+    shrink_to_fit();
+}
+
+void PageCache::finish_loading()
+{
+    if (!m_loading_count)
+        return;
+
+    auto ok = m_db.m_async_io.wait();
+    assert (ok);
+
+    for (auto &page : m_pages)
+    {
+        if (!page.is_loading)
+            continue;
+
+        // NOTE: A chunk can be compressed while it's being read, so go by what was read
+        const auto &stored = page.compressed.empty() ? page.data : page.compressed;
+        if (!page.chunk->m_has_been_verified)
+            m_db.check_checksum(*page.chunk, stored.data(), stored.size());
+
+        if (!page.compressed.empty())
+        {
+            page.data = m_db.decompress_chunk(*page.chunk, page.compressed.data(), page.compressed.size());
+            page.compressed = {};
+        }
+
+        page.is_loading = false;
+    }
+
+    m_loading_count = 0;
+}
+
+const char *PageCache::find(Chunk &chunk, size_t offset, size_t size)
+{
+    // NOTE: Reads of uncached chunks go to the file instead, so count as misses
+    auto it = m_page_map.find(&chunk);
+    if (it == m_page_map.end())
+    {
+        m_misses += 1;
+        return nullptr;
+    }
+
+    auto &page = *it->second;
+    if (page.is_loading)
+        finish_loading();
+    if (offset + size > page.data.size())
+    {
+        m_misses += 1;
+        return nullptr;
+    }
+
+    m_hits += 1;
+    return page.data.data() + offset;
+}
+
+void PageCache::write_through(Chunk &chunk, size_t offset, const char *data, size_t size)
+{
+    auto it = m_page_map.find(&chunk);
+    if (it == m_page_map.end())
+        return;
+
+    auto &page = *it->second;
+    if (page.is_loading)
+        finish_loading();
+
+    // The chunk has grown past what was cached
+    if (offset + size > page.data.size())
+    {
+        evict(chunk);
+        return;
+    }
+
+    memcpy(page.data.data() + offset, data, size);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "forward.hpp"
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace DB
+{
+
+    // Holds the decompressed contents of compressed chunks, so a scan
+    // only has to read and decompress each chunk once. Pages are evicted
+    // least recently used first once the cache grows past what the memory
+    // budget leaves it, dirty pages are written back before they're evicted.
+    // Scans also read chunks ahead of themselves into the cache, uncompressed
+    // chunks included. Writes to those go through to the file as well.
+    class PageCache
+    {
+    public:
+        PageCache(DataBase &db, const MemoryBudget &budget)
+            : m_db(db)
+            , m_budget(budget) {}
+
+        std::vector<char> &data(Chunk&);
+        void mark_dirty(Chunk&);
+        void resize(Chunk&, size_t size);
+        void evict(Chunk&);
+        void flush();
+
+        // Evict pages until the cache fits its share of the budget again
+        void shrink_to_fit();
+
+        // Start reading chunks that aren't cached yet in the background
+        void read_ahead(const std::vector<Chunk*>&);
+
+        // Read a chunk into the cache now, checking it against its checksum
+        void load(Chunk&);
+
+        // The cached data of an uncompressed chunk, if it covers the range
+        const char *find(Chunk&, size_t offset, size_t size);
+        void write_through(Chunk&, size_t offset, const char *data, size_t size);
+
+        inline size_t size_in_bytes() const { return m_size_in_bytes; }
+        inline size_t hits() const { return m_hits; }
+        inline size_t misses() const { return m_misses; }
+        inline size_t evictions() const { return m_evictions; }
+        size_t dirty_in_bytes() const;
+
+    private:
+        struct Page
+        {
+            Chunk *chunk;
+            std::vector<char> data;
+            bool is_dirty;
+            bool is_loading;
+
+            // The stored data of a compressed chunk while it's being read
+            std::vector<char> compressed;
+        };
+
+        void write_back(Page&);
+        void finish_loading();
+
+        DataBase &m_db;
+        const MemoryBudget &m_budget;
+        size_t m_size_in_bytes { 0 };
+        size_t m_hits { 0 };
+        size_t m_misses { 0 };
+        size_t m_evictions { 0 };
+        size_t m_loading_count { 0 };
+
+        std::list<Page> m_pages;
+        std::unordered_map<Chunk*, std::list<Page>::iterator> m_page_map;
+
+    };
+
+}
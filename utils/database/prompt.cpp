@@ -1,6 +1,9 @@
 #include "config.hpp"
 #include "prompt.hpp"
 #include "database.hpp"
+#include "client.hpp"
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 using namespace DB;
 
@@ -9,27 +12,227 @@ Prompt::Prompt(const std::string &database_path)
     m_db = DataBase::open(database_path);
 }
 
+Prompt::Prompt(std::shared_ptr<DataBase> db)
+    : m_db(std::move(db))
+{
+}
+
+Prompt::Prompt(std::shared_ptr<Client> client)
+    : m_client(std::move(client))
+{
+}
+
+static std::string trim(const std::string &str)
+{
+    auto start = str.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return "";
+
+    auto end = str.find_last_not_of(" \t\r\n");
+    return str.substr(start, end - start + 1);
+}
+
+// Add a line to the statement being read, moving the statements it
+// finishes into statements. The rest of a line after '--' is a comment.
+static void read_statements(const std::string &line, std::string &pending,
+    std::vector<std::string> &statements)
+{
+    // NOTE: Strings can't contain a quote, so one is
+    //       open if the pending statement has an odd number
+    bool in_string = false;
+    for (char c : pending)
+        in_string ^= (c == '\'');
+
+    if (!pending.empty())
+        pending += '\n';
+
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        char c = line[i];
+        if (c == '\'')
+            in_string = !in_string;
+
+        if (!in_string && c == '-' && i + 1 < line.size() && line[i + 1] == '-')
+            break;
+
+        if (!in_string && c == ';')
+        {
+            auto statement = trim(pending);
+            if (!statement.empty())
+                statements.push_back(std::move(statement));
+            pending.clear();
+            continue;
+        }
+
+        pending += c;
+    }
+
+    if (trim(pending).empty())
+        pending.clear();
+}
+
 void Prompt::run()
 {
+    if (!m_db && !m_client)
+        return;
+
     std::cout << "DataBase V" 
         << Config::major_version << "." << Config::minor_version
         << " prompt\n\n";
     
-    for (;;)
+    std::string pending;
+    while (!m_has_exited)
     {
-        std::cout << ">> ";
+        std::cout << (pending.empty() ? ">> " : ".. ");
         
         std::string line;
         std::getline(std::cin, line);
-        if (line == "exit")
+        if (!std::cin)
             break;
-        
-        auto result = m_db->execute_sql(line);
-        if (!result.good())
-            result.output_errors();
-        
-        for (auto &row : result)
-            std::cout << row << "\n";
-        std::cout << "\n";
+
+        if (pending.empty() && run_command(line))
+            continue;
+
+        std::vector<std::string> statements;
+        read_statements(line, pending, statements);
+        for (const auto &statement : statements)
+            execute(statement);
+    }
+
+    if (m_output_stats && m_db)
+        std::cout << "\n" << m_db->memory_stats();
+}
+
+bool Prompt::run_script(std::istream &script)
+{
+    if (!m_db && !m_client)
+        return false;
+
+    if (m_db)
+        m_db->begin_batch();
+
+    bool succeeded = true;
+    std::string pending;
+    std::string line;
+    while (succeeded && !m_has_exited && std::getline(script, line))
+    {
+        if (pending.empty() && run_command(line))
+            continue;
+
+        std::vector<std::string> statements;
+        read_statements(line, pending, statements);
+        for (size_t i = 0; i < statements.size() && succeeded; i++)
+            succeeded = execute(statements[i]);
+    }
+
+    // NOTE: The last statement doesn't need a ';'
+    if (succeeded && !m_has_exited && !pending.empty())
+        succeeded = execute(trim(pending));
+
+    if (m_db)
+        m_db->end_batch();
+
+    if (m_output_stats && m_db)
+        std::cout << "\n" << m_db->memory_stats();
+    return succeeded;
+}
+
+bool Prompt::run_command(const std::string &line)
+{
+    auto command = trim(line);
+    if (command == "exit")
+    {
+        m_has_exited = true;
+        return true;
+    }
+
+    if (command == "\\timing")
+    {
+        m_timing = !m_timing;
+        std::cout << "Timing is " << (m_timing ? "on" : "off") << "\n\n";
+        return true;
     }
+
+    if (command == "stats" && m_db)
+    {
+        std::cout << m_db->memory_stats() << "\n";
+        return true;
+    }
+
+    return false;
+}
+
+bool Prompt::execute(const std::string &query)
+{
+    if (m_client)
+        return execute_on_server(query);
+
+    DataBase::QueryTimings timings;
+    auto result = m_db->execute_sql(query, {}, m_timing ? &timings : nullptr);
+    if (!result.good())
+        result.output_errors();
+    
+    size_t row_count = 0;
+    for (auto &row : result)
+    {
+        std::cout << row << "\n";
+        row_count += 1;
+    }
+    std::cout << "\n";
+
+    if (m_timing && result.good())
+    {
+        output_timing(timings.parse_in_nanoseconds, timings.plan_in_nanoseconds,
+            timings.execute_in_nanoseconds, row_count);
+    }
+    return result.good();
+}
+
+bool Prompt::execute_on_server(const std::string &query)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto result = m_client->execute(query);
+    auto time_in_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    if (!result)
+        return false;
+
+    for (const auto &error : result->errors())
+        std::cerr << "SQL Error: " << error << "\n";
+
+    for (size_t row = 0; row < result->row_count(); row++)
+    {
+        std::cout << "Row: { ";
+        for (size_t column = 0; column < result->column_count(); column++)
+            std::cout << result->column_name(column) << ": " << result->value(row, column) << ", ";
+        std::cout << "}\n";
+    }
+    std::cout << "\n";
+
+    // NOTE: The server doesn't say how long each part took,
+    //       so it's all counted as executing
+    if (m_timing && result->errors().empty())
+        output_timing(0, 0, time_in_nanoseconds, result->row_count());
+    return result->errors().empty();
+}
+
+void Prompt::output_timing(uint64_t parse_in_nanoseconds, uint64_t plan_in_nanoseconds,
+    uint64_t execute_in_nanoseconds, size_t row_count)
+{
+    auto total_in_nanoseconds = parse_in_nanoseconds + plan_in_nanoseconds + execute_in_nanoseconds;
+    auto milliseconds = [](uint64_t nanoseconds) { return nanoseconds / 1e6; };
+
+    auto flags = std::cout.flags();
+    auto precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(3)
+        << "Time: " << milliseconds(total_in_nanoseconds) << " ms (parse "
+        << milliseconds(parse_in_nanoseconds) << " ms, plan "
+        << milliseconds(plan_in_nanoseconds) << " ms, execute "
+        << milliseconds(execute_in_nanoseconds) << " ms), " << row_count << " rows";
+    if (row_count > 0 && total_in_nanoseconds > 0)
+        std::cout << std::setprecision(0) << ", " << row_count / (total_in_nanoseconds / 1e9) << " rows/s";
+    std::cout << "\n\n";
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
 }
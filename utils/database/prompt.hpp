@@ -1,19 +1,48 @@
 #pragma once
 #include "forward.hpp"
+#include <istream>
 #include <string>
 #include <memory>
 
 namespace DB
 {
-    
+
+    class Client;
+
     class Prompt
     {
     public:
         Prompt(const std::string &database_path);
+        Prompt(std::shared_ptr<DataBase> db);
+
+        // Run queries on a database server instead
+        Prompt(std::shared_ptr<Client> client);
+
+        // Output the database's memory statistics once the prompt exits
+        inline void set_output_stats(bool enabled) { m_output_stats = enabled; }
+
+        // Statements end with a ';', so they can span many lines
         void run();
+
+        // Run a script of statements, stopping at the first that fails.
+        // Returns if they all succeeded.
+        // NOTE: Its writes are written back together at the end, but
+        //       nothing is rolled back if a statement fails
+        bool run_script(std::istream&);
         
     private:
+        // Handle 'exit', 'stats' and '\timing', returning if the line was one
+        bool run_command(const std::string &line);
+        bool execute(const std::string &query);
+        bool execute_on_server(const std::string &query);
+        void output_timing(uint64_t parse_in_nanoseconds, uint64_t plan_in_nanoseconds,
+            uint64_t execute_in_nanoseconds, size_t row_count);
+
         std::shared_ptr<DataBase> m_db;
+        std::shared_ptr<Client> m_client;
+        bool m_output_stats { false };
+        bool m_timing { false };
+        bool m_has_exited { false };
     
     };
     
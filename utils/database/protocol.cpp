@@ -0,0 +1,49 @@
+#include "protocol.hpp"
+#include <cassert>
+#include <cstring>
+using namespace DB;
+using namespace DB::Protocol;
+
+template<typename T>
+static void put(std::string &out, T value)
+{
+    out.append((const char*)&value, sizeof(T));
+}
+
+template<typename T>
+static bool get(std::string_view &in, T &value)
+{
+    if (in.size() < sizeof(T))
+        return false;
+
+    memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+void Protocol::append_message(std::string &out, MessageType type, std::string_view payload)
+{
+    assert (payload.size() <= UINT32_MAX);
+    put<uint32_t>(out, payload.size());
+    put<uint8_t>(out, (uint8_t)type);
+    out.append(payload);
+}
+
+std::optional<size_t> Protocol::message_size(std::string_view data)
+{
+    uint32_t payload_size;
+    if (!get(data, payload_size))
+        return std::nullopt;
+
+    return message_header_size + payload_size;
+}
+
+std::optional<Message> Protocol::parse_message(std::string_view data)
+{
+    auto size = message_size(data);
+    if (!size || data.size() < *size)
+        return std::nullopt;
+
+    return Message { (MessageType)data[sizeof(uint32_t)],
+        data.substr(message_header_size, *size - message_header_size) };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// The protocol spoken between a database server and its clients.
+// Every message is a u32 payload size and a u8 type, followed by the payload.
+// Clients can send any number of queries without waiting, and the
+// results come back in the same order, encoded by SqlResult::encode().
+namespace DB::Protocol
+{
+
+    enum class MessageType : uint8_t
+    {
+        Query = 1,
+        Result = 2,
+    };
+
+    static size_t constexpr message_header_size = sizeof(uint32_t) + sizeof(uint8_t);
+
+    struct Message
+    {
+        MessageType type;
+        std::string_view payload;
+    };
+
+    void append_message(std::string &out, MessageType, std::string_view payload);
+
+    // The total size of the first message in data, once its header has arrived
+    std::optional<size_t> message_size(std::string_view data);
+
+    // The first message in data, if all of it has arrived
+    std::optional<Message> parse_message(std::string_view data);
+
+}
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <utility>
 using namespace DB;
 
 Row::Row(const std::vector<Column> &columns)
@@ -42,14 +43,7 @@ Row::Row(std::vector<std::string> select_columns, Row &&other)
 
 std::unique_ptr<Entry> const &Row::operator [](const std::string &name)
 {
-    for (auto &entity : m_entities)
-    {
-        if (entity.column.name() == name)
-            return entity.entry;
-    }
-
-    // TODO: Error: This column doesn't exist
-    assert (false);
+    return std::as_const(*this)[name];
 }
 
 const std::unique_ptr<Entry> &Row::operator [](const std::string &name) const
@@ -60,6 +54,14 @@ const std::unique_ptr<Entry> &Row::operator [](const std::string &name) const
             return entity.entry;
     }
 
+    // NOTE: Joined rows have columns named 'table.column', which can
+    //       also be found by just the column name
+    for (const auto &entity : m_entities)
+    {
+        if (entity.column.has_name(name))
+            return entity.entry;
+    }
+
     // TODO: Error: This column doesn't exist
     assert (false);
 }
@@ -88,8 +90,8 @@ void Row::read(Chunk &chunk, size_t row_offset)
 
 void Row::write(Chunk &chunk, size_t row_offset)
 {
-    for (size_t i = row_offset; i < m_row_size; i++)
-        chunk.write_byte(i, 0xCD);
+    // NOTE: Only the row header is padding, the entries cover the rest
+    chunk.write_string(row_offset, std::string(Config::row_header_size, (char)0xCD));
 
     for (const auto &entitiy : m_entities)
     {
@@ -99,3 +101,14 @@ void Row::write(Chunk &chunk, size_t row_offset)
             entry->write(chunk, offset);
     }
 }
+
+void Row::write_changed(Chunk &chunk, size_t row_offset)
+{
+    for (const auto &entitiy : m_entities)
+    {
+        auto &entry = entitiy.entry;
+        auto offset = row_offset + entitiy.offset_in_row;
+        if (entry && entry->is_dirty())
+            entry->write(chunk, offset);
+    }
+}
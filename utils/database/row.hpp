@@ -13,6 +13,10 @@ namespace DB
     {
         friend Table;
         friend Sql::SelectStatement;
+        friend Sql::SpillFile;
+        friend Sql::HashAggregate;
+        friend Sql::HashJoin;
+        friend Sql::QueryPlan;
 
     public:
         class const_itorator
@@ -46,6 +50,10 @@ namespace DB
         void read(Chunk &chunk, size_t row_offset);
         void write(Chunk &chunk, size_t row_offset);
 
+        // Write only the entries that have changed since the row was read,
+        // the row has to already be at this offset
+        void write_changed(Chunk &chunk, size_t row_offset);
+
     private:
         explicit Row(const std::vector<Column> &columns);
 
@@ -0,0 +1,318 @@
+#include "server.hpp"
+#include "config.hpp"
+#include "database.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace DB;
+
+// NOTE: Enough for the biggest message, anything more waits in the socket
+static constexpr size_t max_input_size = Protocol::message_header_size + Config::max_message_size;
+
+static bool make_address(const std::string &socket_path, sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Server: Socket path '" << socket_path << "' is too long\n";
+        return false;
+    }
+
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+    return true;
+}
+
+std::shared_ptr<Server> Server::listen(std::shared_ptr<DataBase> db, const std::string &socket_path)
+{
+    if (!db)
+        return nullptr;
+
+    sockaddr_un address;
+    if (!make_address(socket_path, address))
+        return nullptr;
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket()");
+        return nullptr;
+    }
+
+    // NOTE: A socket left behind by a server that's gone away can be
+    //       replaced, but not one that's still being served
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) == 0)
+    {
+        std::cerr << "Server: '" << socket_path << "' is already being served\n";
+        close(fd);
+        return nullptr;
+    }
+    unlink(socket_path.c_str());
+
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+    {
+        perror("bind()");
+        close(fd);
+        return nullptr;
+    }
+
+    return std::shared_ptr<Server>(new Server(std::move(db), socket_path, fd));
+}
+
+Server::Server(std::shared_ptr<DataBase> db, const std::string &socket_path, int listen_fd)
+    : m_db(std::move(db))
+    , m_socket_path(socket_path)
+    , m_listen_fd(listen_fd)
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0)
+        perror("epoll_create1()");
+
+    // Handle interrupts in the event loop, so the database is closed cleanly
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    m_signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_signal_fd < 0)
+        perror("signalfd()");
+
+    for (auto fd : { m_listen_fd, m_signal_fd })
+    {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+            perror("epoll_ctl()");
+    }
+}
+
+Server::~Server()
+{
+    for (auto &[fd, connection] : m_connections)
+        close(fd);
+
+    close(m_listen_fd);
+    unlink(m_socket_path.c_str());
+
+    if (m_signal_fd >= 0)
+        close(m_signal_fd);
+    if (m_epoll_fd >= 0)
+        close(m_epoll_fd);
+}
+
+void Server::run()
+{
+    std::vector<epoll_event> events(Config::server_max_events);
+    for (;;)
+    {
+        auto event_count = epoll_wait(m_epoll_fd, events.data(), events.size(), -1);
+        if (event_count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("epoll_wait()");
+            return;
+        }
+
+        for (int i = 0; i < event_count; i++)
+        {
+            auto fd = events[i].data.fd;
+            if (fd == m_signal_fd)
+                return;
+
+            if (fd == m_listen_fd)
+            {
+                accept_connections();
+                continue;
+            }
+
+            auto it = m_connections.find(fd);
+            if (it == m_connections.end())
+                continue;
+
+            auto &connection = it->second;
+            auto is_open = true;
+            // NOTE: Queries held back while the client wasn't reading
+            //       its results are run once it's caught up
+            if (events[i].events & EPOLLOUT)
+                is_open = write_output(connection) && handle_messages(connection) && write_output(connection);
+
+            if (is_open && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                // NOTE: Every query that's arrived is run before writing any
+                //       results, so pipelined queries go out in one write
+                is_open = read_input(connection);
+                is_open = handle_messages(connection) && is_open;
+                is_open = write_output(connection) && is_open;
+            }
+
+            if (!is_open)
+                close_connection(connection);
+        }
+    }
+}
+
+void Server::accept_connections()
+{
+    for (;;)
+    {
+        auto fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("accept4()");
+            return;
+        }
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            perror("epoll_ctl()");
+            close(fd);
+            continue;
+        }
+
+        Connection connection;
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+        m_connections.emplace(fd, std::move(connection));
+    }
+}
+
+void Server::close_connection(Connection &connection)
+{
+    auto fd = connection.fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    m_connections.erase(fd);
+}
+
+bool Server::has_too_much_output(const Connection &connection)
+{
+    return connection.output.size() - connection.output_offset > Config::server_max_pending_output;
+}
+
+bool Server::read_input(Connection &connection)
+{
+    char buffer[64 * 1024];
+    while (connection.input.size() < max_input_size)
+    {
+        auto wanted = std::min(sizeof(buffer), max_input_size - connection.input.size());
+        auto result = recv(connection.fd, buffer, wanted, 0);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        // NOTE: The client may still be waiting for results
+        if (result == 0)
+        {
+            connection.has_hung_up = true;
+            return true;
+        }
+
+        connection.input.append(buffer, result);
+    }
+
+    return true;
+}
+
+bool Server::handle_messages(Connection &connection)
+{
+    std::string_view input = connection.input;
+    size_t consumed = 0;
+    while (!has_too_much_output(connection))
+    {
+        auto size = Protocol::message_size(input.substr(consumed));
+        if (size && *size > Config::max_message_size)
+        {
+            std::cerr << "Server: Message of " << *size << " bytes is too big\n";
+            return false;
+        }
+
+        auto message = Protocol::parse_message(input.substr(consumed));
+        if (!message)
+            break;
+        consumed += *size;
+
+        if (message->type != Protocol::MessageType::Query)
+        {
+            std::cerr << "Server: Unexpected message type " << (int)message->type << "\n";
+            return false;
+        }
+
+        auto result = m_db->execute_sql(std::string(message->payload));
+        Protocol::append_message(connection.output,
+            Protocol::MessageType::Result, result.encode());
+    }
+
+    connection.input.erase(0, consumed);
+    return true;
+}
+
+bool Server::write_output(Connection &connection)
+{
+    while (connection.output_offset < connection.output.size())
+    {
+        auto result = send(connection.fd,
+            connection.output.data() + connection.output_offset,
+            connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            break;
+        }
+
+        connection.output_offset += result;
+    }
+
+    if (connection.output_offset == connection.output.size())
+    {
+        connection.output.clear();
+        connection.output_offset = 0;
+    }
+
+    if (connection.has_hung_up && connection.output.empty() && !Protocol::parse_message(connection.input))
+        return false;
+
+    // Only wait to write while there's something left to, and stop reading
+    // queries while a client isn't reading their results
+    auto is_reading = !connection.has_hung_up && !has_too_much_output(connection);
+    uint32_t events = is_reading ? (uint32_t)EPOLLIN : 0u;
+    if (!connection.output.empty())
+        events |= EPOLLOUT;
+
+    if (events != connection.events)
+    {
+        epoll_event event {};
+        event.events = events;
+        event.data.fd = connection.fd;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, connection.fd, &event) < 0)
+        {
+            perror("epoll_ctl()");
+            return false;
+        }
+        connection.events = events;
+    }
+
+    return true;
+}
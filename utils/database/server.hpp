@@ -0,0 +1,57 @@
+#pragma once
+#include "forward.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace DB
+{
+
+    // Keeps a database open and serves queries to any number of
+    // clients over a UNIX domain socket, from a single event loop
+    class Server
+    {
+    public:
+        ~Server();
+
+        Server(const Server&) = delete;
+        Server(Server&) = delete;
+
+        static std::shared_ptr<Server> listen(std::shared_ptr<DataBase>, const std::string &socket_path);
+
+        // Serve clients until interrupted with SIGINT or SIGTERM
+        void run();
+
+    private:
+        Server(std::shared_ptr<DataBase>, const std::string &socket_path, int listen_fd);
+
+        struct Connection
+        {
+            int fd;
+            std::string input;
+            std::string output;
+            size_t output_offset { 0 };
+            bool has_hung_up { false };
+            uint32_t events { 0 };
+        };
+
+        void accept_connections();
+        void close_connection(Connection&);
+
+        static bool has_too_much_output(const Connection&);
+
+        // Returns false if the connection should be closed
+        bool read_input(Connection&);
+        bool handle_messages(Connection&);
+        bool write_output(Connection&);
+
+        std::shared_ptr<DataBase> m_db;
+        std::string m_socket_path;
+        int m_listen_fd;
+        int m_epoll_fd { -1 };
+        int m_signal_fd { -1 };
+        std::unordered_map<int, Connection> m_connections;
+
+    };
+
+}
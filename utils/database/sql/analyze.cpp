@@ -0,0 +1,21 @@
+#include "analyze.hpp"
+#include "../database.hpp"
+using namespace DB;
+using namespace DB::Sql;
+
+SqlResult AnalyzeStatement::execute(DataBase &db) const
+{
+    if (!m_table)
+    {
+        for (auto &table : db.tables())
+            table.analyze();
+        return SqlResult::ok();
+    }
+
+    auto table = db.get_table(*m_table);
+    if (!table)
+        return SqlResult::error("No table with the name '" + *m_table + "' found");
+
+    table->analyze();
+    return SqlResult::ok();
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "statement.hpp"
+#include <optional>
+#include <string>
+
+namespace DB::Sql
+{
+
+    class AnalyzeStatement : public Statement
+    {
+        friend Parser;
+
+    public:
+        virtual SqlResult execute(DataBase&) const override;
+
+    private:
+        AnalyzeStatement()
+            : Statement(Type::Analyze) {}
+
+        // NOTE: Every table is analysed if none is given
+        std::optional<std::string> m_table;
+
+    };
+
+}
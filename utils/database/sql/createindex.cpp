@@ -0,0 +1,32 @@
+#include "createindex.hpp"
+#include "../table.hpp"
+#include "../database.hpp"
+using namespace DB;
+using namespace DB::Sql;
+
+SqlResult CreateIndexStatement::execute(DataBase &db) const
+{
+    auto table = db.get_table(m_table);
+    if (!table)
+        return SqlResult::error("No table with the name '" + m_table + "' found");
+
+    const Column *column = nullptr;
+    for (const auto &it : table->columns())
+    {
+        if (it.name() == m_column)
+            column = &it;
+    }
+
+    if (!column)
+        return SqlResult::error("No column with the name '" + m_column + "' found");
+
+    auto primitive = column->data_type().primitive();
+    if (primitive != DataType::Char && primitive != DataType::Text)
+        return SqlResult::error("Only Char and Text columns can be indexed");
+
+    if (table->find_index(m_column))
+        return SqlResult::error("Column '" + m_column + "' is already indexed");
+
+    table->create_index(m_column);
+    return SqlResult::ok();
+}
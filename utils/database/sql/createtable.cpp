@@ -36,6 +36,23 @@ SqlResult CreateTableStatement::execute(DataBase& db) const
         tc.add_column(column.name, *type);
     }
 
+    if (!m_partition_column.empty())
+    {
+        auto column = std::find_if(m_columns.begin(), m_columns.end(),
+            [&](const auto &it) { return it.name == m_partition_column; });
+        if (column == m_columns.end())
+            return SqlResult::error("No column with the name '" + m_partition_column + "' to partition by");
+
+        auto type_name = column->type;
+        std::for_each(type_name.begin(), type_name.end(), [](char &c) { c = ::tolower(c); });
+        if (type_name != "integer" && type_name != "bigint")
+            return SqlResult::error("Can only partition by an Integer or BigInt column");
+        if (m_partition_width <= 0)
+            return SqlResult::error("Partitions have to be at least 1 wide");
+
+        tc.partition_by(m_partition_column, m_partition_width);
+    }
+
     db.construct_table(tc);
     return SqlResult::ok();
 }
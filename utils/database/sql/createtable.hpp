@@ -28,6 +28,10 @@ namespace DB::Sql
         std::string m_name;
         std::vector<Column> m_columns;
 
+        // NOTE: Only set for a partitioned table
+        std::string m_partition_column;
+        int64_t m_partition_width { 0 };
+
     };
 
 }
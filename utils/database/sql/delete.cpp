@@ -11,14 +11,32 @@ SqlResult DeleteStatement::execute(DataBase &db) const
     auto table = db.get_table(m_table);
     if (!table)
         return SqlResult::error("No table with the name '" + m_table + "' found");
+    if (auto unknown = m_where->unknown_column(table->columns()))
+        return SqlResult::error("No column with the name '" + *unknown + "' found");
+
+    // NOTE: Rows of a partitioned table can only go a whole partition at a time
+    if (const auto &partitioning = table->partitioning())
+    {
+        auto time = m_where->upper_bound(partitioning->column);
+        if (!time)
+        {
+            return SqlResult::error("Rows can only be deleted from '" + m_table +
+                "' a whole partition at a time, with '" + partitioning->column + " <' a time");
+        }
+
+        if (!table->drop_partitions_before(*time))
+            return SqlResult::error("Can't delete part of a partition of '" + m_table + "'");
+        return SqlResult::ok();
+    }
     
+    m_where->order_by_selectivity(table->stats());
     for (size_t i = 0; i < table->row_count(); i++)
     {
         auto row = table->get_row(i);
         assert (row);
         
         auto result = m_where->evaluate(*row);
-        if (result.as_bool())
+        if (result.is_true())
             table->remove_row(i);
     }
     
@@ -0,0 +1,15 @@
+#include "explain.hpp"
+#include "queryplan.hpp"
+#include "../database.hpp"
+using namespace DB;
+using namespace DB::Sql;
+
+SqlResult ExplainStatement::execute(DataBase &db) const
+{
+    QueryPlan plan;
+    auto result = m_statement->explain(db, plan, m_analyze);
+    if (!result.good())
+        return result;
+
+    return plan.as_result(m_analyze);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "statement.hpp"
+
+namespace DB::Sql
+{
+
+    class ExplainStatement : public Statement
+    {
+        friend Parser;
+
+    public:
+        virtual SqlResult execute(DataBase&) const override;
+
+    private:
+        ExplainStatement()
+            : Statement(Type::Explain) {}
+
+        std::shared_ptr<Statement> m_statement;
+        bool m_analyze { false };
+
+    };
+
+}
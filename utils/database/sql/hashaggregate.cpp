@@ -0,0 +1,372 @@
+#include "hashaggregate.hpp"
+#include "../config.hpp"
+#include "../entry.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+using namespace DB;
+using namespace DB::Sql;
+
+static constexpr size_t partition_count = 8;
+static constexpr int max_spill_depth = 8;
+
+std::optional<HashAggregate::Aggregate::Function> HashAggregate::Aggregate::function_from_name(const std::string &name)
+{
+    auto lower = name;
+    std::for_each(lower.begin(), lower.end(), [](char &c)
+    {
+        c = ::tolower(c);
+    });
+
+    if (lower == "count")
+        return Count;
+    else if (lower == "sum")
+        return Sum;
+    else if (lower == "min")
+        return Min;
+    else if (lower == "max")
+        return Max;
+    else if (lower == "avg")
+        return Avg;
+    return std::nullopt;
+}
+
+std::string HashAggregate::Aggregate::name() const
+{
+    auto argument = column.empty() ? "*" : column;
+    switch (function)
+    {
+        case Count: return "count(" + argument + ")";
+        case Sum: return "sum(" + argument + ")";
+        case Min: return "min(" + argument + ")";
+        case Max: return "max(" + argument + ")";
+        case Avg: return "avg(" + argument + ")";
+    }
+
+    assert (false);
+    return "";
+}
+
+HashAggregate::HashAggregate(const std::vector<Column> &columns,
+    std::vector<std::string> group_by, std::vector<Aggregate> aggregates,
+    std::vector<std::string> output, size_t memory_budget, int depth)
+    : m_columns(columns)
+    , m_group_by(std::move(group_by))
+    , m_aggregates(std::move(aggregates))
+    , m_output(std::move(output))
+    , m_memory_budget(memory_budget)
+    , m_depth(depth)
+{
+    auto find_column = [&](const std::string &name) -> const Column&
+    {
+        for (const auto &column : m_columns)
+        {
+            if (column.name() == name)
+                return column;
+        }
+
+        assert (false);
+        return m_columns.front();
+    };
+
+    // Work out where each group column is in the raw row
+    size_t group_size_in_bytes = 0;
+    for (const auto &name : m_group_by)
+    {
+        size_t offset = Config::row_header_size;
+        for (const auto &column : m_columns)
+        {
+            if (column.name() == name)
+                break;
+            offset += column.data_type().size();
+        }
+
+        m_group_column_offsets.push_back(offset);
+        group_size_in_bytes += find_column(name).data_type().size() + 64;
+    }
+
+    for (const auto &name : m_output)
+    {
+        auto aggregate = std::find_if(m_aggregates.begin(), m_aggregates.end(),
+            [&](const auto &aggregate) { return aggregate.name() == name; });
+
+        if (aggregate == m_aggregates.end())
+        {
+            m_output_columns.push_back(find_column(name));
+            continue;
+        }
+
+        auto type = DataType::big_int();
+        switch (aggregate->function)
+        {
+            case Aggregate::Count:
+                break;
+            case Aggregate::Sum:
+                if (find_column(aggregate->column).data_type().primitive() == DataType::Float)
+                    type = DataType::float_();
+                break;
+            case Aggregate::Avg:
+                type = DataType::float_();
+                break;
+            case Aggregate::Min:
+            case Aggregate::Max:
+                type = find_column(aggregate->column).data_type();
+                break;
+        }
+        m_output_columns.push_back(Column(name, type));
+    }
+
+    // NOTE: A rough guess of the memory each group takes up, the key
+    //       and group values, plus the aggregate states
+    auto group_size = group_size_in_bytes * 2 + m_aggregates.size() * sizeof(State) + sizeof(Group);
+    m_max_group_count = std::max(m_memory_budget / group_size, (size_t)16);
+    if (m_group_by.empty() || m_depth >= max_spill_depth)
+        m_max_group_count = SIZE_MAX;
+
+    m_slots.resize(64, -1);
+}
+
+std::string HashAggregate::make_key(std::string_view row_data, const Row &row) const
+{
+    std::string key;
+    for (size_t i = 0; i < m_group_by.size(); i++)
+    {
+        const auto &entry = row[m_group_by[i]];
+        if (entry->data_type().primitive() == DataType::Text)
+        {
+            // NOTE: Text is stored out of line, so we have to use its contents
+            auto text = entry->is_null() ? std::string() : entry->as_string();
+            uint32_t length = text.size();
+            key += entry->is_null() ? '\1' : '\0';
+            key.append((const char*)&length, sizeof(length));
+            key += text;
+            continue;
+        }
+
+        auto offset = m_group_column_offsets[i];
+        key.append(row_data.substr(offset, entry->data_type().size()));
+    }
+
+    return key;
+}
+
+std::string HashAggregate::make_key(const Row &row) const
+{
+    std::string key;
+    for (const auto &column : m_group_by)
+    {
+        const auto &entry = row[column];
+        auto value = entry->is_null() ? Value() : Value::from_entry(*entry);
+        auto value_key = value.as_key();
+
+        uint32_t length = value_key.size();
+        key.append((const char*)&length, sizeof(length));
+        key += value_key;
+    }
+
+    return key;
+}
+
+uint64_t HashAggregate::hash(std::string_view key) const
+{
+    // FNV-1a, seeded by depth so spilled partitions split differently
+    uint64_t hash = 14695981039346656037ull ^ (uint64_t)m_depth;
+    for (auto c : key)
+    {
+        hash ^= (uint8_t)c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+std::optional<size_t> HashAggregate::find_slot(std::string_view key, uint64_t hash) const
+{
+    auto mask = m_slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        auto group_index = m_slots[i];
+        if (group_index < 0 || m_groups[group_index].key == key)
+            return i;
+    }
+
+    return std::nullopt;
+}
+
+void HashAggregate::grow()
+{
+    m_slots.assign(m_slots.size() * 2, -1);
+    for (size_t i = 0; i < m_groups.size(); i++)
+    {
+        const auto &key = m_groups[i].key;
+        auto slot = find_slot(key, hash(key));
+        m_slots[*slot] = i;
+    }
+}
+
+static int compare_values(const Value &a, const Value &b)
+{
+    auto compare = [](auto x, auto y) { return x < y ? -1 : (x > y ? 1 : 0); };
+    switch (a.type())
+    {
+        case Value::Integer: return compare(a.as_int(), b.as_int());
+        case Value::Float: return compare(a.as_float(), b.as_float());
+        case Value::String: return compare(a.as_string(), b.as_string());
+        default:
+            assert (false);
+            return 0;
+    }
+}
+
+void HashAggregate::update(Group &group, const Row &row)
+{
+    for (size_t i = 0; i < m_aggregates.size(); i++)
+    {
+        const auto &aggregate = m_aggregates[i];
+        auto &state = group.states[i];
+        if (aggregate.column.empty())
+        {
+            state.count += 1;
+            continue;
+        }
+
+        const auto &entry = row[aggregate.column];
+        if (entry->is_null())
+            continue;
+
+        auto value = Value::from_entry(*entry);
+        state.count += 1;
+        if (value.type() == Value::Integer)
+        {
+            state.int_sum += value.as_int();
+            state.float_sum += value.as_int();
+        }
+        else if (value.type() == Value::Float)
+        {
+            state.float_sum += value.as_float();
+        }
+
+        if (!state.min || compare_values(value, *state.min) < 0)
+            state.min = value;
+        if (!state.max || compare_values(value, *state.max) > 0)
+            state.max = value;
+    }
+}
+
+void HashAggregate::add(Row row, std::string key)
+{
+    auto key_hash = hash(key);
+    auto slot = *find_slot(key, key_hash);
+    if (m_slots[slot] >= 0)
+    {
+        update(m_groups[m_slots[slot]], row);
+        return;
+    }
+
+    // No more room, so this group will have to be done later
+    if (m_groups.size() >= m_max_group_count)
+    {
+        if (m_partitions.empty())
+        {
+            for (size_t i = 0; i < partition_count; i++)
+                m_partitions.emplace_back(m_columns);
+        }
+
+        m_partitions[(key_hash >> 32) % partition_count].write(row, key);
+        m_spilled_row_count += 1;
+        return;
+    }
+
+    Group group { std::move(key), Row(m_group_by, Row(m_columns)), std::vector<State>(m_aggregates.size()) };
+    update(group, row);
+    group.row = Row(m_group_by, std::move(row));
+
+    m_slots[slot] = m_groups.size();
+    m_groups.push_back(std::move(group));
+    if (m_groups.size() * 2 > m_slots.size())
+        grow();
+}
+
+Row HashAggregate::make_output_row(Group &group)
+{
+    Row row(m_output_columns);
+    for (size_t i = 0; i < m_output.size(); i++)
+    {
+        auto &entry = row.m_entities[i].entry;
+        auto aggregate = std::find_if(m_aggregates.begin(), m_aggregates.end(),
+            [&](const auto &aggregate) { return aggregate.name() == m_output[i]; });
+
+        if (aggregate == m_aggregates.end())
+        {
+            for (auto &entity : group.row.m_entities)
+            {
+                if (entity.column.name() == m_output[i])
+                    entry = std::move(entity.entry);
+            }
+            continue;
+        }
+
+        const auto &state = group.states[aggregate - m_aggregates.begin()];
+        if (aggregate->function == Aggregate::Count)
+        {
+            entry->set(std::make_unique<BigIntEntry>(state.count));
+            continue;
+        }
+
+        // NOTE: Everything else is null if there were no values
+        if (state.count == 0)
+            continue;
+
+        switch (aggregate->function)
+        {
+            case Aggregate::Sum:
+                if (entry->data_type().primitive() == DataType::Float)
+                    entry->set(std::make_unique<FloatEntry>(state.float_sum));
+                else
+                    entry->set(std::make_unique<BigIntEntry>(state.int_sum));
+                break;
+            case Aggregate::Avg:
+                entry->set(std::make_unique<FloatEntry>(state.float_sum / state.count));
+                break;
+            case Aggregate::Min:
+                entry->set(state.min->as_entry());
+                break;
+            case Aggregate::Max:
+                entry->set(state.max->as_entry());
+                break;
+            default:
+                assert (false);
+        }
+    }
+
+    return row;
+}
+
+void HashAggregate::finish(std::function<void(Row)> callback)
+{
+    // Without any groups, there's always exactly one result
+    if (m_groups.empty() && m_group_by.empty())
+        m_groups.push_back({ "", Row(m_group_by, Row(m_columns)), std::vector<State>(m_aggregates.size()) });
+
+    for (auto &group : m_groups)
+        callback(make_output_row(group));
+    m_groups.clear();
+    m_slots.clear();
+
+    for (auto &partition : m_partitions)
+    {
+        HashAggregate aggregate(m_columns, m_group_by, m_aggregates,
+            m_output, m_memory_budget, m_depth + 1);
+
+        m_spilled_in_bytes += partition.size_in_bytes();
+        partition.rewind();
+        std::string key;
+        while (auto row = partition.read(&key))
+            aggregate.add(std::move(*row), std::move(key));
+
+        aggregate.finish(callback);
+        m_spilled_row_count += aggregate.spilled_row_count();
+        m_spilled_in_bytes += aggregate.spilled_in_bytes();
+    }
+    m_partitions.clear();
+}
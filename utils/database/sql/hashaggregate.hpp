@@ -0,0 +1,103 @@
+#pragma once
+#include "../forward.hpp"
+#include "../column.hpp"
+#include "../row.hpp"
+#include "spillfile.hpp"
+#include "value.hpp"
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace DB::Sql
+{
+
+    // Groups rows by the raw bytes of their group columns, in an open
+    // addressing hash table. Once the table is full, rows belonging to new
+    // groups are spilled into partitions on disk by hash, which are each
+    // aggregated on their own after the in memory groups are output.
+    class HashAggregate
+    {
+    public:
+        struct Aggregate
+        {
+            enum Function
+            {
+                Count,
+                Sum,
+                Min,
+                Max,
+                Avg,
+            };
+
+            Function function;
+
+            // NOTE: Empty for 'count(*)'
+            std::string column;
+
+            static std::optional<Function> function_from_name(const std::string&);
+            std::string name() const;
+        };
+
+        // The output row is made up of the given columns, each
+        // either a group by column or the name of an aggregate
+        HashAggregate(const std::vector<Column> &columns,
+            std::vector<std::string> group_by, std::vector<Aggregate> aggregates,
+            std::vector<std::string> output, size_t memory_budget, int depth = 0);
+
+        // Key of the row stored at the start of a raw row buffer
+        std::string make_key(std::string_view row_data, const Row &row) const;
+
+        // Key of a row that isn't stored in a table, such as a joined row
+        std::string make_key(const Row &row) const;
+
+        void add(Row row, std::string key);
+        void finish(std::function<void(Row)> callback);
+
+        inline const std::vector<Column> &output_columns() const { return m_output_columns; }
+        inline size_t spilled_row_count() const { return m_spilled_row_count; }
+        inline size_t spilled_in_bytes() const { return m_spilled_in_bytes; }
+
+    private:
+        struct State
+        {
+            size_t count { 0 };
+            int64_t int_sum { 0 };
+            double float_sum { 0 };
+            std::optional<Value> min;
+            std::optional<Value> max;
+        };
+
+        struct Group
+        {
+            std::string key;
+            Row row;
+            std::vector<State> states;
+        };
+
+        uint64_t hash(std::string_view key) const;
+        std::optional<size_t> find_slot(std::string_view key, uint64_t hash) const;
+        void grow();
+        void update(Group&, const Row&);
+        Row make_output_row(Group&);
+
+        std::vector<Column> m_columns;
+        std::vector<std::string> m_group_by;
+        std::vector<Aggregate> m_aggregates;
+        std::vector<std::string> m_output;
+        std::vector<Column> m_output_columns;
+        size_t m_memory_budget;
+        size_t m_max_group_count;
+        int m_depth;
+
+        std::vector<size_t> m_group_column_offsets;
+        std::vector<int64_t> m_slots;
+        std::vector<Group> m_groups;
+        std::vector<SpillFile> m_partitions;
+        size_t m_spilled_row_count { 0 };
+        size_t m_spilled_in_bytes { 0 };
+
+    };
+
+}
@@ -0,0 +1,197 @@
+#include "hashjoin.hpp"
+#include "value.hpp"
+#include "../table.hpp"
+#include "../entry.hpp"
+#include <unordered_map>
+using namespace DB;
+using namespace DB::Sql;
+
+HashJoin::HashJoin(Table &left, Table &right, ValueNode &condition)
+    : m_left(left)
+    , m_right(right)
+    , m_condition(condition)
+{
+    for (const auto *table : { &m_left, &m_right })
+    {
+        for (const auto &column : table->columns())
+            m_columns.push_back(Column(table->name() + "." + column.name(), column.data_type()));
+    }
+
+    // Use the first 'left = right' in the condition as the key
+    for (const auto &[a, b] : m_condition.column_equalities())
+    {
+        auto left_a = find_column(m_left, a);
+        auto right_b = find_column(m_right, b);
+        if (left_a && right_b)
+        {
+            m_left_key = left_a;
+            m_right_key = right_b;
+            break;
+        }
+
+        auto left_b = find_column(m_left, b);
+        auto right_a = find_column(m_right, a);
+        if (left_b && right_a)
+        {
+            m_left_key = left_b;
+            m_right_key = right_a;
+            break;
+        }
+    }
+}
+
+std::string HashJoin::describe() const
+{
+    // NOTE: The smaller table is always the one held in memory
+    auto &inner = m_left.row_count() <= m_right.row_count() ? m_left : m_right;
+    if (!is_hash_join())
+        return "nested loop, " + inner.name() + " in memory";
+
+    return m_left.name() + "." + *m_left_key + " = " + m_right.name() + "." + *m_right_key
+        + ", build on " + inner.name();
+}
+
+std::optional<std::string> HashJoin::find_column(const Table &table, const std::string &name) const
+{
+    auto column_name = name;
+    auto prefix = table.name() + ".";
+    if (name.compare(0, prefix.size(), prefix) == 0)
+        column_name = name.substr(prefix.size());
+    else if (name.find('.') != std::string::npos)
+        return std::nullopt;
+
+    for (const auto &column : table.columns())
+    {
+        if (column.name() == column_name)
+            return column_name;
+    }
+
+    return std::nullopt;
+}
+
+static std::unique_ptr<Entry> copy_entry(const Column &column, const Entry &entry)
+{
+    auto copy = column.null();
+    if (!entry.is_null())
+        copy->set(Value::from_entry(entry).as_entry());
+    return copy;
+}
+
+Row HashJoin::join(const Row &left, const Row &right) const
+{
+    Row row(m_columns);
+    size_t index = 0;
+    for (const auto *side : { &left, &right })
+    {
+        for (const auto &entity : side->m_entities)
+        {
+            auto &joined_entity = row.m_entities[index++];
+            joined_entity.entry = copy_entry(joined_entity.column, *entity.entry);
+        }
+    }
+
+    return row;
+}
+
+std::vector<Row> HashJoin::read_all(Table &table)
+{
+    std::vector<Row> rows;
+    rows.reserve(table.row_count());
+    auto row_chunks = table.row_chunks();
+    for (size_t chunk_index = 0; chunk_index < row_chunks.size(); chunk_index++)
+    {
+        const auto &row_chunk = row_chunks[chunk_index];
+        table.read_ahead(row_chunks, chunk_index);
+        for (size_t i = 0; i < row_chunk.row_count; i++)
+            rows.push_back(table.read_row(*row_chunk.chunk, i));
+    }
+
+    m_rows_read += rows.size();
+    return rows;
+}
+
+void HashJoin::run(std::function<bool(Row)> callback)
+{
+    if (is_hash_join())
+        run_hash_join(callback);
+    else
+        run_nested_loop(callback);
+}
+
+void HashJoin::run_hash_join(std::function<bool(Row)> &callback)
+{
+    // Build on the smaller table
+    auto build_is_left = m_left.row_count() <= m_right.row_count();
+    auto &build = build_is_left ? m_left : m_right;
+    auto &probe = build_is_left ? m_right : m_left;
+    const auto &build_key = build_is_left ? *m_left_key : *m_right_key;
+    const auto &probe_key = build_is_left ? *m_right_key : *m_left_key;
+
+    std::unordered_multimap<std::string, Row> hash_table;
+    hash_table.reserve(build.row_count());
+    for (auto &row : read_all(build))
+    {
+        // NOTE: Null never equals anything, so can't be joined
+        const auto &entry = row[build_key];
+        if (entry->is_null())
+            continue;
+
+        auto key = Value::from_entry(*entry).as_key();
+        hash_table.emplace(std::move(key), std::move(row));
+    }
+
+    auto row_chunks = probe.row_chunks();
+    for (size_t chunk_index = 0; chunk_index < row_chunks.size(); chunk_index++)
+    {
+        const auto &row_chunk = row_chunks[chunk_index];
+        probe.read_ahead(row_chunks, chunk_index);
+        for (size_t i = 0; i < row_chunk.row_count; i++)
+        {
+            auto row = probe.read_row(*row_chunk.chunk, i);
+            m_rows_read += 1;
+            const auto &entry = row[probe_key];
+            if (entry->is_null())
+                continue;
+
+            auto [begin, end] = hash_table.equal_range(Value::from_entry(*entry).as_key());
+            for (auto it = begin; it != end; ++it)
+            {
+                auto joined = build_is_left ? join(it->second, row) : join(row, it->second);
+
+                // The rest of the condition still has to hold
+                if (!m_condition.evaluate(joined).is_true())
+                    continue;
+                if (!callback(std::move(joined)))
+                    return;
+            }
+        }
+    }
+}
+
+void HashJoin::run_nested_loop(std::function<bool(Row)> &callback)
+{
+    // Keep the smaller table in memory, and scan the other once
+    auto inner_is_left = m_left.row_count() <= m_right.row_count();
+    auto &outer = inner_is_left ? m_right : m_left;
+    auto inner_rows = read_all(inner_is_left ? m_left : m_right);
+
+    auto row_chunks = outer.row_chunks();
+    for (size_t chunk_index = 0; chunk_index < row_chunks.size(); chunk_index++)
+    {
+        const auto &row_chunk = row_chunks[chunk_index];
+        outer.read_ahead(row_chunks, chunk_index);
+        for (size_t i = 0; i < row_chunk.row_count; i++)
+        {
+            auto outer_row = outer.read_row(*row_chunk.chunk, i);
+            m_rows_read += 1;
+            for (const auto &inner_row : inner_rows)
+            {
+                auto joined = inner_is_left ? join(inner_row, outer_row) : join(outer_row, inner_row);
+                if (!m_condition.evaluate(joined).is_true())
+                    continue;
+                if (!callback(std::move(joined)))
+                    return;
+            }
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "../forward.hpp"
+#include "../column.hpp"
+#include "../row.hpp"
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace DB::Sql
+{
+
+    // Joins the rows of two tables on a condition. If the condition
+    // requires a column from each table to be equal, the smaller table
+    // is built into a hash table on that column and the other is probed
+    // against it, otherwise every pair of rows is tried.
+    // Joined rows have the columns of both tables, named 'table.column'.
+    class HashJoin
+    {
+    public:
+        HashJoin(Table &left, Table &right, ValueNode &condition);
+
+        inline const std::vector<Column> &columns() const { return m_columns; }
+        inline bool is_hash_join() const { return m_left_key.has_value(); }
+        inline size_t rows_read() const { return m_rows_read; }
+        std::string describe() const;
+
+        // Stops early if the callback returns false
+        void run(std::function<bool(Row)> callback);
+
+    private:
+        std::optional<std::string> find_column(const Table&, const std::string &name) const;
+        Row join(const Row &left, const Row &right) const;
+        std::vector<Row> read_all(Table&);
+
+        void run_hash_join(std::function<bool(Row)> &callback);
+        void run_nested_loop(std::function<bool(Row)> &callback);
+
+        Table &m_left;
+        Table &m_right;
+        ValueNode &m_condition;
+        std::vector<Column> m_columns;
+
+        // Columns of each table to join on
+        std::optional<std::string> m_left_key;
+        std::optional<std::string> m_right_key;
+
+        size_t m_rows_read { 0 };
+
+    };
+
+}
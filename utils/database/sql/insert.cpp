@@ -1,27 +1,46 @@
 #include "insert.hpp"
 #include "../database.hpp"
 #include "value.hpp"
+#include <algorithm>
 using namespace DB;
 using namespace DB::Sql;
 
 SqlResult InsertStatement::execute(DataBase& db) const
 {
     if (m_columns.size() != m_values.size())
-    {
-        assert (false);
         return SqlResult::error("Column and value counts do not match");
-    }
 
     auto table = db.get_table(m_table);
     if (!table)
         return SqlResult::error("No table with the name '" + m_table + "' found");
 
+    const auto &columns = table->columns();
     auto row = table->make_row();
     for (int i = 0; i < (int)m_columns.size(); i++)
     {
         const auto &column = m_columns[i];
-        const auto &value = m_values[i];
-        row[column]->set(value->evaluate(row).as_entry());
+        auto it = std::find_if(columns.begin(), columns.end(),
+            [&](const auto &other) { return other.name() == column; });
+        if (it == columns.end())
+            return SqlResult::error("No column with the name '" + column + "' found");
+        if (auto unknown = m_values[i]->unknown_column(columns))
+            return SqlResult::error("No column with the name '" + *unknown + "' found");
+
+        // NOTE: Columns are null unless they're given a value
+        auto value = m_values[i]->evaluate(row);
+        if (value.type() == Value::Null)
+            continue;
+        if (!value.fits(it->data_type()))
+            return SqlResult::error("Value given for '" + column + "' doesn't fit its type");
+        row[column]->set(value.as_entry());
+    }
+
+    // NOTE: Partitions are sealed once a later one starts, so rows can't go back in time
+    const auto &partitioning = table->partitioning();
+    if (partitioning && !table->can_append(row))
+    {
+        return SqlResult::error("Rows added to '" + m_table + "' need a '"
+            + partitioning->column + "' in its latest partition or after");
     }
 
     table->add_row(std::move(row));
@@ -1,176 +1,213 @@
 #include "lexer.hpp"
-#include <algorithm>
 #include <cassert>
-#include <iostream>
+#include <cctype>
 using namespace DB::Sql;
 
-std::optional<Lexer::Token> Lexer::next()
+struct Keyword
+{
+    std::string_view name;
+    Lexer::Type type;
+};
+
+static constexpr Keyword keywords[] =
+{
+    { "select", Lexer::Select },
+    { "from", Lexer::From },
+    { "insert", Lexer::Insert },
+    { "into", Lexer::Into },
+    { "values", Lexer::Values },
+    { "create", Lexer::Create },
+    { "table", Lexer::Table },
+    { "where", Lexer::Where },
+    { "update", Lexer::Update },
+    { "set", Lexer::Set },
+    { "delete", Lexer::Delete },
+    { "if", Lexer::If },
+    { "not", Lexer::Not },
+    { "exists", Lexer::Exists },
+    { "and", Lexer::And },
+    { "order", Lexer::Order },
+    { "by", Lexer::By },
+    { "asc", Lexer::Asc },
+    { "desc", Lexer::Desc },
+    { "limit", Lexer::Limit },
+    { "group", Lexer::Group },
+    { "join", Lexer::Join },
+    { "on", Lexer::On },
+    { "explain", Lexer::Explain },
+    { "analyze", Lexer::Analyze },
+    { "or", Lexer::Or },
+    { "like", Lexer::Like },
+    { "in", Lexer::In },
+    { "between", Lexer::Between },
+    { "is", Lexer::Is },
+    { "null", Lexer::Null },
+    { "index", Lexer::Index },
+    { "partition", Lexer::Partition },
+    { "every", Lexer::Every },
+};
+
+static constexpr size_t keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+static constexpr size_t keyword_table_size = 128;
+
+// NOTE: Names are letters, digits and '.', which '| 0x20' leaves
+//       alone apart from making letters lower case
+static constexpr char to_lower(char c)
+{
+    return c | 0x20;
+}
+
+// A perfect hash of the keywords, so a name is only ever compared
+// against the one keyword it could be. If adding a keyword makes the
+// static_assert below fail, pick new multipliers.
+static constexpr size_t keyword_hash(std::string_view name)
 {
-    if (m_peek_stack.size() > 0)
+    return (to_lower(name.front()) * 7
+        + to_lower(name.back()) * 6
+        + name.size()) % keyword_table_size;
+}
+
+struct KeywordTable
+{
+    std::array<int, keyword_table_size> slots {};
+    bool has_collisions { false };
+};
+
+static constexpr KeywordTable build_keyword_table()
+{
+    KeywordTable table;
+    for (auto &slot : table.slots)
+        slot = -1;
+
+    for (size_t i = 0; i < keyword_count; i++)
     {
-        auto token = m_peek_stack.front();
-        m_peek_stack.erase(m_peek_stack.begin());
-        return token;
+        auto &slot = table.slots[keyword_hash(keywords[i].name)];
+        if (slot != -1)
+            table.has_collisions = true;
+        slot = i;
     }
 
-    std::string buffer;
-    for (;;)
-    {
-        if (m_pointer > m_query.size())
-            break;
+    return table;
+}
 
-        if (!m_should_reconsume)
-        {
-            m_curr_char = m_query[m_pointer];
-            m_pointer += 1;
-        }
-        m_should_reconsume = false;
+static constexpr auto keyword_table = build_keyword_table();
+static_assert (!keyword_table.has_collisions, "Keyword hash has collisions");
 
-        auto c = m_curr_char;
-        switch (m_state)
-        {
-            case State::Normal:
-                if (isspace(c))
-                    break;
-
-                if (isalpha(c))
-                {
-                    m_should_reconsume = true;
-                    m_state = State::Name;
-                    break;
-                }
-
-                if (isdigit(c))
-                {
-                    m_should_reconsume = true;
-                    m_state = State::Integer;
-                    break;
-                }
-
-                if (c == '\'')
-                {
-                    m_state = State::String;
-                    break;
-                }
-
-                switch (c)
-                {
-                    case '*':
-                        return Token { "*", Type::Star };
-                    case ',':
-                        return Token { ",", Type::Comma };
-                    case '(':
-                        return Token { "(", Type::OpenBrace };
-                    case ')':
-                        return Token { ")", Type::CloseBrace };
-                    case '>':
-                        return Token { ">", Type::MoreThan };
-                    case '=':
-                        return Token { "=", Type::Equals };
-                    default:
-                        break;
-                }
-
-                if (!c)
-                    return std::nullopt;
-
-                assert (false);
-                break;
-
-            case State::Name:
-                if (!isalnum(c))
-                {
-                    m_should_reconsume = true;
-                    m_state = State::Normal;
-                    return parse_name(buffer);
-                }
-
-                buffer += c;
-                break;
-
-            case State::Integer:
-                if (c == '.')
-                {
-                    buffer += c;
-                    m_state = State::Float;
-                    break;
-                }
-
-                if (!isdigit(c))
-                {
-                    m_should_reconsume = true;
-                    m_state = State::Normal;
-                    return Token { buffer, Type::Integer };
-                }
-
-                buffer += c;
-                break;
-
-            case State::Float:
-                if (!isdigit(c))
-                {
-                    m_should_reconsume = true;
-                    m_state = State::Normal;
-                    return Token { buffer, Type::Float };
-                }
-
-                buffer += c;
-                break;
-
-            case State::String:
-                if (c == '\'')
-                {
-                    m_state = State::Normal;
-                    return Token { buffer, Type::String };
-                }
-
-                buffer += c;
-                break;
-        }
+Lexer::Type Lexer::keyword_type(std::string_view name)
+{
+    auto slot = keyword_table.slots[keyword_hash(name)];
+    if (slot == -1)
+        return Type::Name;
+
+    const auto &keyword = keywords[slot];
+    if (keyword.name.size() != name.size())
+        return Type::Name;
+
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (to_lower(name[i]) != keyword.name[i])
+            return Type::Name;
     }
 
-    return std::nullopt;
+    return keyword.type;
 }
 
-Lexer::Token Lexer::parse_name(const std::string &buffer)
+std::optional<Lexer::Token> Lexer::next()
 {
-    auto lower = buffer;
-    std::for_each(lower.begin(), lower.end(), [](char &c)
+    auto is_at_end = [&]()
+    {
+        return m_pointer >= m_query.size();
+    };
+
+    auto take_while = [&](auto predicate)
+    {
+        while (!is_at_end() && predicate(m_query[m_pointer]))
+            m_pointer += 1;
+    };
+
+    take_while([](char c) { return isspace(c); });
+    if (is_at_end())
+        return std::nullopt;
+
+    auto start = m_pointer;
+    auto token = [&](Type type)
+    {
+        return Token { m_query.substr(start, m_pointer - start), type };
+    };
+
+    auto c = m_query[m_pointer];
+    if (isalpha(c))
+    {
+        // NOTE: Names can be qualified by a table, 'table.column'
+        take_while([](char c) { return isalnum(c) || c == '.'; });
+        auto name = token(Type::Name);
+        name.type = keyword_type(name.data);
+        return name;
+    }
+
+    if (isdigit(c))
+    {
+        take_while([](char c) { return isdigit(c); });
+        if (is_at_end() || m_query[m_pointer] != '.')
+            return token(Type::Integer);
+
+        m_pointer += 1;
+        take_while([](char c) { return isdigit(c); });
+        return token(Type::Float);
+    }
+
+    // Consume the next character if it's the one given
+    auto next_is = [&](char next)
     {
-        c = ::tolower(c);
-    });
-
-    if (lower == "select")
-        return { buffer, Type::Select };
-    else if (lower == "from")
-        return { buffer, Type::From };
-    else if (lower == "insert")
-        return { buffer, Type::Insert };
-    else if (lower == "into")
-        return { buffer, Type::Into };
-    else if (lower == "values")
-        return { buffer, Type::Values };
-    else if (lower == "create")
-        return { buffer, Type::Create };
-    else if (lower == "table")
-        return { buffer, Type::Table };
-    else if (lower == "where")
-        return { buffer, Type::Where };
-    else if (lower == "update")
-        return { buffer, Type::Update };
-    else if (lower == "set")
-        return { buffer, Type::Set };
-    else if (lower == "delete")
-        return { buffer, Type::Delete };
-    else if (lower == "if")
-        return { buffer, Type::If };
-    else if (lower == "not")
-        return { buffer, Type::Not };
-    else if (lower == "exists")
-        return { buffer, Type::Exists };
-    else if (lower == "and")
-        return { buffer, Type::And };
-    return { buffer, Type::Name };
+        if (is_at_end() || m_query[m_pointer] != next)
+            return false;
+
+        m_pointer += 1;
+        return true;
+    };
+
+    m_pointer += 1;
+    switch (c)
+    {
+        case '\'':
+        {
+            auto end = m_query.find('\'', m_pointer);
+            if (end == std::string_view::npos)
+            {
+                // NOTE: An unterminated string can't be parsed as anything
+                m_pointer = m_query.size();
+                return token(Type::Unknown);
+            }
+
+            m_pointer = end + 1;
+            return Token { m_query.substr(start + 1, end - start - 1), Type::String };
+        }
+        case '*': return token(Type::Star);
+        case ',': return token(Type::Comma);
+        case '(': return token(Type::OpenBrace);
+        case ')': return token(Type::CloseBrace);
+        case '+': return token(Type::Plus);
+        case '-': return token(Type::Minus);
+        case '/': return token(Type::Slash);
+        case '=': return token(Type::Equals);
+        case '>':
+            if (next_is('='))
+                return token(Type::MoreThanOrEqual);
+            return token(Type::MoreThan);
+        case '<':
+            if (next_is('='))
+                return token(Type::LessThanOrEqual);
+            if (next_is('>'))
+                return token(Type::NotEquals);
+            return token(Type::LessThan);
+        case '!':
+            if (next_is('='))
+                return token(Type::NotEquals);
+            return token(Type::Unknown);
+        case '?': return token(Type::Parameter);
+        default:
+            return token(Type::Unknown);
+    }
 }
 
 std::optional<Lexer::Token> Lexer::consume(Type type)
@@ -182,26 +219,23 @@ std::optional<Lexer::Token> Lexer::consume(Type type)
     if (type != Type::None && token->type != type)
         return std::nullopt;
 
-    return next();
+    m_lookahead_start = (m_lookahead_start + 1) % max_lookahead;
+    m_lookahead_count -= 1;
+    return token;
 }
 
 std::optional<Lexer::Token> Lexer::peek(size_t count)
 {
-    std::optional<Token> token;
-    for (size_t i = 0; i <= count; i++)
+    assert (count < max_lookahead);
+    while (m_lookahead_count <= count)
     {
-        if (i < m_peek_stack.size())
-        {
-            token = m_peek_stack[i];
-            continue;
-        }
-
-        token = next();
+        auto token = next();
         if (!token)
             return std::nullopt;
 
-        m_peek_stack.push_back(*token);
+        m_lookahead[(m_lookahead_start + m_lookahead_count) % max_lookahead] = *token;
+        m_lookahead_count += 1;
     }
 
-    return token;
+    return m_lookahead[(m_lookahead_start + count) % max_lookahead];
 }
@@ -1,7 +1,7 @@
 #pragma once
 #include "../forward.hpp"
-#include <string>
-#include <vector>
+#include <array>
+#include <string_view>
 #include <optional>
 
 namespace DB::Sql
@@ -31,52 +31,76 @@ public:
         If,
         Not,
         Exists,
+        Order,
+        By,
+        Asc,
+        Desc,
+        Limit,
+        Group,
+        Join,
+        On,
+        Explain,
+        Analyze,
+        Or,
+        Like,
+        In,
+        Between,
+        Is,
+        Null,
+        Index,
+        Partition,
+        Every,
 
         Integer,
         Float,
         String,
+        Parameter,
 
         MoreThan,
+        MoreThanOrEqual,
+        LessThan,
+        LessThanOrEqual,
         Equals,
+        NotEquals,
         And,
 
+        Plus,
+        Minus,
+        Slash,
+
         Star,
         Comma,
+
+        // A character that doesn't start any token
+        Unknown,
     };
 
+    // NOTE: Tokens point into the query, so it has to outlive them
     struct Token
     {
-        std::string data;
+        std::string_view data;
         Type type;
     };
 
-    Lexer(const std::string &query)
-        : m_query(query)
-        , m_should_reconsume(false) {}
+    Lexer(std::string_view query)
+        : m_query(query) {}
 
     std::optional<Token> consume(Type type = None);
     std::optional<Token> peek(size_t count = 0);
 
 private:
-    enum class State
-    {
-        Normal,
-        Name,
-        Integer,
-        Float,
-        String,
-    };
+    static size_t constexpr max_lookahead = 4;
 
     std::optional<Token> next();
-    Token parse_name(const std::string &buffer);
+    static Type keyword_type(std::string_view name);
 
-    std::string m_query;
-    State m_state { State::Normal };
-    char m_curr_char { 0 };
-
-    bool m_should_reconsume { false };
+    std::string_view m_query;
     size_t m_pointer { 0 };
-    std::vector<Token> m_peek_stack;
+
+    // Tokens peeked at but not consumed yet
+    std::array<Token, max_lookahead> m_lookahead;
+    size_t m_lookahead_start { 0 };
+    size_t m_lookahead_count { 0 };
 
 };
 
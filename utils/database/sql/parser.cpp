@@ -3,10 +3,15 @@
 #include "insert.hpp"
 #include "createtable.hpp"
 #include "createtableifnotexists.hpp"
+#include "createindex.hpp"
 #include "update.hpp"
 #include "delete.hpp"
+#include "explain.hpp"
+#include "analyze.hpp"
 #include "../entry.hpp"
+#include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <iostream>
 #include <memory>
 using namespace DB;
@@ -27,9 +32,15 @@ SqlResult Parser::errors_as_result()
 void Parser::expected(const std::string &name)
 {
     auto token = m_lexer.consume();
+    if (!token)
+    {
+        m_errors.push_back("Expected token '" + name + "', got the end of the query instead");
+        return;
+    }
+
     m_errors.push_back("Expected token '" +
         name + "', got '" +
-        token->data + "' instead");
+        std::string(token->data) + "' instead");
 }
 
 void Parser::match(Lexer::Type type, const std::string &name)
@@ -66,30 +77,52 @@ std::unique_ptr<ValueNode> Parser::parse_value()
         case Lexer::Integer:
         {
             m_lexer.consume();
-            auto i = atol(peek->data.c_str());
+            int64_t i = 0;
+            std::from_chars(peek->data.data(), peek->data.data() + peek->data.size(), i);
             value = std::make_unique<ValueNode>(Value(i));
             break;
         }
         case Lexer::Float:
         {
             m_lexer.consume();
-            float f = atof(peek->data.c_str());
+            float f = 0;
+            std::from_chars(peek->data.data(), peek->data.data() + peek->data.size(), f);
             value = std::make_unique<ValueNode>(Value(f));
             break;
         }
         case Lexer::String:
         {
             m_lexer.consume();
-            value = std::make_unique<ValueNode>(Value(peek->data));
+            value = std::make_unique<ValueNode>(Value(std::string(peek->data)));
+            break;
+        }
+        case Lexer::Null:
+        {
+            m_lexer.consume();
+            value = std::make_unique<ValueNode>(Value());
+            break;
+        }
+        case Lexer::Parameter:
+        {
+            m_lexer.consume();
+            value = ValueNode::parameter();
+            m_parameters.push_back(value.get());
             break;
         }
         case Lexer::Name:
         {
             m_lexer.consume();
-            auto operand = std::make_unique<ValueNode>(Value(peek->data));
+            auto operand = std::make_unique<ValueNode>(Value(std::string(peek->data)));
             value = std::make_unique<ValueNode>(ValueNode::Type::Column, std::move(operand));
             break;
         }
+        case Lexer::OpenBrace:
+        {
+            m_lexer.consume();
+            value = parse_or();
+            match(Lexer::CloseBrace, ")");
+            break;
+        }
         default:
             break;
     }
@@ -100,57 +133,222 @@ std::unique_ptr<ValueNode> Parser::parse_value()
     return value;
 }
 
+std::unique_ptr<ValueNode> Parser::parse_factor()
+{
+    if (!m_lexer.consume(Lexer::Minus))
+        return parse_value();
+
+    auto operand = parse_factor();
+    if (!operand)
+    {
+        expected("value");
+        return nullptr;
+    }
+
+    // NOTE: Negative literals are folded along with any other constants
+    return std::make_unique<ValueNode>(
+        std::make_unique<ValueNode>(Value((int64_t)0)), ValueNode::Type::Subtract, std::move(operand));
+}
+
+std::unique_ptr<ValueNode> Parser::parse_binary(std::function<std::unique_ptr<ValueNode>()> parse_operand,
+    std::initializer_list<std::pair<Lexer::Type, ValueNode::Type>> operators)
+{
+    auto left = parse_operand();
+    while (left)
+    {
+        auto peek = m_lexer.peek();
+        if (!peek)
+            break;
+
+        auto it = std::find_if(operators.begin(), operators.end(),
+            [&](const auto &op) { return op.first == peek->type; });
+        if (it == operators.end())
+            break;
+
+        m_lexer.consume();
+        auto right = parse_operand();
+        if (!right)
+        {
+            expected("value");
+            return nullptr;
+        }
+
+        left = std::make_unique<ValueNode>(std::move(left), it->second, std::move(right));
+    }
+
+    return left;
+}
+
+std::unique_ptr<ValueNode> Parser::parse_term()
+{
+    return parse_binary([&]() { return parse_factor(); },
+    {
+        { Lexer::Star, ValueNode::Type::Multiply },
+        { Lexer::Slash, ValueNode::Type::Divide },
+    });
+}
+
+std::unique_ptr<ValueNode> Parser::parse_arithmetic()
+{
+    return parse_binary([&]() { return parse_term(); },
+    {
+        { Lexer::Plus, ValueNode::Type::Add },
+        { Lexer::Minus, ValueNode::Type::Subtract },
+    });
+}
+
 std::unique_ptr<ValueNode> Parser::parse_comparison()
 {
-    auto left = parse_value();
+    auto left = parse_arithmetic();
     auto peek = m_lexer.peek();
-    if (!peek)
+    if (!left || !peek)
         return left;
 
-    ValueNode::Type operation;
-    std::unique_ptr<ValueNode> right;
+    auto operand = [&]()
+    {
+        auto value = parse_arithmetic();
+        if (!value)
+            expected("value");
+        return value;
+    };
+
+    // 'IS [NOT] NULL'
+    if (m_lexer.consume(Lexer::Is))
+    {
+        auto is_not = m_lexer.consume(Lexer::Not).has_value();
+        match(Lexer::Null, "null");
+
+        auto node = std::make_unique<ValueNode>(ValueNode::Type::IsNull, std::move(left));
+        if (is_not)
+            node = std::make_unique<ValueNode>(ValueNode::Type::Not, std::move(node));
+        return node;
+    }
+
+    // NOTE: 'NOT' before 'LIKE', 'IN' or 'BETWEEN' negates the whole comparison
+    auto next = m_lexer.peek(1);
+    auto is_not = peek->type == Lexer::Not && next &&
+        (next->type == Lexer::Like || next->type == Lexer::In || next->type == Lexer::Between);
+    if (is_not)
+    {
+        m_lexer.consume();
+        peek = next;
+    }
+
+    std::unique_ptr<ValueNode> node;
     switch (peek->type)
     {
-        case Lexer::MoreThan:
+        case Lexer::Like:
+        {
             m_lexer.consume();
-            right = parse_value();
-            operation = ValueNode::Type::MoreThan;
+            auto pattern = operand();
+            if (!pattern)
+                return nullptr;
+            node = std::make_unique<ValueNode>(std::move(left), ValueNode::Type::Like, std::move(pattern));
             break;
-        case Lexer::Equals:
+        }
+
+        case Lexer::In:
+        {
             m_lexer.consume();
-            right = parse_value();
-            operation = ValueNode::Type::Equals;
+            std::vector<std::unique_ptr<ValueNode>> list;
+            parse_list([&]()
+            {
+                if (auto value = operand())
+                    list.push_back(std::move(value));
+            });
+            if (list.empty())
+            {
+                expected("value");
+                return nullptr;
+            }
+            node = std::make_unique<ValueNode>(std::move(left), ValueNode::Type::In, std::move(list));
             break;
+        }
+
+        case Lexer::Between:
+        {
+            m_lexer.consume();
+            auto low = operand();
+            match(Lexer::And, "and");
+            auto high = operand();
+            if (!low || !high)
+                return nullptr;
+
+            std::vector<std::unique_ptr<ValueNode>> bounds;
+            bounds.push_back(std::move(low));
+            bounds.push_back(std::move(high));
+            node = std::make_unique<ValueNode>(std::move(left), ValueNode::Type::Between, std::move(bounds));
+            break;
+        }
+
         default:
-            return left;
+        {
+            ValueNode::Type operation;
+            switch (peek->type)
+            {
+                case Lexer::MoreThan: operation = ValueNode::Type::MoreThan; break;
+                case Lexer::MoreThanOrEqual: operation = ValueNode::Type::MoreThanOrEqual; break;
+                case Lexer::LessThan: operation = ValueNode::Type::LessThan; break;
+                case Lexer::LessThanOrEqual: operation = ValueNode::Type::LessThanOrEqual; break;
+                case Lexer::Equals: operation = ValueNode::Type::Equals; break;
+                case Lexer::NotEquals: operation = ValueNode::Type::NotEquals; break;
+                default:
+                    return left;
+            }
+
+            m_lexer.consume();
+            auto right = operand();
+            if (!right)
+                return nullptr;
+            node = std::make_unique<ValueNode>(std::move(left), operation, std::move(right));
+            break;
+        }
     }
 
-    return std::make_unique<ValueNode>(
-        std::move(left), operation, std::move(right));
+    if (is_not)
+        node = std::make_unique<ValueNode>(ValueNode::Type::Not, std::move(node));
+    return node;
 }
 
-std::unique_ptr<ValueNode> Parser::parse_condition()
+std::unique_ptr<ValueNode> Parser::parse_not()
 {
-    auto left = parse_comparison();
-    auto peek = m_lexer.peek();
-    if (!peek)
-        return left;
+    if (!m_lexer.consume(Lexer::Not))
+        return parse_comparison();
 
-    ValueNode::Type operation;
-    std::unique_ptr<ValueNode> right;
-    switch (peek->type)
+    auto operand = parse_not();
+    if (!operand)
     {
-        case Lexer::And:
-            m_lexer.consume();
-            right = parse_comparison();
-            operation = ValueNode::Type::And;
-            break;
-        default:
-            return left;
+        expected("condition");
+        return nullptr;
     }
 
-    return std::make_unique<ValueNode>(
-        std::move(left), operation, std::move(right));
+    return std::make_unique<ValueNode>(ValueNode::Type::Not, std::move(operand));
+}
+
+std::unique_ptr<ValueNode> Parser::parse_or()
+{
+    auto parse_and = [&]()
+    {
+        return parse_binary([&]() { return parse_not(); },
+            { { Lexer::And, ValueNode::Type::And } });
+    };
+
+    return parse_binary(parse_and,
+        { { Lexer::Or, ValueNode::Type::Or } });
+}
+
+std::unique_ptr<ValueNode> Parser::parse_expression()
+{
+    auto expression = parse_arithmetic();
+    ValueNode::fold_constants(expression);
+    return expression;
+}
+
+std::unique_ptr<ValueNode> Parser::parse_condition()
+{
+    auto condition = parse_or();
+    ValueNode::fold_constants(condition);
+    return condition;
 }
 
 std::shared_ptr<Statement> Parser::parse_select()
@@ -167,11 +365,24 @@ std::shared_ptr<Statement> Parser::parse_select()
         for (;;)
         {
             auto token = m_lexer.consume(Lexer::Name);
-            if (token)
-                select->m_columns.push_back(token->data);
-            else
+            if (!token)
+            {
                 expected("column name");
-            
+                return nullptr;
+            }
+
+            auto name = std::string(token->data);
+            if (m_lexer.peek() && m_lexer.peek()->type == Lexer::OpenBrace)
+            {
+                auto aggregate = parse_aggregate(name);
+                if (!aggregate)
+                    return nullptr;
+
+                name = aggregate->name();
+                select->m_aggregates.push_back(std::move(*aggregate));
+            }
+
+            select->m_columns.push_back(name);
             if (!m_lexer.consume(Lexer::Comma))
                 break;
         }
@@ -185,6 +396,26 @@ std::shared_ptr<Statement> Parser::parse_select()
         return nullptr;
     }
 
+    if (m_lexer.consume(Lexer::Join))
+    {
+        auto join_table = m_lexer.consume(Lexer::Name);
+        if (!join_table)
+        {
+            expected("table name");
+            return nullptr;
+        }
+
+        match(Lexer::On, "on");
+        auto condition = parse_condition();
+        if (!condition)
+        {
+            expected("condition");
+            return nullptr;
+        }
+
+        select->m_join = SelectStatement::Join { std::string(join_table->data), std::move(condition) };
+    }
+
     if (m_lexer.consume(Lexer::Where))
     {
         auto condition = parse_condition();
@@ -197,10 +428,108 @@ std::shared_ptr<Statement> Parser::parse_select()
         select->m_where = std::move(condition);
     }
 
+    if (m_lexer.consume(Lexer::Group))
+    {
+        match(Lexer::By, "by");
+        for (;;)
+        {
+            auto column = m_lexer.consume(Lexer::Name);
+            if (!column)
+            {
+                expected("column name");
+                return nullptr;
+            }
+
+            select->m_group_by.push_back(std::string(column->data));
+            if (!m_lexer.consume(Lexer::Comma))
+                break;
+        }
+    }
+
+    if (m_lexer.consume(Lexer::Order))
+    {
+        match(Lexer::By, "by");
+        for (;;)
+        {
+            auto column = m_lexer.consume(Lexer::Name);
+            if (!column)
+            {
+                expected("column name");
+                return nullptr;
+            }
+
+            // NOTE: Aggregates are ordered by their output column
+            auto column_name = std::string(column->data);
+            if (m_lexer.peek() && m_lexer.peek()->type == Lexer::OpenBrace)
+            {
+                auto aggregate = parse_aggregate(column_name);
+                if (!aggregate)
+                    return nullptr;
+                column_name = aggregate->name();
+            }
+
+            bool descending = false;
+            if (m_lexer.consume(Lexer::Desc))
+                descending = true;
+            else
+                m_lexer.consume(Lexer::Asc);
+
+            select->m_order_by.push_back({ column_name, descending });
+            if (!m_lexer.consume(Lexer::Comma))
+                break;
+        }
+    }
+
+    if (m_lexer.consume(Lexer::Limit))
+    {
+        auto limit = m_lexer.consume(Lexer::Integer);
+        if (!limit)
+        {
+            expected("limit");
+            return nullptr;
+        }
+
+        size_t count = 0;
+        std::from_chars(limit->data.data(), limit->data.data() + limit->data.size(), count);
+        select->m_limit = count;
+    }
+
     select->m_table = table->data;
     return select;
 }
 
+std::optional<HashAggregate::Aggregate> Parser::parse_aggregate(const std::string &function_name)
+{
+    auto function = HashAggregate::Aggregate::function_from_name(function_name);
+    if (!function)
+    {
+        m_errors.push_back("Unkown aggregate function '" + function_name + "'");
+        return std::nullopt;
+    }
+
+    match(Lexer::OpenBrace, "(");
+    std::string column;
+    if (!m_lexer.consume(Lexer::Star))
+    {
+        auto token = m_lexer.consume(Lexer::Name);
+        if (!token)
+        {
+            expected("column name");
+            return std::nullopt;
+        }
+        column = token->data;
+    }
+    match(Lexer::CloseBrace, ")");
+
+    if (column.empty() && *function != HashAggregate::Aggregate::Count)
+    {
+        expected("column name");
+        return std::nullopt;
+    }
+
+    return HashAggregate::Aggregate { *function, column };
+}
+
 std::shared_ptr<Statement> Parser::parse_insert()
 {
     match(Lexer::Insert, "instert");
@@ -221,13 +550,13 @@ std::shared_ptr<Statement> Parser::parse_insert()
         if (!column)
             expected("column name");
         else
-            insert->m_columns.push_back(column->data);
+            insert->m_columns.push_back(std::string(column->data));
     });
 
     match(Lexer::Values, "values");
     parse_list([&]()
     {
-        auto value = parse_value();
+        auto value = parse_expression();
         if (!value)
             expected("value");
         else
@@ -237,6 +566,42 @@ std::shared_ptr<Statement> Parser::parse_insert()
     return std::move(insert);
 }
 
+std::shared_ptr<Statement> Parser::parse_create()
+{
+    auto next = m_lexer.peek(1);
+    if (next && next->type == Lexer::Index)
+        return parse_create_index();
+    return parse_create_table();
+}
+
+std::shared_ptr<Statement> Parser::parse_create_index()
+{
+    match(Lexer::Create, "create");
+    match(Lexer::Index, "index");
+    match(Lexer::On, "on");
+
+    auto create_index = std::shared_ptr<CreateIndexStatement>(new CreateIndexStatement());
+    auto table = m_lexer.consume(Lexer::Name);
+    if (!table)
+    {
+        expected("table name");
+        return nullptr;
+    }
+    create_index->m_table = table->data;
+
+    match(Lexer::OpenBrace, "(");
+    auto column = m_lexer.consume(Lexer::Name);
+    if (!column)
+    {
+        expected("column name");
+        return nullptr;
+    }
+    create_index->m_column = column->data;
+    match(Lexer::CloseBrace, ")");
+
+    return create_index;
+}
+
 std::shared_ptr<Statement> Parser::parse_create_table()
 {
     match(Lexer::Create, "create");
@@ -291,14 +656,38 @@ std::shared_ptr<Statement> Parser::parse_create_table()
                 return;
             }
 
-            column_type_length = atoi(length->data.c_str());
+            std::from_chars(length->data.data(), length->data.data() + length->data.size(), column_type_length);
             match(Lexer::CloseBrace, ")");
         }
 
         create_table->m_columns.push_back({
-            column_name->data, column_type->data, column_type_length});
+            std::string(column_name->data), std::string(column_type->data), column_type_length});
     });
 
+    // PARTITION BY column EVERY width
+    if (m_lexer.consume(Lexer::Partition))
+    {
+        match(Lexer::By, "by");
+        auto column = m_lexer.consume(Lexer::Name);
+        if (!column)
+        {
+            expected("column name");
+            return nullptr;
+        }
+
+        match(Lexer::Every, "every");
+        auto width = m_lexer.consume(Lexer::Integer);
+        if (!width)
+        {
+            expected("partition width");
+            return nullptr;
+        }
+
+        create_table->m_partition_column = column->data;
+        std::from_chars(width->data.data(), width->data.data() + width->data.size(),
+            create_table->m_partition_width);
+    }
+
     return std::move(create_table);
 }
 
@@ -326,14 +715,14 @@ std::shared_ptr<Statement> Parser::parse_update()
         }
 
         match(Lexer::Equals, "=");
-        auto value = parse_value();
+        auto value = parse_expression();
         if (!value)
         {
             expected("value");
             return nullptr;
         }
 
-        update->m_columns.push_back({column->data, std::move(value)});
+        update->m_columns.push_back({std::string(column->data), std::move(value)});
         if (!m_lexer.consume(Lexer::Comma))
             break;
     }
@@ -379,7 +768,56 @@ std::shared_ptr<Statement> Parser::parse_delete()
     return delete_;
 }
 
+std::shared_ptr<Statement> Parser::parse_explain()
+{
+    match(Lexer::Explain, "explain");
+
+    auto explain = std::shared_ptr<ExplainStatement>(new ExplainStatement());
+    if (m_lexer.consume(Lexer::Analyze))
+        explain->m_analyze = true;
+
+    auto peek = m_lexer.peek();
+    if (peek && peek->type == Lexer::Explain)
+    {
+        m_errors.push_back("Can't explain an explain");
+        return nullptr;
+    }
+
+    explain->m_statement = parse_statement();
+    if (!explain->m_statement)
+        return nullptr;
+
+    return explain;
+}
+
+std::shared_ptr<Statement> Parser::parse_analyze()
+{
+    match(Lexer::Analyze, "analyze");
+
+    auto analyze = std::shared_ptr<AnalyzeStatement>(new AnalyzeStatement());
+    if (auto table = m_lexer.consume(Lexer::Name))
+        analyze->m_table = table->data;
+    return analyze;
+}
+
 std::shared_ptr<Statement> Parser::run()
+{
+    auto statement = parse_statement();
+    if (!statement || !good())
+        return statement;
+
+    // NOTE: Anything left over would otherwise be silently ignored
+    if (m_lexer.peek())
+    {
+        expected("end of query");
+        return nullptr;
+    }
+
+    statement->m_parameters = std::move(m_parameters);
+    return statement;
+}
+
+std::shared_ptr<Statement> Parser::parse_statement()
 {
     auto peek = m_lexer.peek();
     if (!peek)
@@ -392,11 +830,13 @@ std::shared_ptr<Statement> Parser::run()
     {
         case Lexer::Select: return parse_select();
         case Lexer::Insert: return parse_insert();
-        case Lexer::Create: return parse_create_table();
+        case Lexer::Create: return parse_create();
         case Lexer::Update: return parse_update();
         case Lexer::Delete: return parse_delete();
+        case Lexer::Explain: return parse_explain();
+        case Lexer::Analyze: return parse_analyze();
         default:
-            m_errors.push_back("Unkown statement '" + peek->data + "'");
+            m_errors.push_back("Unkown statement '" + std::string(peek->data) + "'");
             return nullptr;
     }
 }
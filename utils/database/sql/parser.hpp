@@ -2,7 +2,9 @@
 #include "lexer.hpp"
 #include "statement.hpp"
 #include "value.hpp"
+#include "hashaggregate.hpp"
 #include <functional>
+#include <optional>
 
 namespace DB::Sql
 {
@@ -21,19 +23,39 @@ namespace DB::Sql
 
         void expected(const std::string &name);
         void match(Lexer::Type, const std::string &name);
+        std::shared_ptr<Statement> parse_statement();
         std::shared_ptr<Statement> parse_select();
+        std::optional<HashAggregate::Aggregate> parse_aggregate(const std::string &function_name);
         std::shared_ptr<Statement> parse_insert();
+        std::shared_ptr<Statement> parse_create();
         std::shared_ptr<Statement> parse_create_table();
+        std::shared_ptr<Statement> parse_create_index();
         std::shared_ptr<Statement> parse_update();
         std::shared_ptr<Statement> parse_delete();
+        std::shared_ptr<Statement> parse_explain();
+        std::shared_ptr<Statement> parse_analyze();
 
+        // Expressions, from the tightest binding up
         std::unique_ptr<ValueNode> parse_value();
+        std::unique_ptr<ValueNode> parse_factor();
+        std::unique_ptr<ValueNode> parse_term();
+        std::unique_ptr<ValueNode> parse_arithmetic();
         std::unique_ptr<ValueNode> parse_comparison();
+        std::unique_ptr<ValueNode> parse_not();
+        std::unique_ptr<ValueNode> parse_or();
+
+        // Left associative operators between operands
+        std::unique_ptr<ValueNode> parse_binary(std::function<std::unique_ptr<ValueNode>()> parse_operand,
+            std::initializer_list<std::pair<Lexer::Type, ValueNode::Type>> operators);
+
+        // With any constants folded
+        std::unique_ptr<ValueNode> parse_expression();
         std::unique_ptr<ValueNode> parse_condition();
         void parse_list(std::function<void()>);
 
         Lexer m_lexer;
         std::vector<std::string> m_errors;
+        std::vector<ValueNode*> m_parameters;
     };
 
 }
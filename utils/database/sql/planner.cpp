@@ -0,0 +1,135 @@
+#include "planner.hpp"
+#include "value.hpp"
+#include "../table.hpp"
+#include <algorithm>
+#include <cmath>
+using namespace DB;
+using namespace DB::Sql;
+
+// Relative to reading and checking a single row
+static constexpr double row_cost = 1.0;
+static constexpr double chunk_cost = 64.0;
+static constexpr double zone_map_check_cost = 0.5;
+static constexpr double index_probe_cost = 8.0;
+static constexpr double index_row_cost = 4.0;
+
+Planner::Choice Planner::choose(Table &table, ValueNode *where,
+    const std::vector<std::string> &indexed_columns)
+{
+    auto row_chunks = table.row_chunks();
+    double row_count = table.row_count();
+    const auto *stats = table.stats();
+
+    Choice full_scan;
+    full_scan.path = AccessPath::FullScan;
+    full_scan.chunk_count = row_chunks.size();
+    full_scan.cost = row_chunks.size() * chunk_cost + row_count * row_cost;
+    full_scan.estimated_rows = row_count;
+    if (!where)
+        return full_scan;
+
+    where->order_by_selectivity(stats);
+
+    auto selectivity = where->estimate_selectivity(stats);
+    full_scan.estimated_rows = selectivity * row_count;
+
+    // The zone maps are in memory, so we know exactly which chunks can be skipped
+    Choice zone_map_scan = full_scan;
+    zone_map_scan.path = AccessPath::ZoneMapScan;
+    zone_map_scan.cost = 0;
+    for (const auto &row_chunk : row_chunks)
+    {
+        zone_map_scan.cost += zone_map_check_cost;
+        const auto *zone_map = table.find_zone_map(*row_chunk.chunk);
+        if (zone_map && where->can_skip(*zone_map))
+        {
+            zone_map_scan.skippable_chunk_count += 1;
+            continue;
+        }
+
+        zone_map_scan.cost += chunk_cost + row_chunk.row_count * row_cost;
+    }
+
+    auto best = zone_map_scan.cost < full_scan.cost ? zone_map_scan : full_scan;
+    for (const auto &column : where->literal_equality_columns())
+    {
+        if (std::find(indexed_columns.begin(), indexed_columns.end(), column) == indexed_columns.end())
+            continue;
+
+        // Every matching row could be in a different chunk
+        const auto *column_stats = stats ? stats->column(column) : nullptr;
+        auto matching_rows = column_stats
+            ? row_count / std::max(column_stats->distinct_count, (size_t)1)
+            : row_count * 0.1;
+
+        Choice index_lookup = full_scan;
+        index_lookup.path = AccessPath::IndexLookup;
+        index_lookup.index_column = column;
+        index_lookup.cost = index_probe_cost * std::log2(row_count + 2)
+            + matching_rows * (index_row_cost + row_cost);
+        if (index_lookup.cost < best.cost)
+            best = index_lookup;
+    }
+
+    for (const auto &[column, pattern] : where->like_patterns())
+    {
+        const auto *index = table.find_index(column);
+        if (!index)
+            continue;
+
+        // NOTE: The rarest trigram in the pattern bounds how many rows it could match
+        auto candidates = index->estimate_candidates(pattern);
+        if (!candidates)
+            continue;
+
+        Choice index_lookup = full_scan;
+        index_lookup.path = AccessPath::IndexLookup;
+        index_lookup.index_column = column;
+        index_lookup.index_pattern = pattern;
+        index_lookup.estimated_rows = std::min(full_scan.estimated_rows, (double)*candidates);
+        index_lookup.cost = index_probe_cost * std::log2(row_count + 2)
+            + *candidates * (index_row_cost + row_cost);
+        if (index_lookup.cost < best.cost)
+            best = index_lookup;
+    }
+
+    return best;
+}
+
+std::string Planner::path_name(AccessPath path)
+{
+    switch (path)
+    {
+        case AccessPath::FullScan: return "Full scan";
+        case AccessPath::ZoneMapScan: return "Zone map scan";
+        case AccessPath::IndexLookup: return "Index lookup";
+    }
+
+    return "";
+}
+
+std::string Planner::describe(const Table &table, const Choice &choice)
+{
+    auto detail = table.name();
+    switch (choice.path)
+    {
+        case AccessPath::FullScan:
+            detail += ", " + std::to_string(choice.chunk_count) + " chunks";
+            break;
+        case AccessPath::ZoneMapScan:
+            detail += ", " + std::to_string(choice.skippable_chunk_count)
+                + " of " + std::to_string(choice.chunk_count) + " chunks skipped";
+            break;
+        case AccessPath::IndexLookup:
+            detail += " on " + choice.index_column;
+            if (!choice.index_pattern.empty())
+                detail += " like '" + choice.index_pattern + "'";
+            break;
+    }
+
+    detail += ", ~" + std::to_string((size_t)std::llround(choice.estimated_rows)) + " rows";
+    detail += ", cost " + std::to_string((size_t)std::llround(choice.cost));
+    if (!table.stats())
+        detail += ", no stats";
+    return detail;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "../forward.hpp"
+#include <string>
+#include <vector>
+
+namespace DB::Sql
+{
+
+    // Picks how to read the rows of a table for a condition, by estimating
+    // the cost of each way from the table's stats and zone maps. Costs are
+    // in rough units of reading and checking one row.
+    class Planner
+    {
+    public:
+        enum class AccessPath
+        {
+            FullScan,
+            ZoneMapScan,
+            IndexLookup,
+        };
+
+        struct Choice
+        {
+            AccessPath path { AccessPath::FullScan };
+            double estimated_rows { 0 };
+            double cost { 0 };
+            size_t chunk_count { 0 };
+            size_t skippable_chunk_count { 0 };
+
+            // NOTE: Only set for an index lookup, which finds the
+            //       rows that could be 'LIKE' the pattern
+            std::string index_column;
+            std::string index_pattern;
+        };
+
+        // Indexed columns are those with an index that can find the rows
+        // equal to a given value, as well as the table's own trigram indexes
+        // for 'LIKE'. The condition is reordered, so the parts most likely
+        // to decide it are evaluated first.
+        static Choice choose(Table&, ValueNode *where,
+            const std::vector<std::string> &indexed_columns = {});
+
+        static std::string path_name(AccessPath);
+        static std::string describe(const Table&, const Choice&);
+
+    };
+
+}
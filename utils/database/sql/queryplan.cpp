@@ -0,0 +1,78 @@
+#include "queryplan.hpp"
+#include "../column.hpp"
+#include "../entry.hpp"
+#include "../row.hpp"
+using namespace DB;
+using namespace DB::Sql;
+
+QueryPlan::Timer::Timer(Operator *op, const char *profiler_scope)
+    : m_operator(op)
+{
+    if (!m_operator)
+        return;
+
+    if (profiler_scope)
+        m_profile_timer.emplace(profiler_scope);
+    m_start = std::chrono::steady_clock::now();
+}
+
+QueryPlan::Timer::~Timer()
+{
+    if (!m_operator)
+        return;
+
+    auto time_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_start);
+    m_operator->time_in_nanoseconds += time_elapsed.count();
+}
+
+QueryPlan::Operator &QueryPlan::add(std::string name, std::string detail)
+{
+    m_operators.push_back({ std::move(name), std::move(detail) });
+    return m_operators.back();
+}
+
+SqlResult QueryPlan::as_result(bool analyze) const
+{
+    std::vector<Column> columns =
+    {
+        Column("operator", DataType::char_(32)),
+        Column("detail", DataType::char_(128)),
+    };
+
+    if (analyze)
+    {
+        for (const auto *name : { "rows_in", "rows_out", "chunks_read",
+            "chunks_skipped", "bytes_read", "io_calls", "time_us" })
+        {
+            columns.push_back(Column(name, DataType::big_int()));
+        }
+    }
+
+    auto set = [](Row &row, const std::string &name, auto entry)
+    {
+        row[name]->set(std::move(entry));
+    };
+
+    SqlResult result;
+    for (const auto &op : m_operators)
+    {
+        Row row(columns);
+        set(row, "operator", std::make_unique<CharEntry>(op.name.substr(0, 32)));
+        set(row, "detail", std::make_unique<CharEntry>(op.detail.substr(0, 128)));
+        if (analyze)
+        {
+            set(row, "rows_in", std::make_unique<BigIntEntry>(op.rows_in));
+            set(row, "rows_out", std::make_unique<BigIntEntry>(op.rows_out));
+            set(row, "chunks_read", std::make_unique<BigIntEntry>(op.chunks_read));
+            set(row, "chunks_skipped", std::make_unique<BigIntEntry>(op.chunks_skipped));
+            set(row, "bytes_read", std::make_unique<BigIntEntry>(op.bytes_read));
+            set(row, "io_calls", std::make_unique<BigIntEntry>(op.io_calls));
+            set(row, "time_us", std::make_unique<BigIntEntry>(op.time_in_nanoseconds / 1000));
+        }
+
+        result.m_rows.push_back(std::move(row));
+    }
+
+    return result;
+}
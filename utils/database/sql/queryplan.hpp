@@ -0,0 +1,62 @@
+#pragma once
+#include "../forward.hpp"
+#include "sql.hpp"
+#include <libprofile/profile.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+
+namespace DB::Sql
+{
+
+    // The steps taken to run a statement, in the order rows flow through
+    // them. When analysing, each step also counts the rows going in and
+    // out of it, the chunks and bytes it read and the time it took.
+    class QueryPlan
+    {
+    public:
+        struct Operator
+        {
+            std::string name;
+            std::string detail;
+            size_t rows_in { 0 };
+            size_t rows_out { 0 };
+            size_t chunks_read { 0 };
+            size_t chunks_skipped { 0 };
+            size_t bytes_read { 0 };
+            size_t io_calls { 0 };
+            uint64_t time_in_nanoseconds { 0 };
+        };
+
+        // Adds time to an operator until it goes out of scope. A
+        // null operator is ignored, so this costs nothing outside
+        // of analysing. When given a profiler scope, the time also
+        // shows up under that name in the profiler tree.
+        class Timer
+        {
+        public:
+            Timer(Operator *op, const char *profiler_scope = nullptr);
+            ~Timer();
+
+        private:
+            Operator *m_operator;
+            std::optional<Profile::Timer> m_profile_timer;
+            std::chrono::steady_clock::time_point m_start;
+
+        };
+
+        // NOTE: Operators are kept in a deque, so references
+        //       to them stay valid as more are added
+        Operator &add(std::string name, std::string detail = "");
+        inline const std::deque<Operator> &operators() const { return m_operators; }
+
+        SqlResult as_result(bool analyze) const;
+
+    private:
+        std::deque<Operator> m_operators;
+
+    };
+
+}
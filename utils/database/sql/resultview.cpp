@@ -0,0 +1,363 @@
+#include "resultview.hpp"
+#include "sql.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <sstream>
+using namespace DB;
+
+template<typename T>
+static void put(std::string &out, T value)
+{
+    out.append((const char*)&value, sizeof(T));
+}
+
+static void put_string(std::string &out, std::string_view str)
+{
+    put<uint32_t>(out, str.size());
+    out.append(str);
+}
+
+static size_t encoded_size(DataType::Primitive primitive)
+{
+    switch (primitive)
+    {
+        case DataType::Integer: return 1 + sizeof(int32_t);
+        case DataType::BigInt: return 1 + sizeof(int64_t);
+        case DataType::Float: return 1 + sizeof(float);
+        case DataType::Char:
+        case DataType::Text:
+            return 1 + 2 * sizeof(uint32_t);
+    }
+
+    assert (false);
+}
+
+// The type a column needs to hold values of both types
+static DataType::Primitive merge_types(DataType::Primitive a, DataType::Primitive b)
+{
+    auto is_one_of = [&](auto x, auto y)
+    {
+        return (a == x && b == y) || (a == y && b == x);
+    };
+
+    if (a == b)
+        return a;
+    if (is_one_of(DataType::Integer, DataType::BigInt))
+        return DataType::BigInt;
+
+    // NOTE: Anything else is written out as text
+    return DataType::Text;
+}
+
+std::string SqlResult::encode() const
+{
+    std::string out;
+    put<uint32_t>(out, m_errors.size());
+    for (const auto &error : m_errors)
+        put_string(out, error);
+
+    // NOTE: Results don't carry their columns, so the names come from the
+    //       first row and the types from the first value that isn't null
+    std::vector<std::string> names;
+    std::vector<std::optional<DataType::Primitive>> types;
+    if (!m_rows.empty())
+    {
+        for (const auto &[name, entry] : m_rows.front())
+            names.push_back(name);
+    }
+
+    types.resize(names.size());
+    for (const auto &row : m_rows)
+    {
+        size_t column = 0;
+        for (const auto &[name, entry] : row)
+        {
+            assert (column < names.size());
+            if (entry != nullptr && !entry->is_null())
+            {
+                auto primitive = entry->data_type().primitive();
+                auto &type = types[column];
+                type = type ? merge_types(*type, primitive) : primitive;
+            }
+            column += 1;
+        }
+    }
+
+    put<uint32_t>(out, names.size());
+    uint32_t row_size = 0;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        auto primitive = types[i].value_or(DataType::Integer);
+        types[i] = primitive;
+
+        put<uint8_t>(out, primitive);
+        put<uint32_t>(out, row_size);
+        put_string(out, names[i]);
+        row_size += encoded_size(primitive);
+    }
+
+    put<uint32_t>(out, row_size);
+    put<uint64_t>(out, m_rows.size());
+
+    // NOTE: The heap size is filled in once the rows are written
+    auto heap_size_offset = out.size();
+    put<uint64_t>(out, 0);
+
+    std::string heap;
+    out.reserve(out.size() + m_rows.size() * row_size);
+    for (const auto &row : m_rows)
+    {
+        size_t column = 0;
+        for (const auto &[name, entry] : row)
+        {
+            auto primitive = *types[column++];
+            if (entry == nullptr || entry->is_null())
+            {
+                put<uint8_t>(out, 1);
+                out.append(encoded_size(primitive) - 1, '\0');
+                continue;
+            }
+
+            put<uint8_t>(out, 0);
+            switch (primitive)
+            {
+                case DataType::Integer:
+                    put<int32_t>(out, entry->as_int());
+                    break;
+                case DataType::BigInt:
+                {
+                    auto is_int = entry->data_type().primitive() == DataType::Integer;
+                    put<int64_t>(out, is_int ? entry->as_int() : entry->as_long());
+                    break;
+                }
+                case DataType::Float:
+                    put<float>(out, entry->as_float());
+                    break;
+                case DataType::Char:
+                case DataType::Text:
+                {
+                    auto entry_primitive = entry->data_type().primitive();
+                    std::string str;
+                    if (entry_primitive == DataType::Char || entry_primitive == DataType::Text)
+                    {
+                        str = entry->as_string();
+                    }
+                    else
+                    {
+                        std::stringstream stream;
+                        stream << *entry;
+                        str = stream.str();
+                    }
+
+                    assert (heap.size() + str.size() <= UINT32_MAX);
+                    put<uint32_t>(out, heap.size());
+                    put<uint32_t>(out, str.size());
+                    heap += str;
+                    break;
+                }
+            }
+        }
+        assert (column == types.size());
+    }
+
+    uint64_t heap_size = heap.size();
+    memcpy(out.data() + heap_size_offset, &heap_size, sizeof(uint64_t));
+    out += heap;
+    return out;
+}
+
+std::optional<ResultView> ResultView::parse(std::string_view buffer)
+{
+    ResultView view;
+    view.m_buffer = buffer;
+    if (!view.parse_buffer())
+        return std::nullopt;
+
+    return view;
+}
+
+std::optional<ResultView> ResultView::parse(std::string &&buffer)
+{
+    ResultView view;
+    view.m_owned_buffer = std::move(buffer);
+    if (!view.parse_buffer())
+        return std::nullopt;
+
+    return view;
+}
+
+bool ResultView::parse_buffer()
+{
+    auto data = buffer();
+    size_t offset = 0;
+
+    auto get = [&](auto &value)
+    {
+        if (data.size() - offset < sizeof(value))
+            return false;
+
+        memcpy(&value, data.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    };
+
+    auto get_slice = [&](Slice &slice)
+    {
+        uint32_t size;
+        if (!get(size) || data.size() - offset < size)
+            return false;
+
+        slice = { offset, size };
+        offset += size;
+        return true;
+    };
+
+    uint32_t error_count;
+    if (!get(error_count))
+        return false;
+
+    for (uint32_t i = 0; i < error_count; i++)
+    {
+        Slice error;
+        if (!get_slice(error))
+            return false;
+        m_errors.push_back(error);
+    }
+
+    uint32_t column_count;
+    if (!get(column_count))
+        return false;
+
+    for (uint32_t i = 0; i < column_count; i++)
+    {
+        uint8_t primitive;
+        uint32_t offset_in_row;
+        Slice name;
+        if (!get(primitive) || !get(offset_in_row) || !get_slice(name))
+            return false;
+        if (primitive > DataType::Float)
+            return false;
+
+        m_columns.push_back({ name, (DataType::Primitive)primitive, offset_in_row });
+    }
+
+    uint32_t row_size;
+    uint64_t row_count, heap_size;
+    if (!get(row_size) || !get(row_count) || !get(heap_size))
+        return false;
+
+    for (const auto &column : m_columns)
+    {
+        if (column.offset_in_row + encoded_size(column.primitive) > row_size)
+            return false;
+    }
+
+    m_row_size = row_size;
+    m_row_count = row_count;
+    m_rows_offset = offset;
+    if (row_size != 0 && row_count > (data.size() - offset) / row_size)
+        return false;
+
+    m_heap_offset = offset + row_size * row_count;
+    m_heap_size = heap_size;
+    return m_heap_offset + m_heap_size == data.size();
+}
+
+std::vector<std::string_view> ResultView::errors() const
+{
+    std::vector<std::string_view> errors;
+    for (const auto &error : m_errors)
+        errors.push_back(slice(error));
+
+    return errors;
+}
+
+std::optional<size_t> ResultView::find_column(std::string_view name) const
+{
+    for (size_t i = 0; i < m_columns.size(); i++)
+    {
+        if (column_name(i) == name)
+            return i;
+    }
+
+    return std::nullopt;
+}
+
+const char *ResultView::value_data(size_t row, size_t column) const
+{
+    assert (row < m_row_count && column < m_columns.size());
+    return buffer().data() + m_rows_offset + row * m_row_size + m_columns[column].offset_in_row;
+}
+
+bool ResultView::is_null(size_t row, size_t column) const
+{
+    return value_data(row, column)[0] != 0;
+}
+
+int64_t ResultView::as_long(size_t row, size_t column) const
+{
+    auto data = value_data(row, column) + 1;
+    switch (column_type(column))
+    {
+        case DataType::Integer:
+        {
+            int32_t i;
+            memcpy(&i, data, sizeof(i));
+            return i;
+        }
+        case DataType::BigInt:
+        {
+            int64_t i;
+            memcpy(&i, data, sizeof(i));
+            return i;
+        }
+        default:
+            assert (false);
+    }
+}
+
+float ResultView::as_float(size_t row, size_t column) const
+{
+    assert (column_type(column) == DataType::Float);
+
+    float f;
+    memcpy(&f, value_data(row, column) + 1, sizeof(f));
+    return f;
+}
+
+std::string_view ResultView::as_string(size_t row, size_t column) const
+{
+    auto type = column_type(column);
+    assert (type == DataType::Char || type == DataType::Text);
+
+    uint32_t heap_offset, size;
+    auto data = value_data(row, column) + 1;
+    memcpy(&heap_offset, data, sizeof(uint32_t));
+    memcpy(&size, data + sizeof(uint32_t), sizeof(uint32_t));
+
+    // NOTE: Out of range strings come from a corrupt buffer, so are read as empty
+    if (heap_offset > m_heap_size || size > m_heap_size - heap_offset)
+        return {};
+    return buffer().substr(m_heap_offset + heap_offset, size);
+}
+
+Sql::Value ResultView::value(size_t row, size_t column) const
+{
+    if (is_null(row, column))
+        return Sql::Value();
+
+    switch (column_type(column))
+    {
+        case DataType::Integer:
+        case DataType::BigInt:
+            return Sql::Value(as_long(row, column));
+        case DataType::Float:
+            return Sql::Value(as_float(row, column));
+        case DataType::Char:
+        case DataType::Text:
+            return Sql::Value(std::string(as_string(row, column)));
+    }
+
+    assert (false);
+}
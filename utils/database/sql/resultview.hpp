@@ -0,0 +1,85 @@
+#pragma once
+#include "../entry.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace DB
+{
+
+    // Reads a result encoded by SqlResult::encode() straight out of the buffer.
+    //
+    // The encoding is the errors, a schema header, then every row as fixed
+    // width bytes, followed by a heap the strings are stored in:
+    //
+    //     u32 error count, then each error as a u32 size and its bytes
+    //     u32 column count, then for each column:
+    //         u8 primitive, u32 offset in the row, u32 name size, name bytes
+    //     u32 row size, u64 row count, u64 heap size
+    //     row data (row count * row size bytes)
+    //     heap (heap size bytes)
+    //
+    // Each value in a row starts with an 'is null' flag, followed by an i32
+    // for Integer, an i64 for BigInt, a float for Float, or a u32 offset
+    // into the heap and a u32 size for Char and Text
+    class ResultView
+    {
+    public:
+        // NOTE: The buffer is not copied, so it has to outlive the view
+        static std::optional<ResultView> parse(std::string_view buffer);
+        static std::optional<ResultView> parse(std::string &&buffer);
+
+        inline bool good() const { return m_errors.empty(); }
+        std::vector<std::string_view> errors() const;
+
+        inline size_t row_count() const { return m_row_count; }
+        inline size_t column_count() const { return m_columns.size(); }
+        inline std::string_view column_name(size_t column) const { return slice(m_columns[column].name); }
+        inline DataType::Primitive column_type(size_t column) const { return m_columns[column].primitive; }
+        std::optional<size_t> find_column(std::string_view name) const;
+
+        bool is_null(size_t row, size_t column) const;
+        int64_t as_long(size_t row, size_t column) const;
+        float as_float(size_t row, size_t column) const;
+        std::string_view as_string(size_t row, size_t column) const;
+        Sql::Value value(size_t row, size_t column) const;
+
+    private:
+        ResultView() = default;
+
+        // NOTE: Everything is kept as offsets, so the view
+        //       stays valid when an owned buffer is moved
+        struct Slice
+        {
+            size_t offset;
+            size_t size;
+        };
+
+        struct ColumnInfo
+        {
+            Slice name;
+            DataType::Primitive primitive;
+            size_t offset_in_row;
+        };
+
+        bool parse_buffer();
+        inline std::string_view buffer() const { return m_owned_buffer.empty() ? m_buffer : m_owned_buffer; }
+        inline std::string_view slice(Slice slice) const { return buffer().substr(slice.offset, slice.size); }
+        const char *value_data(size_t row, size_t column) const;
+
+        std::string m_owned_buffer;
+        std::string_view m_buffer;
+        std::vector<Slice> m_errors;
+        std::vector<ColumnInfo> m_columns;
+        size_t m_row_size { 0 };
+        size_t m_row_count { 0 };
+        size_t m_rows_offset { 0 };
+        size_t m_heap_offset { 0 };
+        size_t m_heap_size { 0 };
+
+    };
+
+}
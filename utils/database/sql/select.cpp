@@ -1,38 +1,525 @@
 #include "select.hpp"
 #include "value.hpp"
+#include "queryplan.hpp"
+#include "planner.hpp"
 #include "../database.hpp"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 using namespace DB;
 using namespace DB::Sql;
 
 SelectStatement::SelectStatement()
     : Statement(Type::Select) {}
 
+static bool has_column(const std::vector<Column> &columns, const std::string &name)
+{
+    return std::any_of(columns.begin(), columns.end(),
+        [&](const auto &column) { return column.name() == name; });
+}
+
+std::optional<SqlResult> SelectStatement::resolve_names(const std::vector<Column> &columns, Names &names) const
+{
+    names = { m_columns, m_group_by, m_aggregates, m_order_by };
+
+    // Find the full name of a column, which may have been
+    // given without the table it's from
+    std::optional<SqlResult> error;
+    auto resolve = [&](std::string &name)
+    {
+        if (has_column(columns, name))
+            return;
+
+        std::vector<std::string> matches;
+        for (const auto &column : columns)
+        {
+            const auto &full_name = column.name();
+            auto suffix = "." + name;
+            if (full_name.size() > suffix.size() &&
+                full_name.compare(full_name.size() - suffix.size(), suffix.size(), suffix) == 0)
+            {
+                matches.push_back(full_name);
+            }
+        }
+
+        if (matches.size() > 1 && !error)
+            error = SqlResult::error("Column name '" + name + "' is ambiguous");
+        if (matches.size() == 1)
+            name = matches.front();
+    };
+
+    auto rename = [](std::vector<std::string> &list, const std::string &from, const std::string &to)
+    {
+        std::replace(list.begin(), list.end(), from, to);
+    };
+
+    for (auto &aggregate : names.aggregates)
+    {
+        if (aggregate.column.empty())
+            continue;
+
+        // NOTE: Aggregates are referred to by name, so that changes too
+        auto old_name = aggregate.name();
+        resolve(aggregate.column);
+        rename(names.columns, old_name, aggregate.name());
+        for (auto &key : names.order_by)
+        {
+            if (key.column == old_name)
+                key.column = aggregate.name();
+        }
+    }
+
+    for (auto &column : names.columns)
+        resolve(column);
+    for (auto &column : names.group_by)
+        resolve(column);
+    for (auto &key : names.order_by)
+        resolve(key.column);
+
+    return error;
+}
+
+std::optional<SqlResult> SelectStatement::validate_aggregate(const std::vector<Column> &columns, const Names &names) const
+{
+    if (m_all)
+        return SqlResult::error("Can't select '*' with an aggregate");
+
+    for (const auto &column : names.group_by)
+    {
+        if (!has_column(columns, column))
+            return SqlResult::error("No column with the name '" + column + "' to group by");
+    }
+
+    for (const auto &aggregate : names.aggregates)
+    {
+        if (aggregate.column.empty())
+            continue;
+
+        auto column = std::find_if(columns.begin(), columns.end(),
+            [&](const auto &column) { return column.name() == aggregate.column; });
+        if (column == columns.end())
+            return SqlResult::error("No column with the name '" + aggregate.column + "' to aggregate");
+
+        auto primitive = column->data_type().primitive();
+        auto is_numeric = primitive == DataType::Integer
+            || primitive == DataType::BigInt
+            || primitive == DataType::Float;
+        auto needs_numeric = aggregate.function == HashAggregate::Aggregate::Sum
+            || aggregate.function == HashAggregate::Aggregate::Avg;
+        if (needs_numeric && !is_numeric)
+            return SqlResult::error("Can't take '" + aggregate.name() + "' of a non numeric column");
+    }
+
+    for (const auto &column : names.columns)
+    {
+        auto is_aggregate = std::any_of(names.aggregates.begin(), names.aggregates.end(),
+            [&](const auto &aggregate) { return aggregate.name() == column; });
+        auto is_grouped = std::find(names.group_by.begin(), names.group_by.end(), column) != names.group_by.end();
+        if (!is_aggregate && !is_grouped)
+            return SqlResult::error("Column '" + column + "' must be grouped by or used in an aggregate");
+    }
+
+    for (const auto &key : names.order_by)
+    {
+        if (std::find(names.columns.begin(), names.columns.end(), key.column) == names.columns.end())
+            return SqlResult::error("Can only order by a selected column or aggregate, not '" + key.column + "'");
+    }
+
+    return std::nullopt;
+}
+
 SqlResult SelectStatement::execute(DataBase& db) const
+{
+    return run(db, nullptr, true);
+}
+
+SqlResult SelectStatement::explain(DataBase &db, QueryPlan &plan, bool analyze) const
+{
+    auto result = run(db, &plan, analyze);
+    if (!result.good())
+        return result;
+
+    return SqlResult::ok();
+}
+
+SqlResult SelectStatement::run(DataBase &db, QueryPlan *plan, bool analyze) const
 {
     auto table = db.get_table(m_table);
     if (!table)
         return SqlResult::error("No table with the name '" + m_table + "' found");
 
-    SqlResult result;
-    for (size_t i = 0; i < table->row_count(); i++)
+    std::optional<HashJoin> join;
+    if (m_join)
+    {
+        auto join_table = db.get_table(m_join->table);
+        if (!join_table)
+            return SqlResult::error("No table with the name '" + m_join->table + "' found");
+
+        join.emplace(*table, *join_table, *m_join->condition);
+        if (auto unknown = m_join->condition->unknown_column(join->columns()))
+            return SqlResult::error("No column with the name '" + *unknown + "' to join on");
+    }
+
+    const auto &columns = join ? join->columns() : table->columns();
+    Names names;
+    auto error = resolve_names(columns, names);
+    if (error)
+        return std::move(*error);
+    if (m_where)
+    {
+        if (auto unknown = m_where->unknown_column(columns))
+            return SqlResult::error("No column with the name '" + *unknown + "' found");
+    }
+
+    // NOTE: Working memory comes out of the database's memory budget
+    std::optional<MemoryBudget::Reservation> aggregate_memory;
+    std::optional<HashAggregate> aggregate;
+    if (!names.aggregates.empty() || !names.group_by.empty())
+    {
+        auto error = validate_aggregate(columns, names);
+        if (error)
+            return std::move(*error);
+
+        aggregate_memory.emplace(db.reserve_memory(Config::aggregate_memory_budget));
+        aggregate.emplace(columns, names.group_by, names.aggregates,
+            names.columns, aggregate_memory->size_in_bytes());
+    }
+    else
+    {
+        for (const auto &column : names.columns)
+        {
+            if (!has_column(columns, column))
+                return SqlResult::error("No column with the name '" + column + "' to select");
+        }
+        for (const auto &key : names.order_by)
+        {
+            if (!has_column(columns, key.column))
+                return SqlResult::error("No column with the name '" + key.column + "' to order by");
+        }
+    }
+
+    // NOTE: Rows are sorted before they're projected,
+    //       as we may be ordering by a column not selected.
+    //       Aggregated rows are sorted after grouping.
+    std::optional<MemoryBudget::Reservation> sort_memory;
+    std::optional<Sorter> sorter;
+    if (!names.order_by.empty())
     {
-        auto row = table->get_row(i);
-        assert (row);
-        
+        const auto &sort_columns = aggregate ? aggregate->output_columns() : columns;
+        sort_memory.emplace(db.reserve_memory(Config::sort_memory_budget));
+        sorter.emplace(sort_columns, names.order_by, m_limit, sort_memory->size_in_bytes());
+    }
+
+    // NOTE: Joins always read every row of both tables
+    std::optional<Planner::Choice> access;
+    if (!join)
+    {
+        auto planning_start = std::chrono::steady_clock::now();
+        access = Planner::choose(*table, m_where.get());
+        db.add_plan_time(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - planning_start).count());
+    }
+    auto use_zone_maps = access && access->path == Planner::AccessPath::ZoneMapScan;
+
+    // Each step of the plan, only set if there's a plan to fill in
+    QueryPlan::Operator *scan_step = nullptr;
+    QueryPlan::Operator *filter_step = nullptr;
+    QueryPlan::Operator *aggregate_step = nullptr;
+    QueryPlan::Operator *sort_step = nullptr;
+    QueryPlan::Operator *limit_step = nullptr;
+    QueryPlan::Operator *project_step = nullptr;
+    if (plan)
+    {
+        if (join)
+            scan_step = &plan->add(join->is_hash_join() ? "Hash join" : "Nested loop join", join->describe());
+        else
+            scan_step = &plan->add(Planner::path_name(access->path), Planner::describe(*table, *access));
+
         if (m_where)
+            filter_step = &plan->add("Filter", "where");
+
+        if (aggregate)
         {
-            auto where_result = m_where->evaluate(*row);
-            if (!where_result.as_bool())
-                continue;
+            std::string detail;
+            for (const auto &name : names.columns)
+                detail += (detail.empty() ? "" : ", ") + name;
+            if (!names.group_by.empty())
+            {
+                detail += " by ";
+                for (size_t i = 0; i < names.group_by.size(); i++)
+                    detail += (i ? ", " : "") + names.group_by[i];
+            }
+            aggregate_step = &plan->add("Hash aggregate", detail);
+        }
+
+        if (sorter)
+        {
+            std::string detail;
+            for (const auto &key : names.order_by)
+                detail += (detail.empty() ? "" : ", ") + key.column + (key.descending ? " desc" : "");
+            if (m_limit)
+                detail += ", limit " + std::to_string(*m_limit);
+            sort_step = &plan->add(sorter->uses_heap() ? "Top N sort" : "Sort", detail);
+        }
+        else if (m_limit)
+        {
+            limit_step = &plan->add("Limit", std::to_string(*m_limit));
+        }
+
+        project_step = &plan->add("Project", m_all ? "*" : std::to_string(names.columns.size()) + " columns");
+        if (!analyze)
+            return SqlResult::ok();
+    }
+
+    SqlResult result;
+    auto emit = [&](Row row)
+    {
+        QueryPlan::Timer timer(project_step);
+        if (project_step)
+        {
+            project_step->rows_in += 1;
+            project_step->rows_out += 1;
         }
 
         if (m_all)
         {
-            result.m_rows.push_back(std::move(*row));
-            continue;
+            result.m_rows.push_back(std::move(row));
+            return;
+        }
+        result.m_rows.push_back(Row(names.columns, std::move(row)));
+    };
+
+    auto sort = [&](Row row)
+    {
+        QueryPlan::Timer timer(sort_step);
+        if (sort_step)
+            sort_step->rows_in += 1;
+        sorter->add(std::move(row));
+    };
+
+    // Without an order, we can stop as soon as we have enough rows
+    auto has_reached_limit = [&]()
+    {
+        return !sorter && m_limit && result.m_rows.size() >= *m_limit;
+    };
+
+    // Filter a row, then pass it on to be aggregated, sorted or output.
+    // Rows read straight from a table chunk are given their chunk, so
+    // the aggregate can key them on the raw row data.
+    auto process_row = [&](Row row, Chunk *chunk, size_t index_in_chunk)
+    {
+        if (m_where)
+        {
+            QueryPlan::Timer timer(filter_step);
+            auto where_result = m_where->evaluate(row);
+            if (filter_step)
+            {
+                filter_step->rows_in += 1;
+                filter_step->rows_out += where_result.is_true();
+            }
+
+            if (!where_result.is_true())
+                return;
+        }
+
+        if (aggregate)
+        {
+            QueryPlan::Timer timer(aggregate_step);
+            if (aggregate_step)
+                aggregate_step->rows_in += 1;
+
+            auto key = chunk
+                ? aggregate->make_key(table->read_row_data(*chunk, index_in_chunk), row)
+                : aggregate->make_key(row);
+            aggregate->add(std::move(row), std::move(key));
+        }
+        else if (sorter)
+        {
+            sort(std::move(row));
+        }
+        else
+        {
+            emit(std::move(row));
+        }
+    };
+
+    auto io_stats_before = db.io_stats();
+    {
+        QueryPlan::Timer timer(scan_step, "SelectStatement::scan");
+        if (join)
+        {
+            join->run([&](Row row)
+            {
+                process_row(std::move(row), nullptr, 0);
+                return !has_reached_limit();
+            });
+
+            if (scan_step)
+                scan_step->rows_out = join->rows_read();
+        }
+        else if (access->path == Planner::AccessPath::IndexLookup)
+        {
+            // NOTE: The rows are in order, so each chunk is found by walking forward
+            const auto *index = table->find_index(access->index_column);
+            auto rows = index->candidates(access->index_pattern);
+            assert (rows);
+
+            auto row_chunks = table->row_chunks();
+            size_t chunk_index = 0;
+            for (auto row_index : *rows)
+            {
+                if (has_reached_limit())
+                    break;
+
+                while (chunk_index < row_chunks.size() &&
+                    row_index >= row_chunks[chunk_index].first_row + row_chunks[chunk_index].row_count)
+                {
+                    chunk_index += 1;
+                }
+                if (chunk_index >= row_chunks.size())
+                    break;
+
+                auto &chunk = *row_chunks[chunk_index].chunk;
+                auto index_in_chunk = row_index - row_chunks[chunk_index].first_row;
+                if (scan_step)
+                    scan_step->rows_out += 1;
+                process_row(table->read_row(chunk, index_in_chunk), &chunk, index_in_chunk);
+            }
+        }
+        else
+        {
+            auto row_chunks = table->row_chunks();
+            for (size_t chunk_index = 0; chunk_index < row_chunks.size(); chunk_index++)
+            {
+                if (has_reached_limit())
+                    break;
+
+                const auto &row_chunk = row_chunks[chunk_index];
+                auto &chunk = *row_chunk.chunk;
+
+                // Skip whole partitions outside the time the condition is for,
+                // whichever way the table is scanned
+                auto partition_zone_map = table->partition_zone_map(chunk);
+                if (m_where && partition_zone_map && m_where->can_skip(*partition_zone_map))
+                {
+                    if (scan_step)
+                        scan_step->chunks_skipped += 1;
+                    continue;
+                }
+
+                // Skip whole chunks the condition can't match, building
+                // a zone map for the chunk as we go if it doesn't have one
+                const auto *zone_map = table->find_zone_map(chunk);
+                if (use_zone_maps && zone_map && m_where->can_skip(*zone_map))
+                {
+                    if (scan_step)
+                        scan_step->chunks_skipped += 1;
+                    continue;
+                }
+
+                std::optional<ZoneMap> new_zone_map;
+                if (!zone_map)
+                    new_zone_map = table->make_zone_map();
+
+                if (scan_step)
+                    scan_step->chunks_read += 1;
+                table->read_ahead(row_chunks, chunk_index);
+
+                for (size_t i = 0; i < row_chunk.row_count; i++)
+                {
+                    if (has_reached_limit())
+                    {
+                        // Only part of the chunk has been seen
+                        new_zone_map = std::nullopt;
+                        break;
+                    }
+
+                    auto row = table->read_row(chunk, i);
+                    if (new_zone_map)
+                        new_zone_map->add(row);
+
+                    if (scan_step)
+                        scan_step->rows_out += 1;
+                    process_row(std::move(row), &chunk, i);
+                }
+
+                if (new_zone_map)
+                    table->set_zone_map(chunk, std::move(*new_zone_map));
+            }
+        }
+    }
+
+    // NOTE: Each step drives the ones after it, so the time spent
+    //       in those is taken out to get the time of the step itself
+    auto time_after = [](std::initializer_list<QueryPlan::Operator*> steps)
+    {
+        uint64_t time = 0;
+        for (const auto *step : steps)
+            time += step ? step->time_in_nanoseconds : 0;
+        return time;
+    };
+
+    if (scan_step)
+    {
+        scan_step->time_in_nanoseconds -= time_after({ filter_step, aggregate_step, sort_step, project_step });
+
+        scan_step->bytes_read = db.io_stats().bytes_read - io_stats_before.bytes_read;
+        scan_step->io_calls = (db.io_stats().reads + db.io_stats().writes)
+            - (io_stats_before.reads + io_stats_before.writes);
+    }
+
+    if (aggregate)
+    {
+        auto time_before = time_after({ sort_step, project_step });
+        {
+            QueryPlan::Timer timer(aggregate_step, "SelectStatement::aggregate");
+            aggregate->finish([&](Row row)
+            {
+                if (aggregate_step)
+                    aggregate_step->rows_out += 1;
+
+                if (sorter)
+                    sort(std::move(row));
+                else if (!has_reached_limit())
+                    emit(std::move(row));
+            });
         }
-        result.m_rows.push_back(Row(m_columns, std::move(*row)));
+
+        aggregate_memory->count_spill(aggregate->spilled_in_bytes());
+        if (aggregate_step)
+        {
+            aggregate_step->time_in_nanoseconds -= time_after({ sort_step, project_step }) - time_before;
+            if (aggregate->spilled_row_count() > 0)
+                aggregate_step->detail += ", spilled " + std::to_string(aggregate->spilled_row_count()) + " rows";
+        }
+    }
+
+    if (sorter)
+    {
+        auto time_before = time_after({ project_step });
+        {
+            QueryPlan::Timer timer(sort_step, "SelectStatement::sort");
+            sorter->finish([&](Row row)
+            {
+                if (sort_step)
+                    sort_step->rows_out += 1;
+                emit(std::move(row));
+            });
+        }
+
+        sort_memory->count_spill(sorter->spilled_in_bytes());
+        if (sort_step)
+        {
+            sort_step->time_in_nanoseconds -= time_after({ project_step }) - time_before;
+            if (sorter->spilled_run_count() > 0)
+                sort_step->detail += ", " + std::to_string(sorter->spilled_run_count()) + " runs spilled";
+        }
+    }
+
+    if (limit_step)
+    {
+        limit_step->rows_in = result.m_rows.size();
+        limit_step->rows_out = result.m_rows.size();
     }
 
     return result;
@@ -1,5 +1,9 @@
 #pragma once
 #include "statement.hpp"
+#include "sorter.hpp"
+#include "hashaggregate.hpp"
+#include "hashjoin.hpp"
+#include <optional>
 #include <vector>
 #include <string>
 
@@ -12,13 +16,42 @@ namespace DB::Sql
 
     public:
         virtual SqlResult execute(DataBase&) const override;
+        virtual SqlResult explain(DataBase&, QueryPlan&, bool analyze) const override;
 
     private:
         SelectStatement();
 
+        // Without a plan, the query is just run. With one, the plan is filled
+        // in, and the query is only run (and profiled) if analysing
+        SqlResult run(DataBase&, QueryPlan*, bool analyze) const;
+
+        // The column names used by the statement, resolved
+        // against the columns of the table or join
+        struct Names
+        {
+            std::vector<std::string> columns;
+            std::vector<std::string> group_by;
+            std::vector<HashAggregate::Aggregate> aggregates;
+            std::vector<Sorter::Key> order_by;
+        };
+
+        std::optional<SqlResult> resolve_names(const std::vector<Column>&, Names&) const;
+        std::optional<SqlResult> validate_aggregate(const std::vector<Column>&, const Names&) const;
+
+        struct Join
+        {
+            std::string table;
+            std::unique_ptr<ValueNode> condition;
+        };
+
         std::vector<std::string> m_columns;
         std::string m_table;
+        std::optional<Join> m_join;
         std::unique_ptr<ValueNode> m_where;
+        std::vector<std::string> m_group_by;
+        std::vector<HashAggregate::Aggregate> m_aggregates;
+        std::vector<Sorter::Key> m_order_by;
+        std::optional<size_t> m_limit;
         bool m_all { false };
 
     };
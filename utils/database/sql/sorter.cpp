@@ -0,0 +1,170 @@
+#include "sorter.hpp"
+#include "../entry.hpp"
+#include <algorithm>
+#include <cassert>
+using namespace DB;
+using namespace DB::Sql;
+
+Sorter::Sorter(const std::vector<Column> &columns, std::vector<Key> keys,
+    std::optional<size_t> limit, size_t memory_budget)
+    : m_columns(columns)
+    , m_keys(std::move(keys))
+    , m_limit(limit)
+    , m_memory_budget(memory_budget)
+{
+    // NOTE: Rough in memory size of a row, the data plus an entry object per column
+    m_bytes_per_row = sizeof(Row);
+    for (const auto &column : m_columns)
+        m_bytes_per_row += column.data_type().size() + 64;
+
+    // If the top rows fit in memory, we don't need to sort everything
+    m_use_heap = m_limit && *m_limit * m_bytes_per_row <= m_memory_budget;
+}
+
+static int compare_entries(const Entry &a, const Entry &b)
+{
+    // NOTE: Nulls are sorted first
+    if (a.is_null() || b.is_null())
+        return (int)b.is_null() - (int)a.is_null();
+
+    auto compare = [](auto x, auto y) { return x < y ? -1 : (x > y ? 1 : 0); };
+    switch (a.data_type().primitive())
+    {
+        case DataType::Integer: return compare(a.as_int(), b.as_int());
+        case DataType::BigInt: return compare(a.as_long(), b.as_long());
+        case DataType::Float: return compare(a.as_float(), b.as_float());
+        case DataType::Char:
+        case DataType::Text:
+            return compare(a.as_string(), b.as_string());
+        default:
+            assert (false);
+            return 0;
+    }
+}
+
+bool Sorter::less_than(const Row &a, const Row &b) const
+{
+    for (const auto &key : m_keys)
+    {
+        auto result = compare_entries(*a[key.column], *b[key.column]);
+        if (result != 0)
+            return key.descending ? result > 0 : result < 0;
+    }
+
+    return false;
+}
+
+void Sorter::add(Row row)
+{
+    auto compare = [&](const Row &a, const Row &b) { return less_than(a, b); };
+    if (m_use_heap)
+    {
+        // Max heap of the best rows seen so far, the worst one on top
+        if (m_rows.size() < *m_limit)
+        {
+            m_rows.push_back(std::move(row));
+            std::push_heap(m_rows.begin(), m_rows.end(), compare);
+        }
+        else if (*m_limit > 0 && less_than(row, m_rows.front()))
+        {
+            std::pop_heap(m_rows.begin(), m_rows.end(), compare);
+            m_rows.back() = std::move(row);
+            std::push_heap(m_rows.begin(), m_rows.end(), compare);
+        }
+        return;
+    }
+
+    m_rows.push_back(std::move(row));
+    if (m_rows.size() * m_bytes_per_row > m_memory_budget)
+        spill_run();
+}
+
+void Sorter::spill_run()
+{
+    auto compare = [&](const Row &a, const Row &b) { return less_than(a, b); };
+    std::stable_sort(m_rows.begin(), m_rows.end(), compare);
+
+    SpillFile run(m_columns);
+    for (const auto &row : m_rows)
+        run.write(row);
+    run.rewind();
+
+    m_spilled_in_bytes += run.size_in_bytes();
+    m_runs.push_back(std::move(run));
+    m_spilled_run_count += 1;
+    m_rows.clear();
+}
+
+void Sorter::finish(std::function<void(Row)> callback)
+{
+    auto compare = [&](const Row &a, const Row &b) { return less_than(a, b); };
+    auto limit = m_limit.value_or(SIZE_MAX);
+
+    if (m_use_heap)
+    {
+        std::sort_heap(m_rows.begin(), m_rows.end(), compare);
+        for (auto &row : m_rows)
+            callback(std::move(row));
+        m_rows.clear();
+        return;
+    }
+
+    // Everything fit in memory
+    if (m_runs.empty())
+    {
+        std::stable_sort(m_rows.begin(), m_rows.end(), compare);
+        for (size_t i = 0; i < m_rows.size() && i < limit; i++)
+            callback(std::move(m_rows[i]));
+        m_rows.clear();
+        return;
+    }
+
+    if (!m_rows.empty())
+        spill_run();
+
+    // Merge the sorted runs, taking the smallest head each time. Ties
+    // go to the earliest run, so rows keep their original order.
+    struct Head
+    {
+        Row row;
+        size_t run;
+    };
+
+    auto head_compare = [&](const Head &a, const Head &b)
+    {
+        if (less_than(b.row, a.row))
+            return true;
+        if (less_than(a.row, b.row))
+            return false;
+        return a.run > b.run;
+    };
+
+    std::vector<Head> heads;
+    for (size_t i = 0; i < m_runs.size(); i++)
+    {
+        auto row = m_runs[i].read();
+        if (row)
+            heads.push_back({ std::move(*row), i });
+    }
+    std::make_heap(heads.begin(), heads.end(), head_compare);
+
+    size_t emitted = 0;
+    while (!heads.empty() && emitted < limit)
+    {
+        std::pop_heap(heads.begin(), heads.end(), head_compare);
+        auto head = std::move(heads.back());
+        heads.pop_back();
+
+        auto next = m_runs[head.run].read();
+        if (next)
+        {
+            heads.push_back({ std::move(*next), head.run });
+            std::push_heap(heads.begin(), heads.end(), head_compare);
+        }
+
+        callback(std::move(head.row));
+        emitted += 1;
+    }
+
+    m_runs.clear();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "../forward.hpp"
+#include "../row.hpp"
+#include "spillfile.hpp"
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace DB::Sql
+{
+
+    // Sorts rows within a memory budget. Rows are sorted in memory until the
+    // budget runs out, then sorted runs are spilled to disk and merged back
+    // together at the end. With a limit, only the best rows are kept in a heap.
+    class Sorter
+    {
+    public:
+        struct Key
+        {
+            std::string column;
+            bool descending;
+        };
+
+        Sorter(const std::vector<Column> &columns, std::vector<Key> keys,
+            std::optional<size_t> limit, size_t memory_budget);
+
+        void add(Row);
+        void finish(std::function<void(Row)> callback);
+
+        inline size_t run_count() const { return m_runs.size(); }
+        inline size_t spilled_run_count() const { return m_spilled_run_count; }
+        inline size_t spilled_in_bytes() const { return m_spilled_in_bytes; }
+        inline bool uses_heap() const { return m_use_heap; }
+
+    private:
+        bool less_than(const Row &a, const Row &b) const;
+        void spill_run();
+
+        std::vector<Column> m_columns;
+        std::vector<Key> m_keys;
+        std::optional<size_t> m_limit;
+        size_t m_memory_budget;
+        size_t m_bytes_per_row;
+        bool m_use_heap { false };
+
+        std::vector<Row> m_rows;
+        std::vector<SpillFile> m_runs;
+        size_t m_spilled_run_count { 0 };
+        size_t m_spilled_in_bytes { 0 };
+
+    };
+
+}
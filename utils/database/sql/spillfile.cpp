@@ -0,0 +1,158 @@
+#include "spillfile.hpp"
+#include "../entry.hpp"
+#include "../row.hpp"
+#include <cassert>
+#include <cstring>
+using namespace DB;
+using namespace DB::Sql;
+
+SpillFile::SpillFile(const std::vector<Column> &columns)
+    : m_columns(columns)
+{
+    m_file = tmpfile();
+    if (!m_file)
+        perror("tmpfile()");
+    assert (m_file);
+}
+
+SpillFile::SpillFile(SpillFile &&other)
+    : m_columns(std::move(other.m_columns))
+    , m_file(other.m_file)
+    , m_size_in_bytes(other.m_size_in_bytes)
+{
+    other.m_file = nullptr;
+}
+
+SpillFile::~SpillFile()
+{
+    if (m_file)
+        fclose(m_file);
+}
+
+void SpillFile::write(const Row &row, std::string_view key)
+{
+    auto write_bytes = [&](const void *data, size_t size)
+    {
+        fwrite(data, 1, size, m_file);
+        m_size_in_bytes += size;
+    };
+
+    uint32_t key_length = key.size();
+    write_bytes(&key_length, sizeof(key_length));
+    write_bytes(key.data(), key.size());
+
+    for (const auto &it : row)
+    {
+        const auto *entry = it.second;
+        uint8_t is_null = entry->is_null();
+        write_bytes(&is_null, 1);
+        if (is_null)
+            continue;
+
+        switch (entry->data_type().primitive())
+        {
+            case DataType::Integer:
+            {
+                auto i = entry->as_int();
+                write_bytes(&i, sizeof(i));
+                break;
+            }
+            case DataType::BigInt:
+            {
+                auto l = entry->as_long();
+                write_bytes(&l, sizeof(l));
+                break;
+            }
+            case DataType::Float:
+            {
+                auto f = entry->as_float();
+                write_bytes(&f, sizeof(f));
+                break;
+            }
+            case DataType::Char:
+            case DataType::Text:
+            {
+                auto str = entry->as_string();
+                uint32_t length = str.size();
+                write_bytes(&length, sizeof(length));
+                write_bytes(str.data(), str.size());
+                break;
+            }
+            default:
+                assert (false);
+        }
+    }
+}
+
+void SpillFile::rewind()
+{
+    fflush(m_file);
+    ::rewind(m_file);
+}
+
+std::optional<Row> SpillFile::read(std::string *key)
+{
+    auto read_bytes = [&](void *data, size_t size)
+    {
+        return fread(data, 1, size, m_file) == size;
+    };
+
+    uint32_t key_length;
+    if (!read_bytes(&key_length, sizeof(key_length)))
+        return std::nullopt;
+
+    std::string key_buffer(key_length, '\0');
+    read_bytes(key_buffer.data(), key_length);
+    if (key)
+        *key = std::move(key_buffer);
+
+    Row row(m_columns);
+    for (auto &entity : row.m_entities)
+    {
+        uint8_t is_null;
+        read_bytes(&is_null, 1);
+        if (is_null)
+            continue;
+
+        auto &entry = entity.entry;
+        switch (entry->data_type().primitive())
+        {
+            case DataType::Integer:
+            {
+                int i;
+                read_bytes(&i, sizeof(i));
+                entry->set(std::make_unique<IntegerEntry>(i));
+                break;
+            }
+            case DataType::BigInt:
+            {
+                int64_t l;
+                read_bytes(&l, sizeof(l));
+                entry->set(std::make_unique<BigIntEntry>(l));
+                break;
+            }
+            case DataType::Float:
+            {
+                float f;
+                read_bytes(&f, sizeof(f));
+                entry->set(std::make_unique<FloatEntry>(f));
+                break;
+            }
+            case DataType::Char:
+            case DataType::Text:
+            {
+                uint32_t length;
+                read_bytes(&length, sizeof(length));
+
+                std::string str(length, '\0');
+                read_bytes(str.data(), length);
+                entry->set(std::make_unique<CharEntry>(str));
+                break;
+            }
+            default:
+                assert (false);
+        }
+    }
+
+    return row;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "../forward.hpp"
+#include "../column.hpp"
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace DB::Sql
+{
+
+    // A temporary file rows can be written out to when
+    // an operation runs out of memory, then read back in order
+    class SpillFile
+    {
+    public:
+        SpillFile(const std::vector<Column> &columns);
+        SpillFile(const SpillFile&) = delete;
+        SpillFile(SpillFile&&);
+        ~SpillFile();
+
+        // Each row can be tagged with a key, which is read back along with it
+        void write(const Row&, std::string_view key = {});
+        void rewind();
+        std::optional<Row> read(std::string *key = nullptr);
+
+        inline size_t size_in_bytes() const { return m_size_in_bytes; }
+
+    private:
+        std::vector<Column> m_columns;
+        FILE *m_file;
+        size_t m_size_in_bytes { 0 };
+
+    };
+
+}
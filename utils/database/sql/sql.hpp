@@ -16,14 +16,23 @@ namespace DB
         friend Sql::InsertStatement;
         friend Sql::CreateTableStatement;
         friend Sql::CreateTableIfNotExistsStatement;
+        friend Sql::CreateIndexStatement;
         friend Sql::UpdateStatement;
         friend Sql::DeleteStatement;
+        friend Sql::ExplainStatement;
+        friend Sql::AnalyzeStatement;
+        friend Sql::QueryPlan;
+        friend DataBase;
 
     public:
         const auto begin() const { return m_rows.begin(); }
         const auto end() const { return m_rows.end(); }
         
         bool good() { return m_errors.size() == 0; }
+        const std::vector<std::string> &errors() const { return m_errors; }
+
+        // Encode as a compact binary buffer, which can be read with ResultView
+        std::string encode() const;
         void output_errors(std::ostream &out = std::cerr)
         {
             for (const auto &error : m_errors)
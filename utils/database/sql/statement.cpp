@@ -0,0 +1,58 @@
+#include "statement.hpp"
+#include "queryplan.hpp"
+#include "../database.hpp"
+using namespace DB;
+using namespace DB::Sql;
+
+static std::string type_name(Statement::Type type)
+{
+    switch (type)
+    {
+        case Statement::Select: return "Select";
+        case Statement::Insert: return "Insert";
+        case Statement::CreateTable: return "Create table";
+        case Statement::CreateTableIfNotExists: return "Create table if not exists";
+        case Statement::CreateIndex: return "Create index";
+        case Statement::Update: return "Update";
+        case Statement::Delete: return "Delete";
+        case Statement::Explain: return "Explain";
+        case Statement::Analyze: return "Analyze";
+    }
+
+    return "";
+}
+
+SqlResult Statement::explain(DataBase &db, QueryPlan &plan, bool analyze) const
+{
+    // NOTE: By default, a statement is a single step
+    auto &op = plan.add(type_name(type()));
+    if (!analyze)
+        return SqlResult::ok();
+
+    auto io_stats_before = db.io_stats();
+    auto result = [&]()
+    {
+        QueryPlan::Timer timer(&op, "Statement::execute");
+        return execute(db);
+    }();
+
+    op.rows_out = std::distance(result.begin(), result.end());
+    op.bytes_read = db.io_stats().bytes_read - io_stats_before.bytes_read;
+    op.io_calls = (db.io_stats().reads + db.io_stats().writes)
+        - (io_stats_before.reads + io_stats_before.writes);
+    return result;
+}
+
+SqlResult Statement::bind(const std::vector<Value> &parameters)
+{
+    if (parameters.size() != m_parameters.size())
+    {
+        return SqlResult::error("Expected " + std::to_string(m_parameters.size()) +
+            " parameters, got " + std::to_string(parameters.size()));
+    }
+
+    for (size_t i = 0; i < parameters.size(); i++)
+        m_parameters[i]->bind(parameters[i]);
+
+    return SqlResult::ok();
+}
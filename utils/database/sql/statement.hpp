@@ -1,12 +1,15 @@
 #pragma once
 #include "../forward.hpp"
 #include "sql.hpp"
+#include <vector>
 
 namespace DB::Sql
 {
 
     class Statement
     {
+        friend Parser;
+
     public:
         virtual ~Statement() {}
 
@@ -16,13 +19,24 @@ namespace DB::Sql
             Insert,
             CreateTable,
             CreateTableIfNotExists,
+            CreateIndex,
             Update,
             Delete,
+            Explain,
+            Analyze,
         };
 
         virtual SqlResult execute(DataBase&) const = 0;
+
+        // Fill in the steps taken to run this statement. When analysing,
+        // the statement is run and the counters of each step are filled in
+        virtual SqlResult explain(DataBase&, QueryPlan&, bool analyze) const;
         inline Type type() const { return m_type; }
 
+        // Set the values of the statement's '?' parameters, in order
+        SqlResult bind(const std::vector<Value> &parameters);
+        inline size_t parameter_count() const { return m_parameters.size(); }
+
     protected:
         Statement(Type type)
             : m_type(type) {}
@@ -30,6 +44,9 @@ namespace DB::Sql
     private:
         Type m_type;
 
+        // NOTE: Owned by the statement's tree of values
+        std::vector<ValueNode*> m_parameters;
+
     };
 
 }
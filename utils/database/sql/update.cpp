@@ -1,7 +1,9 @@
 #include "update.hpp"
 #include "value.hpp"
 #include "../database.hpp"
+#include <algorithm>
 #include <cassert>
+#include <optional>
 using namespace DB;
 using namespace DB::Sql;
 
@@ -10,29 +12,90 @@ SqlResult UpdateStatement::execute(DataBase &db) const
     auto table = db.get_table(m_table);
     if (!table)
         return SqlResult::error("No table the the name '" + m_table + "' found");
+    if (table->partitioning())
+        return SqlResult::error("'" + m_table + "' is append only");
 
+    const auto &columns = table->columns();
+    std::vector<DataType> data_types;
+    for (const auto &column : m_columns)
+    {
+        auto it = std::find_if(columns.begin(), columns.end(),
+            [&](const auto &other) { return other.name() == column.column; });
+        if (it == columns.end())
+            return SqlResult::error("No column with the name '" + column.column + "' found");
+        if (auto unknown = column.value->unknown_column(columns))
+            return SqlResult::error("No column with the name '" + *unknown + "' found");
+        data_types.push_back(it->data_type());
+
+        // NOTE: Only a bound parameter can be null here
+        const auto *literal = column.value->literal();
+        if (literal && literal->type() == Value::Null)
+            return SqlResult::error("Can't set '" + column.column + "' to null");
+    }
+    if (m_where)
+    {
+        if (auto unknown = m_where->unknown_column(columns))
+            return SqlResult::error("No column with the name '" + *unknown + "' found");
+    }
+
+    // NOTE: An assignment could still come out as null, or as a value that doesn't
+    //       fit its column, in which case the row is left as it was
+    std::optional<std::string> error;
     auto execute_assignments_on_row = [&](size_t index, Row &row)
     {
-        for (const auto &column : m_columns)
-            row[column.column]->set(column.value->evaluate(row).as_entry());
+        std::vector<Value> values;
+        for (size_t i = 0; i < m_columns.size(); i++)
+        {
+            const auto &column = m_columns[i];
+            values.push_back(column.value->evaluate(row));
+            if (values.back().is_null())
+            {
+                error = "Can't set '" + column.column + "' to null";
+                return;
+            }
+            if (!values.back().fits(data_types[i]))
+            {
+                error = "Value given for '" + column.column + "' doesn't fit its type";
+                return;
+            }
+        }
 
+        for (size_t i = 0; i < m_columns.size(); i++)
+            row[m_columns[i].column]->set(values[i].as_entry());
         table->update_row(index, std::move(row));
     };
 
-    for (size_t i = 0; i < table->row_count(); i++)
+    if (m_where)
+        m_where->order_by_selectivity(table->stats());
+
+    auto row_chunks = table->row_chunks();
+    for (size_t chunk_index = 0; chunk_index < row_chunks.size(); chunk_index++)
     {
-        auto row = table->get_row(i);
-        assert (row);
+        const auto &row_chunk = row_chunks[chunk_index];
+        auto &chunk = *row_chunk.chunk;
+        const auto *zone_map = table->find_zone_map(chunk);
+        if (m_where && zone_map && m_where->can_skip(*zone_map))
+            continue;
+
+        table->read_ahead(row_chunks, chunk_index);
 
-        if (!m_where)
+        for (size_t i = 0; i < row_chunk.row_count; i++)
         {
-            execute_assignments_on_row(i, *row);
-            continue;
-        }
+            auto row = table->read_row(chunk, i);
+            if (!m_where)
+            {
+                execute_assignments_on_row(row_chunk.first_row + i, row);
+                if (error)
+                    return SqlResult::error(*error);
+                continue;
+            }
 
-        auto result = m_where->evaluate(*row);
-        if (result.as_bool())
-            execute_assignments_on_row(i, *row);
+            auto result = m_where->evaluate(row);
+            if (result.is_true())
+                execute_assignments_on_row(row_chunk.first_row + i, row);
+            if (error)
+                return SqlResult::error(*error);
+        }
     }
 
     return SqlResult::ok();
@@ -1,9 +1,14 @@
 #include "value.hpp"
 #include "../entry.hpp"
 #include "../row.hpp"
+#include "../zonemap.hpp"
+#include "../stats.hpp"
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <functional>
+#include <optional>
 using namespace DB;
 using namespace DB::Sql;
 
@@ -14,110 +19,884 @@ std::unique_ptr<Entry> Value::as_entry() const
         case Integer: return std::make_unique<BigIntEntry>(m_int);
         case Float: return std::make_unique<FloatEntry>(m_float);
         case String: return std::make_unique<CharEntry>(m_str);
+        case Boolean: return std::make_unique<BigIntEntry>(m_bool ? 1 : 0);
         default:
             assert (false);
     }
 }
 
-static Value get_entry_value(const std::unique_ptr<Entry> &entry)
+bool Value::fits(const DataType &data_type) const
 {
-    switch (entry->data_type().primitive())
+    switch (data_type.primitive())
     {
-        case DataType::Integer: return Value((int64_t)entry->as_int());
-        case DataType::BigInt: return Value(entry->as_long());
-        case DataType::Float: return Value(entry->as_float());
-        case DataType::Char: return Value(entry->as_string());
-        case DataType::Text: return Value(entry->as_string());
+        case DataType::Integer:
+        case DataType::BigInt:
+        case DataType::Float:
+            return m_type == Integer || m_type == Float || m_type == Boolean;
+        case DataType::Char:
+            return m_type == String && m_str.size() <= data_type.length();
+        case DataType::Text:
+            return m_type == String;
+        default:
+            return false;
+    }
+}
+
+Value Value::from_entry(const Entry &entry)
+{
+    switch (entry.data_type().primitive())
+    {
+        case DataType::Integer: return Value((int64_t)entry.as_int());
+        case DataType::BigInt: return Value(entry.as_long());
+        case DataType::Float: return Value(entry.as_float());
+        case DataType::Char: return Value(entry.as_string());
+        case DataType::Text: return Value(entry.as_string());
         default:
             assert (false);
     }
 }
 
-template <typename Callback>
-static Value operation(const Value &lhs, const Value &rhs, Callback callback)
+std::string Value::as_key() const
 {
-    switch (lhs.type())
+    auto append = [](std::string &key, const auto &value)
     {
-        case Value::Type::Integer:
-            switch (rhs.type())
-            {
-                case Value::Type::Integer:
-                    return Value(callback(lhs.as_int(), rhs.as_int()));
-                case Value::Type::Float:
-                    return Value(callback(lhs.as_int(), rhs.as_float()));
-                default:
-                    assert (false);
-            }
+        key.append((const char*)&value, sizeof(value));
+    };
+
+    std::string key;
+    switch (m_type)
+    {
+        case Integer:
+            key += 'i';
+            append(key, m_int);
             break;
-        case Value::Type::Float:
-            switch (rhs.type())
+        case Float:
+            // NOTE: Whole floats have to match the same integer
+            if (m_float == (float)(int64_t)m_float)
             {
-                case Value::Type::Integer:
-                    return Value(callback(lhs.as_float(), rhs.as_int()));
-                case Value::Type::Float:
-                    return Value(callback(lhs.as_float(), rhs.as_float()));
-                default:
-                    assert (false);
+                key += 'i';
+                append(key, (int64_t)m_float);
+                break;
             }
+            key += 'f';
+            append(key, m_float);
             break;
-        case Value::Type::String:
-            switch (rhs.type())
-            {
-                case Value::Type::String:
-                    return Value(callback(lhs.as_string(), rhs.as_string()));
-                default:
-                    assert (false);
-            }
+        case Boolean:
+            key += 'b';
+            key += m_bool ? '\1' : '\0';
+            break;
+        case String:
+            key += 's';
+            key += m_str;
+            break;
+        case Null:
+            key += 'n';
+            break;
+    }
+
+    return key;
+}
+
+static bool is_number(const Value &value)
+{
+    return value.type() == Value::Integer || value.type() == Value::Float;
+}
+
+static double as_number(const Value &value)
+{
+    return value.type() == Value::Float ? (double)value.as_float() : (double)value.as_int();
+}
+
+// Order two values, returns less than 0 if the left one is smaller, 0 if they're
+// equal and more than 0 if it's larger. There's no order if either is null or
+// they're of incompatible types.
+static std::optional<int> compare(const Value &lhs, const Value &rhs)
+{
+    auto three_way = [](const auto &a, const auto &b)
+    {
+        return a < b ? -1 : (b < a ? 1 : 0);
+    };
+
+    if (lhs.type() == Value::Integer && rhs.type() == Value::Integer)
+        return three_way(lhs.as_int(), rhs.as_int());
+    if (is_number(lhs) && is_number(rhs))
+        return three_way(as_number(lhs), as_number(rhs));
+    if (lhs.type() == Value::String && rhs.type() == Value::String)
+        return lhs.as_string().compare(rhs.as_string());
+    if (lhs.type() == Value::Boolean && rhs.type() == Value::Boolean)
+        return three_way(lhs.as_bool(), rhs.as_bool());
+
+    return std::nullopt;
+}
+
+static Value arithmetic(ValueNode::Type operation, const Value &lhs, const Value &rhs)
+{
+    if (!is_number(lhs) || !is_number(rhs))
+        return Value();
+
+    auto apply = [&](auto a, auto b) -> Value
+    {
+        using T = decltype(a);
+        switch (operation)
+        {
+            case ValueNode::Type::Add: return Value(T(a + b));
+            case ValueNode::Type::Subtract: return Value(T(a - b));
+            case ValueNode::Type::Multiply: return Value(T(a * b));
+            case ValueNode::Type::Divide: return b == 0 ? Value() : Value(T(a / b));
+            default:
+                assert (false);
+                return Value();
+        }
+    };
+
+    if (lhs.type() == Value::Integer && rhs.type() == Value::Integer)
+        return apply(lhs.as_int(), rhs.as_int());
+    return apply((float)as_number(lhs), (float)as_number(rhs));
+}
+
+// SQL 'LIKE', where '%' matches any run of characters and '_' any one character
+static bool like(std::string_view text, std::string_view pattern)
+{
+    size_t t = 0;
+    size_t p = 0;
+
+    // Where to carry on from if the text after the last '%' doesn't match
+    auto wildcard = std::string_view::npos;
+    size_t wildcard_text = 0;
+
+    while (t < text.size())
+    {
+        if (p < pattern.size() && pattern[p] == '%')
+        {
+            wildcard = p++;
+            wildcard_text = t;
+        }
+        else if (p < pattern.size() && (pattern[p] == '_' || pattern[p] == text[t]))
+        {
+            p += 1;
+            t += 1;
+        }
+        else if (wildcard != std::string_view::npos)
+        {
+            p = wildcard + 1;
+            t = ++wildcard_text;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '%')
+        p += 1;
+    return p == pattern.size();
+}
+
+// Conditions are true, false or unknown, which is null
+static std::optional<bool> truth(const Value &value)
+{
+    if (value.type() != Value::Boolean)
+        return std::nullopt;
+    return value.as_bool();
+}
+
+static Value logical_and(std::optional<bool> left, std::optional<bool> right)
+{
+    if (left == false || right == false)
+        return Value(false);
+    if (!left || !right)
+        return Value();
+    return Value(true);
+}
+
+static Value logical_or(std::optional<bool> left, std::optional<bool> right)
+{
+    if (left == true || right == true)
+        return Value(true);
+    if (!left || !right)
+        return Value();
+    return Value(false);
+}
+
+// The same comparison with its operands swapped, so 'a < b' becomes 'b > a'
+static ValueNode::Type flip(ValueNode::Type type)
+{
+    switch (type)
+    {
+        case ValueNode::Type::MoreThan: return ValueNode::Type::LessThan;
+        case ValueNode::Type::MoreThanOrEqual: return ValueNode::Type::LessThanOrEqual;
+        case ValueNode::Type::LessThan: return ValueNode::Type::MoreThan;
+        case ValueNode::Type::LessThanOrEqual: return ValueNode::Type::MoreThanOrEqual;
+        default: return type;
+    }
+}
+
+static Value apply_comparison(ValueNode::Type type, const Value &lhs, const Value &rhs)
+{
+    auto order = compare(lhs, rhs);
+    if (!order)
+        return Value();
+
+    switch (type)
+    {
+        case ValueNode::Type::MoreThan: return Value(*order > 0);
+        case ValueNode::Type::MoreThanOrEqual: return Value(*order >= 0);
+        case ValueNode::Type::LessThan: return Value(*order < 0);
+        case ValueNode::Type::LessThanOrEqual: return Value(*order <= 0);
+        case ValueNode::Type::Equals: return Value(*order == 0);
+        case ValueNode::Type::NotEquals: return Value(*order != 0);
         default:
             assert (false);
-            break;
+            return Value();
     }
 }
 
 Value ValueNode::evaluate(const Row &row)
+{
+    return evaluate(&row);
+}
+
+Value ValueNode::evaluate(const Row *row)
 {
     switch (m_type)
     {
         case Type::Value:
+        case Type::Parameter:
             assert (!m_left);
             assert (!m_right);
             return m_value;
         
         case Type::Column:
+        {
             assert (m_left);
             assert (!m_right);
-            return get_entry_value(row[m_left->evaluate(row).as_string()]);
+            assert (row);
+            const auto &entry = (*row)[m_left->m_value.as_string()];
+            if (!entry || entry->is_null())
+                return Value();
+            return Value::from_entry(*entry);
+        }
         
         case Type::MoreThan:
+        case Type::MoreThanOrEqual:
+        case Type::LessThan:
+        case Type::LessThanOrEqual:
+        case Type::Equals:
+        case Type::NotEquals:
             assert (m_left);
             assert (m_right);
-            return operation(
-                m_left->evaluate(row), m_right->evaluate(row), 
-                [&](auto a, auto b) { return a > b; });
-        
-        case Type::Equals:
+            return apply_comparison(m_type, m_left->evaluate(row), m_right->evaluate(row));
+
+        case Type::Like:
+        {
             assert (m_left);
             assert (m_right);
-            return operation(
-                m_left->evaluate(row), m_right->evaluate(row), 
-                [&](auto a, auto b) { return a == b; });
+            auto text = m_left->evaluate(row);
+            auto pattern = m_right->evaluate(row);
+            if (text.type() != Value::String || pattern.type() != Value::String)
+                return Value();
+            return Value(like(text.as_string(), pattern.as_string()));
+        }
+
+        case Type::In:
+        {
+            assert (m_left);
+            auto value = m_left->evaluate(row);
+            if (value.is_null())
+                return Value();
+
+            // NOTE: Not being in a list with a null in it is unknown
+            bool has_null = false;
+            for (const auto &item : m_list)
+            {
+                auto item_value = item->evaluate(row);
+                has_null |= item_value.is_null();
+                if (compare(value, item_value) == 0)
+                    return Value(true);
+            }
+
+            return has_null ? Value() : Value(false);
+        }
+
+        case Type::Between:
+        {
+            assert (m_left);
+            assert (m_list.size() == 2);
+            auto value = m_left->evaluate(row);
+            auto low = apply_comparison(Type::MoreThanOrEqual, value, m_list[0]->evaluate(row));
+            if (low.type() == Value::Boolean && !low.as_bool())
+                return Value(false);
+
+            auto high = apply_comparison(Type::LessThanOrEqual, value, m_list[1]->evaluate(row));
+            return logical_and(truth(low), truth(high));
+        }
+
+        case Type::IsNull:
+            assert (m_left);
+            return Value(m_left->evaluate(row).is_null());
 
         case Type::And:
         {
             assert (m_left);
             assert (m_right);
-            auto left = m_left->evaluate(row);
-            if (left.type() != Value::Boolean || left.as_bool() == false)
+            auto left = truth(m_left->evaluate(row));
+            if (left == false)
                 return Value(false);
 
-            auto right = m_right->evaluate(row);
-            if (right.type() != Value::Boolean || right.as_bool() == false)
-                return Value(false);
+            return logical_and(left, truth(m_right->evaluate(row)));
+        }
+
+        case Type::Or:
+        {
+            assert (m_left);
+            assert (m_right);
+            auto left = truth(m_left->evaluate(row));
+            if (left == true)
+                return Value(true);
 
-            return Value(true);
+            return logical_or(left, truth(m_right->evaluate(row)));
         }
 
+        case Type::Not:
+        {
+            assert (m_left);
+            auto operand = truth(m_left->evaluate(row));
+            return operand ? Value(!*operand) : Value();
+        }
+
+        case Type::Add:
+        case Type::Subtract:
+        case Type::Multiply:
+        case Type::Divide:
+            assert (m_left);
+            assert (m_right);
+            return arithmetic(m_type, m_left->evaluate(row), m_right->evaluate(row));
+    }
+
+    assert (false);
+    return Value();
+}
+
+void ValueNode::fold_constants(std::unique_ptr<ValueNode> &node)
+{
+    if (!node)
+        return;
+
+    switch (node->m_type)
+    {
+        case Type::Value:
+        case Type::Parameter:
+        case Type::Column:
+            return;
         default:
-            assert (false);
+            break;
     }
+
+    fold_constants(node->m_left);
+    fold_constants(node->m_right);
+    for (auto &item : node->m_list)
+        fold_constants(item);
+
+    auto is_constant = [](const std::unique_ptr<ValueNode> &operand)
+    {
+        return !operand || operand->m_type == Type::Value;
+    };
+
+    // A literal either decides an 'AND' or 'OR', or can be left out of it
+    if (node->m_type == Type::And || node->m_type == Type::Or)
+    {
+        auto decides = node->m_type == Type::Or;
+        for (auto *operand : { &node->m_left, &node->m_right })
+        {
+            if (!is_constant(*operand))
+                continue;
+
+            auto value = truth((*operand)->m_value);
+            if (!value)
+                continue;
+
+            // NOTE: The other operand is moved, not copied, as
+            //       it may have parameters pointing into it
+            auto &other = operand == &node->m_left ? node->m_right : node->m_left;
+            if (*value == decides)
+            {
+                // The statement still expects values for any parameters it has
+                if (!other->has_parameters())
+                    node = std::make_unique<ValueNode>(Value(decides));
+                return;
+            }
+
+            auto kept = std::move(other);
+            node = std::move(kept);
+            return;
+        }
+    }
+
+    if (!is_constant(node->m_left) || !is_constant(node->m_right))
+        return;
+    for (const auto &item : node->m_list)
+    {
+        if (!is_constant(item))
+            return;
+    }
+
+    node = std::make_unique<ValueNode>(node->evaluate(nullptr));
+}
+
+std::optional<std::string> ValueNode::unknown_column(const std::vector<Column> &columns) const
+{
+    if (m_type == Type::Column)
+    {
+        const auto &name = m_left->m_value.as_string();
+        auto found = std::any_of(columns.begin(), columns.end(),
+            [&](const auto &column) { return column.has_name(name); });
+        if (!found)
+            return name;
+        return std::nullopt;
+    }
+
+    if (auto name = m_left ? m_left->unknown_column(columns) : std::nullopt)
+        return name;
+    if (auto name = m_right ? m_right->unknown_column(columns) : std::nullopt)
+        return name;
+    for (const auto &item : m_list)
+    {
+        if (auto name = item->unknown_column(columns))
+            return name;
+    }
+
+    return std::nullopt;
+}
+
+bool ValueNode::has_parameters() const
+{
+    if (m_type == Type::Parameter)
+        return true;
+    if ((m_left && m_left->has_parameters()) || (m_right && m_right->has_parameters()))
+        return true;
+
+    return std::any_of(m_list.begin(), m_list.end(),
+        [](const auto &item) { return item->has_parameters(); });
+}
+
+void ValueNode::order_by_selectivity(const TableStats *stats)
+{
+    if (m_type != Type::And && m_type != Type::Or)
+    {
+        if (m_left)
+            m_left->order_by_selectivity(stats);
+        if (m_right)
+            m_right->order_by_selectivity(stats);
+        for (auto &item : m_list)
+            item->order_by_selectivity(stats);
+        return;
+    }
+
+    // Take the operands of the whole chain, such as 'a AND b AND c'
+    std::vector<std::unique_ptr<ValueNode>> operands;
+    std::function<void(std::unique_ptr<ValueNode>)> collect = [&](std::unique_ptr<ValueNode> node)
+    {
+        if (node->m_type != m_type)
+        {
+            node->order_by_selectivity(stats);
+            operands.push_back(std::move(node));
+            return;
+        }
+
+        collect(std::move(node->m_left));
+        collect(std::move(node->m_right));
+    };
+    collect(std::move(m_left));
+    collect(std::move(m_right));
+
+    // NOTE: An 'AND' is decided by an operand that's false,
+    //       and an 'OR' by one that's true
+    std::vector<std::pair<double, std::unique_ptr<ValueNode>>> ranked;
+    for (auto &operand : operands)
+    {
+        auto selectivity = operand->estimate_selectivity(stats);
+        ranked.emplace_back(m_type == Type::And ? selectivity : -selectivity, std::move(operand));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b)
+    {
+        return a.first < b.first;
+    });
+
+    // Rebuild the chain, evaluated from left to right
+    auto chain = std::move(ranked.front().second);
+    for (size_t i = 1; i < ranked.size() - 1; i++)
+        chain = std::make_unique<ValueNode>(std::move(chain), m_type, std::move(ranked[i].second));
+
+    m_left = std::move(chain);
+    m_right = std::move(ranked.back().second);
+}
+
+bool ValueNode::can_skip(const ZoneMap &zone_map) const
+{
+    // Compare a literal to a column's range, returns -1 if the literal is
+    // below the bound, 1 if it's above it and 0 if it's equal to it
+    auto compare = [&](const ZoneMap::Range &range, const Value &value, bool against_max) -> int
+    {
+        if (range.is_float || value.type() == Value::Float)
+        {
+            auto literal = as_number(value);
+            auto bound = range.is_float
+                ? (against_max ? range.max_float : range.min_float)
+                : (double)(against_max ? range.max_int : range.min_int);
+            return literal < bound ? -1 : (literal > bound ? 1 : 0);
+        }
+
+        auto literal = value.as_int();
+        auto bound = against_max ? range.max_int : range.min_int;
+        return literal < bound ? -1 : (literal > bound ? 1 : 0);
+    };
+
+    auto column_range = [&](const ValueNode &column) -> const ZoneMap::Range*
+    {
+        if (column.m_type != Type::Column)
+            return nullptr;
+        return zone_map.range(column.m_left->m_value.as_string());
+    };
+
+    auto number_literal = [](const ValueNode &literal) -> const Value*
+    {
+        if (!literal.is_literal() || !is_number(literal.m_value))
+            return nullptr;
+        return &literal.m_value;
+    };
+
+    // True if no value in the range is between the two literals
+    auto is_outside = [&](const ZoneMap::Range &range, const Value &low, const Value &high)
+    {
+        return compare(range, high, false) < 0 || compare(range, low, true) > 0;
+    };
+
+    // NOTE: Null never compares true, so a range with no values can always be skipped
+    switch (m_type)
+    {
+        // A condition folded down to false or null
+        case Type::Value:
+            return !m_value.is_true();
+
+        case Type::And:
+            return m_left->can_skip(zone_map) || m_right->can_skip(zone_map);
+
+        case Type::Or:
+            return m_left->can_skip(zone_map) && m_right->can_skip(zone_map);
+
+        case Type::MoreThan:
+        case Type::MoreThanOrEqual:
+        case Type::LessThan:
+        case Type::LessThanOrEqual:
+        case Type::Equals:
+        {
+            // Normalise to 'column <op> literal'
+            auto type = m_type;
+            const auto *range = column_range(*m_left);
+            const auto *literal = number_literal(*m_right);
+            if (!range || !literal)
+            {
+                type = flip(m_type);
+                range = column_range(*m_right);
+                literal = number_literal(*m_left);
+            }
+            if (!range || !literal)
+                return false;
+            if (!range->has_values)
+                return true;
+
+            switch (type)
+            {
+                case Type::MoreThan: return compare(*range, *literal, true) >= 0;
+                case Type::MoreThanOrEqual: return compare(*range, *literal, true) > 0;
+                case Type::LessThan: return compare(*range, *literal, false) <= 0;
+                case Type::LessThanOrEqual: return compare(*range, *literal, false) < 0;
+                case Type::Equals: return is_outside(*range, *literal, *literal);
+                default: return false;
+            }
+        }
+
+        case Type::Between:
+        {
+            const auto *range = column_range(*m_left);
+            const auto *low = number_literal(*m_list[0]);
+            const auto *high = number_literal(*m_list[1]);
+            if (!range || !low || !high)
+                return false;
+            return !range->has_values || is_outside(*range, *low, *high);
+        }
+
+        case Type::In:
+        {
+            const auto *range = column_range(*m_left);
+            if (!range)
+                return false;
+            if (!range->has_values)
+                return true;
+
+            for (const auto &item : m_list)
+            {
+                const auto *literal = number_literal(*item);
+                if (!literal || !is_outside(*range, *literal, *literal))
+                    return false;
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+std::vector<std::pair<std::string, std::string>> ValueNode::column_equalities() const
+{
+    std::vector<std::pair<std::string, std::string>> equalities;
+    switch (m_type)
+    {
+        case Type::And:
+        {
+            equalities = m_left->column_equalities();
+            auto right = m_right->column_equalities();
+            equalities.insert(equalities.end(), right.begin(), right.end());
+            break;
+        }
+
+        case Type::Equals:
+            if (m_left->m_type == Type::Column && m_right->m_type == Type::Column)
+            {
+                equalities.emplace_back(
+                    m_left->m_left->m_value.as_string(),
+                    m_right->m_left->m_value.as_string());
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return equalities;
+}
+
+std::vector<std::string> ValueNode::literal_equality_columns() const
+{
+    std::vector<std::string> columns;
+    switch (m_type)
+    {
+        case Type::And:
+        {
+            columns = m_left->literal_equality_columns();
+            auto right = m_right->literal_equality_columns();
+            columns.insert(columns.end(), right.begin(), right.end());
+            break;
+        }
+
+        case Type::Equals:
+            if (m_left->m_type == Type::Column && m_right->is_literal())
+                columns.push_back(m_left->m_left->m_value.as_string());
+            else if (m_right->m_type == Type::Column && m_left->is_literal())
+                columns.push_back(m_right->m_left->m_value.as_string());
+            break;
+
+        default:
+            break;
+    }
+
+    return columns;
+}
+
+std::vector<std::pair<std::string, std::string>> ValueNode::like_patterns() const
+{
+    std::vector<std::pair<std::string, std::string>> patterns;
+    switch (m_type)
+    {
+        case Type::And:
+        {
+            patterns = m_left->like_patterns();
+            auto right = m_right->like_patterns();
+            patterns.insert(patterns.end(), right.begin(), right.end());
+            break;
+        }
+
+        case Type::Like:
+            if (m_left->m_type == Type::Column && m_right->is_literal() &&
+                m_right->m_value.type() == Value::String)
+            {
+                patterns.emplace_back(m_left->m_left->m_value.as_string(), m_right->m_value.as_string());
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return patterns;
+}
+
+std::optional<int64_t> ValueNode::upper_bound(const std::string &column) const
+{
+    if (!m_left || !m_right)
+        return std::nullopt;
+
+    auto type = m_type;
+    const ValueNode *column_node = m_left.get();
+    const ValueNode *literal_node = m_right.get();
+    if (m_right->m_type == Type::Column)
+    {
+        type = flip(m_type);
+        std::swap(column_node, literal_node);
+    }
+
+    if (column_node->m_type != Type::Column || !literal_node->is_literal() ||
+        column_node->m_left->m_value.as_string() != column ||
+        literal_node->m_value.type() != Value::Integer)
+    {
+        return std::nullopt;
+    }
+
+    auto bound = literal_node->m_value.as_int();
+    switch (type)
+    {
+        case Type::LessThan: return bound;
+        case Type::LessThanOrEqual: return bound + 1;
+        default: return std::nullopt;
+    }
+}
+
+double ValueNode::estimate_selectivity(const TableStats *stats) const
+{
+    // NOTE: Guesses for when there are no stats for a column
+    static constexpr double default_equals_selectivity = 0.1;
+    static constexpr double default_range_selectivity = 1.0 / 3.0;
+    static constexpr double default_like_selectivity = 0.25;
+    static constexpr double default_null_selectivity = 0.05;
+
+    auto column_stats = [&](const ValueNode &node) -> const TableStats::ColumnStats*
+    {
+        if (!stats || node.m_type != Type::Column)
+            return nullptr;
+        return stats->column(node.m_left->m_value.as_string());
+    };
+
+    auto literal_number = [](const ValueNode &node) -> std::optional<double>
+    {
+        if (!node.is_literal() || !is_number(node.m_value))
+            return std::nullopt;
+        return as_number(node.m_value);
+    };
+
+    auto non_null = [](const TableStats::ColumnStats *column)
+    {
+        return column ? 1.0 - column->null_fraction : 1.0;
+    };
+
+    // Fraction of rows equal to a literal
+    auto equals_selectivity = [&](const TableStats::ColumnStats *column)
+    {
+        if (!column)
+            return default_equals_selectivity;
+        return non_null(column) / std::max(column->distinct_count, (size_t)1);
+    };
+
+    switch (m_type)
+    {
+        case Type::Value:
+        {
+            auto value = truth(m_value);
+            return value ? (*value ? 1.0 : 0.0) : 1.0;
+        }
+
+        case Type::And:
+            return m_left->estimate_selectivity(stats) * m_right->estimate_selectivity(stats);
+
+        case Type::Or:
+        {
+            auto left = m_left->estimate_selectivity(stats);
+            auto right = m_right->estimate_selectivity(stats);
+            return left + right - left * right;
+        }
+
+        case Type::Not:
+            return 1.0 - m_left->estimate_selectivity(stats);
+
+        case Type::Equals:
+        case Type::NotEquals:
+        {
+            const auto *left = column_stats(*m_left);
+            const auto *right = column_stats(*m_right);
+            double equals;
+            if (left && right)
+                equals = 1.0 / std::max({ left->distinct_count, right->distinct_count, (size_t)1 });
+            else
+                equals = equals_selectivity(left ? left : right);
+
+            if (m_type == Type::Equals)
+                return equals;
+            return std::max(non_null(left ? left : right) - equals, 0.0);
+        }
+
+        case Type::MoreThan:
+        case Type::MoreThanOrEqual:
+        case Type::LessThan:
+        case Type::LessThanOrEqual:
+        {
+            // Normalise to 'column <op> literal'
+            auto type = m_type;
+            const auto *column = column_stats(*m_left);
+            auto literal = literal_number(*m_right);
+            if (!column || !literal)
+            {
+                type = flip(m_type);
+                column = column_stats(*m_right);
+                literal = literal_number(*m_left);
+            }
+            if (!column || !literal)
+                return default_range_selectivity;
+
+            auto more_than = column->fraction_more_than(*literal);
+            if (type == Type::LessThan || type == Type::LessThanOrEqual)
+                more_than = 1.0 - more_than;
+            return non_null(column) * more_than;
+        }
+
+        case Type::Between:
+        {
+            const auto *column = column_stats(*m_left);
+            auto low = literal_number(*m_list[0]);
+            auto high = literal_number(*m_list[1]);
+            if (!column || !low || !high)
+                return default_range_selectivity * default_range_selectivity;
+
+            auto fraction = column->fraction_more_than(*low) - column->fraction_more_than(*high);
+            return non_null(column) * std::max(fraction, 0.0);
+        }
+
+        case Type::In:
+            return std::min(m_list.size() * equals_selectivity(column_stats(*m_left)), 1.0);
+
+        case Type::Like:
+            return default_like_selectivity;
+
+        case Type::IsNull:
+        {
+            const auto *column = column_stats(*m_left);
+            return column ? column->null_fraction : default_null_selectivity;
+        }
+
+        default:
+            return 1.0;
+    }
+}
+
+std::ostream &operator<< (std::ostream &stream, const DB::Sql::Value &value)
+{
+    switch (value.type())
+    {
+        case Value::Null: stream << "NULL"; break;
+        case Value::Integer: stream << value.as_int(); break;
+        case Value::Float: stream << value.as_float(); break;
+        case Value::Boolean: stream << (value.as_bool() ? "true" : "false"); break;
+        case Value::String: stream << "'" << value.as_string() << "'"; break;
+    }
+
+    return stream;
 }
@@ -2,8 +2,11 @@
 #include "../forward.hpp"
 #include <cassert>
 #include <memory>
+#include <optional>
 #include <type_traits>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace DB::Sql
 {
@@ -40,12 +43,23 @@ namespace DB::Sql
             , m_str(str) {}
 
         inline Type type() const { return m_type; }
+        inline bool is_null() const { return m_type == Null; }
+
+        // Conditions match only when they're true, not when they're false or null
+        inline bool is_true() const { return m_type == Boolean && m_bool; }
         inline int64_t as_int() const { assert(m_type == Integer); return m_int; }
         inline float as_float() const { assert(m_type == Float); return m_float; }
         inline bool as_bool() const { assert(m_type == Boolean); return m_bool; }
         inline const std::string &as_string() const { assert(m_type == String); return m_str; }
         
         std::unique_ptr<Entry> as_entry() const;
+
+        // True if this value can be stored in a column of the given type
+        bool fits(const DataType&) const;
+        static Value from_entry(const Entry&);
+
+        // Bytes that are equal for any two values that compare equal
+        std::string as_key() const;
         
     private:
         Type m_type;
@@ -64,14 +78,40 @@ namespace DB::Sql
         {
             Value,
             Column,
+            Parameter,
+
             MoreThan,
+            MoreThanOrEqual,
+            LessThan,
+            LessThanOrEqual,
             Equals,
+            NotEquals,
+            Like,
+            In,
+            Between,
+            IsNull,
+
             And,
+            Or,
+            Not,
+
+            Add,
+            Subtract,
+            Multiply,
+            Divide,
         };
         
         explicit ValueNode(Value value)
             : m_type(Type::Value)
             , m_value(value) {}
+
+        // A '?' parameter, which is treated as a literal once it's bound
+        static std::unique_ptr<ValueNode> parameter()
+        {
+            auto node = std::make_unique<ValueNode>(Value());
+            node->m_type = Type::Parameter;
+            return node;
+        }
         
         // Binary operator
         explicit ValueNode(std::unique_ptr<ValueNode> left, Type operation, std::unique_ptr<ValueNode> right)
@@ -83,15 +123,68 @@ namespace DB::Sql
         explicit ValueNode(Type operation, std::unique_ptr<ValueNode> operand)
             : m_type(operation)
             , m_left(std::move(operand)) {}
+
+        // Operator on a list, 'IN (...)' or 'BETWEEN low AND high'
+        explicit ValueNode(std::unique_ptr<ValueNode> operand, Type operation,
+                std::vector<std::unique_ptr<ValueNode>> list)
+            : m_type(operation)
+            , m_left(std::move(operand))
+            , m_list(std::move(list)) {}
         
+        // NOTE: Comparing with null gives null, as in SQL, as does comparing
+        //       values of incompatible types or dividing by zero
         Value evaluate(const Row &row);
+        void bind(Value value) { assert (m_type == Type::Parameter); m_value = std::move(value); }
+
+        // True if no row within the zone map could match this condition
+        bool can_skip(const ZoneMap&) const;
+
+        // Pairs of columns that must be equal for this condition to be true
+        std::vector<std::pair<std::string, std::string>> column_equalities() const;
+
+        // Columns that must equal a literal for this condition to be true
+        std::vector<std::string> literal_equality_columns() const;
+
+        // Columns that must be 'LIKE' a literal pattern for this condition to be true
+        std::vector<std::pair<std::string, std::string>> like_patterns() const;
+
+        // If this condition is only 'column < literal' (or '<='), the integer
+        // the column has to be below for it to be true
+        std::optional<int64_t> upper_bound(const std::string &column) const;
+
+        // Estimated fraction of rows this condition is true for,
+        // using the table's stats when there are some
+        double estimate_selectivity(const TableStats*) const;
+
+        // Replace subtrees made only of literals with their value, and drop
+        // literals that don't change the result of an 'AND' or 'OR'.
+        // NOTE: Parameters aren't folded, so a statement can be bound again
+        static void fold_constants(std::unique_ptr<ValueNode>&);
+
+        // Order chains of 'AND' and 'OR', so those most likely to decide
+        // the result are evaluated first and the rest are short-circuited
+        void order_by_selectivity(const TableStats*);
+
+        // The first column this refers to that isn't one of these, if any
+        std::optional<std::string> unknown_column(const std::vector<Column>&) const;
         
+        // The value of a literal or bound parameter, or null if this isn't one
+        inline bool is_literal() const { return m_type == Type::Value || m_type == Type::Parameter; }
+        inline const Value *literal() const { return is_literal() ? &m_value : nullptr; }
+
     private:
+        // NOTE: Only constant subtrees are evaluated without a row
+        Value evaluate(const Row *row);
+        bool has_parameters() const;
+
         Type m_type;
         Value m_value;
         std::unique_ptr<ValueNode> m_left { nullptr };
         std::unique_ptr<ValueNode> m_right { nullptr };
+        std::vector<std::unique_ptr<ValueNode>> m_list;
         
     };
     
 }
+
+std::ostream &operator<< (std::ostream&, const DB::Sql::Value&);
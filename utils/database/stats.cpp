@@ -0,0 +1,237 @@
+#include "stats.hpp"
+#include "config.hpp"
+#include "table.hpp"
+#include "entry.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+using namespace DB;
+
+static bool is_numeric(DataType::Primitive primitive)
+{
+    return primitive == DataType::Integer
+        || primitive == DataType::BigInt
+        || primitive == DataType::Float;
+}
+
+static double as_number(const Entry &entry)
+{
+    switch (entry.data_type().primitive())
+    {
+        case DataType::Integer: return entry.as_int();
+        case DataType::BigInt: return entry.as_long();
+        case DataType::Float: return entry.as_float();
+        default:
+            return 0;
+    }
+}
+
+TableStats TableStats::build(Table &table, size_t sample_size)
+{
+    TableStats stats;
+    stats.m_row_count = table.row_count();
+
+    // Pick which rows to sample, in order, so the
+    // table is still read from start to end
+    std::vector<size_t> sample;
+    if (table.row_count() <= sample_size)
+    {
+        sample.resize(table.row_count());
+        std::iota(sample.begin(), sample.end(), 0);
+    }
+    else
+    {
+        std::vector<size_t> all_rows(table.row_count());
+        std::iota(all_rows.begin(), all_rows.end(), 0);
+        std::sample(all_rows.begin(), all_rows.end(), std::back_inserter(sample),
+            sample_size, std::mt19937(Config::stats_sample_seed));
+    }
+    stats.m_sample_size = sample.size();
+
+    struct Sampled
+    {
+        size_t null_count { 0 };
+        std::unordered_map<std::string, size_t> value_counts;
+        std::vector<double> numbers;
+    };
+    std::vector<Sampled> sampled(table.columns().size());
+
+    auto next = sample.begin();
+    for (const auto &row_chunk : table.row_chunks())
+    {
+        for (; next != sample.end() && *next < row_chunk.first_row + row_chunk.row_count; ++next)
+        {
+            auto row = table.read_row(*row_chunk.chunk, *next - row_chunk.first_row);
+            size_t column_index = 0;
+            for (const auto &[name, entry] : row)
+            {
+                auto &column = sampled[column_index++];
+                if (entry->is_null())
+                {
+                    column.null_count += 1;
+                    continue;
+                }
+
+                if (!is_numeric(entry->data_type().primitive()))
+                {
+                    column.value_counts[entry->as_string()] += 1;
+                    continue;
+                }
+
+                auto number = as_number(*entry);
+                column.value_counts[std::string((const char*)&number, sizeof(number))] += 1;
+                column.numbers.push_back(number);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < table.columns().size(); i++)
+    {
+        auto &column = sampled[i];
+        ColumnStats column_stats;
+        column_stats.name = table.columns()[i].name();
+        if (stats.m_sample_size > 0)
+            column_stats.null_fraction = (double)column.null_count / stats.m_sample_size;
+
+        // NOTE: Values seen only once in the sample are likely to stand
+        //       for many more in the whole table, this scales them up by
+        //       sqrt(rows / sample), the 'guaranteed error estimator'
+        size_t seen_once = 0;
+        for (const auto &[value, count] : column.value_counts)
+            seen_once += count == 1;
+
+        auto sampled_count = stats.m_sample_size - column.null_count;
+        auto non_null_rows = (double)stats.m_row_count * (1.0 - column_stats.null_fraction);
+        auto scale = sampled_count > 0 ? std::sqrt(non_null_rows / sampled_count) : 1.0;
+        auto distinct = scale * seen_once + (column.value_counts.size() - seen_once);
+        column_stats.distinct_count = std::min((size_t)std::llround(distinct), (size_t)non_null_rows);
+
+        auto &numbers = column.numbers;
+        if (!numbers.empty())
+        {
+            std::sort(numbers.begin(), numbers.end());
+            auto bucket_count = std::min(Config::stats_histogram_buckets, numbers.size());
+            for (size_t bucket = 0; bucket <= bucket_count; bucket++)
+                column_stats.histogram.push_back(numbers[bucket * (numbers.size() - 1) / bucket_count]);
+        }
+
+        stats.m_columns.push_back(std::move(column_stats));
+    }
+
+    return stats;
+}
+
+double TableStats::ColumnStats::fraction_more_than(double value) const
+{
+    if (histogram.size() < 2)
+        return 0.5;
+    if (value < histogram.front())
+        return 1.0;
+    if (value >= histogram.back())
+        return 0.0;
+
+    // Find the bucket the value is in, and assume values
+    // are spread evenly within it
+    auto bucket_count = histogram.size() - 1;
+    auto upper = std::upper_bound(histogram.begin(), histogram.end(), value);
+    size_t bucket = (upper - histogram.begin()) - 1;
+    auto low = histogram[bucket];
+    auto high = histogram[bucket + 1];
+    auto within_bucket = high > low ? (value - low) / (high - low) : 1.0;
+
+    auto fraction_below = (bucket + within_bucket) / bucket_count;
+    return 1.0 - fraction_below;
+}
+
+const TableStats::ColumnStats *TableStats::column(const std::string &name) const
+{
+    for (const auto &column : m_columns)
+    {
+        if (column.name == name)
+            return &column;
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+static void append(std::string &out, T value)
+{
+    out.append((const char*)&value, sizeof(T));
+}
+
+template <typename T>
+static bool take(const std::string &in, size_t &offset, T &value)
+{
+    if (offset + sizeof(T) > in.size())
+        return false;
+
+    memcpy(&value, in.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+std::string TableStats::serialize() const
+{
+    std::string out;
+    append<uint64_t>(out, m_row_count);
+    append<uint64_t>(out, m_sample_size);
+    append<uint32_t>(out, m_columns.size());
+    for (const auto &column : m_columns)
+    {
+        append<uint8_t>(out, column.name.size());
+        out += column.name;
+        append<double>(out, column.null_fraction);
+        append<uint64_t>(out, column.distinct_count);
+        append<uint8_t>(out, column.histogram.size());
+        for (auto bound : column.histogram)
+            append<double>(out, bound);
+    }
+
+    return out;
+}
+
+std::optional<TableStats> TableStats::deserialize(const std::string &in)
+{
+    TableStats stats;
+    size_t offset = 0;
+    uint64_t row_count, sample_size;
+    uint32_t column_count;
+    if (!take(in, offset, row_count) || !take(in, offset, sample_size) || !take(in, offset, column_count))
+        return std::nullopt;
+
+    stats.m_row_count = row_count;
+    stats.m_sample_size = sample_size;
+    for (uint32_t i = 0; i < column_count; i++)
+    {
+        ColumnStats column;
+        uint8_t name_length, bucket_bound_count;
+        uint64_t distinct_count;
+        if (!take(in, offset, name_length) || offset + name_length > in.size())
+            return std::nullopt;
+        column.name = in.substr(offset, name_length);
+        offset += name_length;
+
+        if (!take(in, offset, column.null_fraction) ||
+            !take(in, offset, distinct_count) ||
+            !take(in, offset, bucket_bound_count))
+        {
+            return std::nullopt;
+        }
+        column.distinct_count = distinct_count;
+
+        column.histogram.resize(bucket_bound_count);
+        for (auto &bound : column.histogram)
+        {
+            if (!take(in, offset, bound))
+                return std::nullopt;
+        }
+
+        stats.m_columns.push_back(std::move(column));
+    }
+
+    return stats;
+}
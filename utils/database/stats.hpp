@@ -0,0 +1,49 @@
+#pragma once
+#include "forward.hpp"
+#include "column.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace DB
+{
+
+    // Statistics about the values in each column of a table, gathered
+    // from a sample of its rows by 'ANALYZE', for estimating how many
+    // rows a query will match.
+    class TableStats
+    {
+    public:
+        struct ColumnStats
+        {
+            std::string name;
+            double null_fraction { 0 };
+            size_t distinct_count { 0 };
+
+            // Equi-depth histogram bounds, each bucket holds the same
+            // number of sampled values. Only numeric columns have one.
+            std::vector<double> histogram;
+
+            // Estimated fraction of non null values above the given one
+            double fraction_more_than(double value) const;
+        };
+
+        static TableStats build(Table&, size_t sample_size);
+
+        inline size_t row_count() const { return m_row_count; }
+        inline size_t sample_size() const { return m_sample_size; }
+        const ColumnStats *column(const std::string &name) const;
+
+        std::string serialize() const;
+        static std::optional<TableStats> deserialize(const std::string&);
+
+    private:
+        TableStats() = default;
+
+        size_t m_row_count { 0 };
+        size_t m_sample_size { 0 };
+        std::vector<ColumnStats> m_columns;
+
+    };
+
+}
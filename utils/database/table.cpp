@@ -3,10 +3,32 @@
 #include "table.hpp"
 #include "database.hpp"
 #include "dynamicdata.hpp"
+#include "entry.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <unordered_set>
 using namespace DB;
 
+// Windows are rounded down, so times before 0 are in their own windows too
+static int64_t window_of(int64_t time, int64_t width)
+{
+    auto window = time / width;
+    if (time % width != 0 && time < 0)
+        window -= 1;
+    return window;
+}
+
+// The text a row has in an indexed column, if it's not null
+static std::optional<std::string> indexed_text(const Row &row, const std::string &column)
+{
+    const auto &entry = row[column];
+    if (!entry || entry->is_null())
+        return std::nullopt;
+
+    return entry->as_string();
+}
+
 Table::Table(DataBase& db, Constructor constructor)
     : m_db(db)
 {
@@ -20,6 +42,17 @@ Table::Table(DataBase& db, Constructor constructor)
         m_row_size += it.second.size();
     }
 
+    if (!constructor.m_partition_column.empty())
+    {
+        auto column = std::find_if(m_columns.begin(), m_columns.end(),
+            [&](const auto &it) { return it.name() == constructor.m_partition_column; });
+        assert (column != m_columns.end());
+        assert (constructor.m_partition_width > 0);
+
+        m_partitioning = Partitioning { constructor.m_partition_column,
+            (size_t)(column - m_columns.begin()), constructor.m_partition_width };
+    }
+
     // Create table object
     write_header();
     m_name = constructor.m_name;
@@ -40,8 +73,8 @@ Table::Table(DataBase &db, std::shared_ptr<Chunk> header)
     // Column and row count
     auto column_count = header->read_byte(offset);
     m_row_count_offset = offset + 1;
-    m_row_count = header->read_int(offset + 1);
-    offset += 1 + sizeof(int);
+    m_row_count = header->read_long(offset + 1);
+    offset += 1 + sizeof(int64_t);
 
     m_row_size = Config::row_header_size;
     for (size_t i = 0; i < column_count; i++)
@@ -68,6 +101,15 @@ Table::Table(DataBase &db, std::shared_ptr<Chunk> header)
         m_row_size += type.size();
     }
 
+    // Partitioning, which older headers don't have
+    if (offset < header->size_in_bytes())
+    {
+        auto column_index = header->read_byte(offset);
+        auto width = header->read_long(offset + 1);
+        assert (column_index < m_columns.size());
+        m_partitioning = Partitioning { m_columns[column_index].name(), column_index, width };
+    }
+
 #ifdef DEBUG_TABLE_LOAD
     std::cout << "Loaded Table { " <<
         "name = " << m_name <<
@@ -86,8 +128,8 @@ void Table::write_header()
 
     m_header->write_byte(curr_offset, m_columns.size());
     m_row_count_offset = curr_offset + 1;
-    m_header->write_int(curr_offset + 1, 0);
-    curr_offset += 1 + sizeof(int);
+    m_header->write_long(curr_offset + 1, 0);
+    curr_offset += 1 + sizeof(int64_t);
 
     for (const auto &column : m_columns)
     {
@@ -106,6 +148,12 @@ void Table::write_header()
         curr_offset += 2;
     }
 
+    if (m_partitioning)
+    {
+        m_header->write_byte(curr_offset, m_partitioning->column_index);
+        m_header->write_long(curr_offset + 1, m_partitioning->width);
+    }
+
     // TODO: Add this API
     // m_header.flush();
 }
@@ -132,10 +180,31 @@ void Table::add_row(Row row)
         return;
     }
 
+    // NOTE: Rows of a partitioned table go in the chunk of their window,
+    //       so the rows in a new window start a new chunk
+    std::optional<int64_t> window;
+    if (m_partitioning)
+    {
+        assert (can_append(row));
+        window = window_of(*partition_value(row), m_partitioning->width);
+    }
+
     // Find or create the active chunk
     std::shared_ptr<Chunk> active_chunk;
     auto new_chunk = [&]() {
-        auto chunk = m_db.new_chunk("RD", m_id, find_next_row_chunk_index());
+        // NOTE: Each chunk reserves an extent to grow into, so rows can still be
+        //       appended once other chunks are written after it. Extents double
+        //       up to the max chunk size, so small tables don't reserve much.
+        auto extent_size = Config::min_row_data_extent_size;
+        if (!m_row_data_chunks.empty())
+        {
+            auto &last_chunk = *m_row_data_chunks.back();
+            extent_size = std::max(extent_size, last_chunk.size_in_bytes() * 2);
+            m_db.seal_chunk(last_chunk);
+        }
+        extent_size = std::min(extent_size, Config::max_row_data_chunk_size);
+
+        auto chunk = m_db.new_chunk("RD", m_id, find_next_row_chunk_index(), extent_size);
         m_row_data_chunks.push_back(chunk);
         return chunk;
     };
@@ -146,32 +215,92 @@ void Table::add_row(Row row)
     }
     else
     {
+        // NOTE: Row data is split into bounded chunks, so full
+        //       ones can be sealed and compressed
         active_chunk = m_row_data_chunks.back();
-        if (!active_chunk->is_active())
+        if (!active_chunk->can_grow_by(m_row_size) ||
+            active_chunk->size_in_bytes() + m_row_size > Config::max_row_data_chunk_size ||
+            (window && partition_window(*active_chunk).value_or(*window) != *window))
+        {
             active_chunk = new_chunk();
+        }
     }
 
     // Write the row to disk
     auto offset = active_chunk->size_in_bytes();
     row.write(*active_chunk, offset);
+    if (window)
+        m_partition_windows[active_chunk->index()] = *window;
+
+    for (auto &index : m_indexes)
+    {
+        mark_index_changed(index);
+        if (auto text = indexed_text(row, index.index.column()))
+            index.index.add(m_row_count, *text);
+    }
+
+    // Keep the zone map up to date, if there isn't one yet
+    // it'll be built from the whole chunk on the next scan
+    auto zone_map = m_zone_maps.find(active_chunk->index());
+    if (zone_map != m_zone_maps.end())
+        zone_map->second.add(row);
+    else if (offset == 0)
+        m_zone_maps.emplace(active_chunk->index(), make_zone_map()).first->second.add(row);
 
     // Update row count
     m_row_count += 1;
-    m_header->write_int(m_row_count_offset, m_row_count);
+    m_header->write_long(m_row_count_offset, m_row_count);
 }
 
 void Table::update_row(size_t index, Row row)
 {
+    assert (!m_partitioning);
     auto [chunk, offset] = find_chunk_and_offset_for_row(index);
     assert (chunk);
 
-    row.write(*chunk, offset);
+    // NOTE: Only indexes on changed columns need updating,
+    //       which the old row is read back for
+    std::optional<Row> old_row;
+    for (auto &table_index : m_indexes)
+    {
+        const auto &column = table_index.index.column();
+        if (!row[column] || !row[column]->is_dirty())
+            continue;
+
+        if (!old_row)
+            old_row = read_row(*chunk, offset / m_row_size);
+
+        mark_index_changed(table_index);
+        if (auto text = indexed_text(*old_row, column))
+            table_index.index.remove(index, *text);
+        if (auto text = indexed_text(row, column))
+            table_index.index.add(index, *text);
+    }
+
+    row.write_changed(*chunk, offset);
+
+    auto zone_map = m_zone_maps.find(chunk->index());
+    if (zone_map != m_zone_maps.end())
+        zone_map->second.add(row);
 }
 
 void Table::remove_row(size_t index)
 {
+    assert (!m_partitioning);
     auto [chunk, offset] = find_chunk_and_offset_for_row(index);
 
+    if (!m_indexes.empty())
+    {
+        auto row = read_row(*chunk, offset / m_row_size);
+        for (auto &table_index : m_indexes)
+        {
+            mark_index_changed(table_index);
+            if (auto text = indexed_text(row, table_index.index.column()))
+                table_index.index.remove(index, *text);
+            table_index.index.remove_row(index);
+        }
+    }
+
     // Copy data up a row
     for (size_t i = offset; i < chunk->size_in_bytes() - m_row_size; i++)
     {
@@ -184,7 +313,7 @@ void Table::remove_row(size_t index)
 
     // Update row count
     m_row_count -= 1;
-    m_header->write_int(m_row_count_offset, m_row_count);
+    m_header->write_long(m_row_count_offset, m_row_count);
 }
 
 Row Table::make_row()
@@ -220,11 +349,11 @@ std::tuple<std::shared_ptr<Chunk>, size_t> Table::find_chunk_and_offset_for_row(
     return std::make_tuple(chunk_containing_row, row_offset);
 }
 
-int Table::find_next_row_chunk_index()
+uint32_t Table::find_next_row_chunk_index()
 {
-    int max_index = 0;
+    uint32_t max_index = 0;
     for (const auto &chunk : m_row_data_chunks)
-        max_index = std::max(max_index, (int)chunk->index());
+        max_index = std::max(max_index, (uint32_t)chunk->index());
 
     return max_index + 1;
 }
@@ -255,20 +384,430 @@ void Table::add_dynamic_data(std::shared_ptr<Chunk> data)
     m_dynamic_data_chunks.push_back(std::move(data));
 }
 
-std::shared_ptr<Chunk> Table::find_dynamic_chunk(int id)
+std::shared_ptr<Chunk> Table::find_dynamic_chunk(uint32_t id)
 {
     for (auto &chunk : m_dynamic_data_chunks)
     {
-        if ((int)chunk->index() == id)
+        if (chunk->index() == id)
             return chunk;
     }
 
     return nullptr;
 }
 
+std::vector<Table::RowChunk> Table::row_chunks() const
+{
+    std::vector<RowChunk> row_chunks;
+    size_t first_row = 0;
+    for (const auto &chunk : m_row_data_chunks)
+    {
+        auto row_count = chunk->size_in_bytes() / m_row_size;
+        row_chunks.push_back({ chunk, first_row, row_count });
+        first_row += row_count;
+    }
+
+    return row_chunks;
+}
+
+Row Table::read_row(Chunk &chunk, size_t index_in_chunk)
+{
+    Row row(m_columns);
+    row.read(chunk, index_in_chunk * m_row_size);
+    return row;
+}
+
+std::string Table::read_row_data(Chunk &chunk, size_t index_in_chunk)
+{
+    return chunk.read_string(index_in_chunk * m_row_size, m_row_size);
+}
+
+void Table::read_ahead(const std::vector<RowChunk> &row_chunks, size_t index)
+{
+    std::vector<Chunk*> chunks;
+    auto end = std::min(row_chunks.size(), index + Config::read_ahead_chunk_count);
+    for (size_t i = index; i < end; i++)
+        chunks.push_back(row_chunks[i].chunk.get());
+
+    m_db.m_page_cache.read_ahead(chunks);
+}
+
+const ZoneMap *Table::find_zone_map(const Chunk &chunk) const
+{
+    auto zone_map = m_zone_maps.find(chunk.index());
+    if (zone_map == m_zone_maps.end())
+        return nullptr;
+
+    return &zone_map->second;
+}
+
+void Table::set_zone_map(const Chunk &chunk, ZoneMap zone_map)
+{
+    m_zone_maps.insert_or_assign(chunk.index(), std::move(zone_map));
+}
+
+void Table::load_zone_maps(Chunk &chunk)
+{
+    size_t offset = 0;
+    auto count = chunk.read_int(offset);
+    offset += sizeof(int);
+
+    for (int i = 0; i < count; i++)
+    {
+        auto index = (uint32_t)chunk.read_int(offset);
+        auto size_in_bytes = (size_t)chunk.read_long(offset + sizeof(uint32_t));
+        offset += sizeof(uint32_t) + sizeof(int64_t);
+
+        size_t zone_map_size;
+        auto zone_map = ZoneMap::read(chunk, offset, m_columns, zone_map_size);
+        offset += zone_map_size;
+
+        // Only trust it if the row data hasn't changed size since it was written
+        for (const auto &row_data : m_row_data_chunks)
+        {
+            if (row_data->index() == index && row_data->size_in_bytes() == size_in_bytes)
+                m_zone_maps.insert_or_assign(index, std::move(zone_map));
+        }
+    }
+}
+
+void Table::write_zone_maps()
+{
+    if (m_zone_maps.empty())
+        return;
+
+    auto chunk = m_db.new_chunk("ZM", m_id, 0);
+    size_t offset = 0;
+    chunk->write_int(offset, m_zone_maps.size());
+    offset += sizeof(int);
+
+    for (const auto &[index, zone_map] : m_zone_maps)
+    {
+        size_t size_in_bytes = 0;
+        for (const auto &row_data : m_row_data_chunks)
+        {
+            if (row_data->index() == index)
+                size_in_bytes = row_data->size_in_bytes();
+        }
+
+        chunk->write_int(offset, index);
+        chunk->write_long(offset + sizeof(uint32_t), size_in_bytes);
+        offset += sizeof(uint32_t) + sizeof(int64_t);
+        offset += zone_map.write(*chunk, offset);
+    }
+}
+
+void Table::analyze()
+{
+    m_stats = TableStats::build(*this, Config::stats_sample_size);
+
+    // NOTE: Stats are small, so just replace the whole chunk
+    if (m_stats_chunk)
+        m_stats_chunk->drop();
+    m_stats_chunk = m_db.new_chunk("ST", m_id, 0);
+    m_stats_chunk->write_string(0, m_stats->serialize());
+}
+
+void Table::load_stats(std::shared_ptr<Chunk> chunk)
+{
+    m_stats_chunk = chunk;
+    m_stats = TableStats::deserialize(chunk->read_string(0, chunk->size_in_bytes()));
+}
+
+Table::Index Table::build_index(const std::string &column)
+{
+    Index index { TrigramIndex(column), nullptr };
+    auto row_chunks = this->row_chunks();
+    for (size_t chunk_index = 0; chunk_index < row_chunks.size(); chunk_index++)
+    {
+        const auto &row_chunk = row_chunks[chunk_index];
+        read_ahead(row_chunks, chunk_index);
+        for (size_t i = 0; i < row_chunk.row_count; i++)
+        {
+            auto row = read_row(*row_chunk.chunk, i);
+            if (auto text = indexed_text(row, column))
+                index.index.add(row_chunk.first_row + i, *text);
+        }
+    }
+
+    return index;
+}
+
+void Table::create_index(const std::string &column)
+{
+    assert (!find_index(column));
+
+    auto column_index = std::find_if(m_columns.begin(), m_columns.end(),
+        [&](const auto &it) { return it.name() == column; }) - m_columns.begin();
+    assert (column_index < (long)m_columns.size());
+
+    // NOTE: The chunk is indexed by the column, so it can be rebuilt from that alone
+    auto index = build_index(column);
+    index.chunk = m_db.new_chunk("TI", m_id, column_index);
+    index.has_changed = true;
+    m_indexes.push_back(std::move(index));
+    write_indexes();
+}
+
+const TrigramIndex *Table::find_index(const std::string &column) const
+{
+    for (const auto &index : m_indexes)
+    {
+        if (index.index.column() == column)
+            return &index.index;
+    }
+
+    return nullptr;
+}
+
+void Table::mark_index_changed(Index &index)
+{
+    if (index.has_changed)
+        return;
+
+    index.chunk->write_byte(0, 0);
+    index.has_changed = true;
+}
+
+void Table::load_index(std::shared_ptr<Chunk> chunk)
+{
+    auto data = chunk->read_string(0, chunk->size_in_bytes());
+    if (!data.empty() && data[0] == 1)
+    {
+        if (auto index = TrigramIndex::deserialize(data.substr(1)))
+        {
+            m_indexes.push_back({ std::move(*index), chunk });
+            return;
+        }
+    }
+
+    // NOTE: It wasn't written back after it last changed, so has to be rebuilt
+    if (chunk->index() >= m_columns.size())
+        return;
+
+    auto index = build_index(m_columns[chunk->index()].name());
+    index.chunk = chunk;
+    index.has_changed = true;
+    m_indexes.push_back(std::move(index));
+}
+
+void Table::write_indexes()
+{
+    // NOTE: Indexes can be large, so are only written back if they've changed
+    for (auto &index : m_indexes)
+    {
+        if (!index.has_changed)
+            continue;
+
+        auto column_index = index.chunk->index();
+        if (index.chunk->size_in_bytes() > 0)
+        {
+            index.chunk->drop();
+            index.chunk = m_db.new_chunk("TI", m_id, column_index);
+        }
+
+        index.chunk->write_byte(0, 1);
+        index.chunk->write_string(1, index.index.serialize());
+        index.has_changed = false;
+    }
+}
+
+void Table::check_consistency(std::vector<std::string> &problems)
+{
+    auto problem = [&](const std::string &message)
+    {
+        problems.push_back("Table '" + m_name + "': " + message);
+    };
+
+    size_t row_count = 0;
+    for (const auto &chunk : m_row_data_chunks)
+    {
+        if (chunk->size_in_bytes() % m_row_size != 0)
+        {
+            problem("Row data chunk " + std::to_string(chunk->index()) + " has "
+                + std::to_string(chunk->size_in_bytes() % m_row_size) + " bytes of a partial row");
+        }
+        row_count += chunk->size_in_bytes() / m_row_size;
+    }
+
+    if (row_count != m_row_count)
+    {
+        problem("Header has " + std::to_string(m_row_count) + " rows, but there are "
+            + std::to_string(row_count) + " in the row data");
+    }
+
+    // NOTE: Text is stored by the id of its dynamic data chunk, which has to exist unless it's null
+    auto text_offsets = this->text_offsets();
+    if (text_offsets.empty())
+        return;
+
+    for (const auto &row_chunk : row_chunks())
+    {
+        for (size_t i = 0; i < row_chunk.row_count; i++)
+        {
+            auto data = read_row_data(*row_chunk.chunk, i);
+            for (auto text_offset : text_offsets)
+            {
+                if (data[text_offset])
+                    continue;
+
+                uint32_t id;
+                memcpy(&id, data.data() + text_offset + 1, sizeof(id));
+                if (!find_dynamic_chunk(id))
+                {
+                    problem("Row " + std::to_string(row_chunk.first_row + i)
+                        + " has text in dynamic data " + std::to_string(id) + ", which doesn't exist");
+                }
+            }
+        }
+    }
+}
+
+std::vector<size_t> Table::text_offsets() const
+{
+    std::vector<size_t> text_offsets;
+    size_t offset = Config::row_header_size;
+    for (const auto &column : m_columns)
+    {
+        if (column.data_type().primitive() == DataType::Text)
+            text_offsets.push_back(offset);
+        offset += column.data_type().size();
+    }
+
+    return text_offsets;
+}
+
+std::optional<int64_t> Table::partition_value(const Row &row) const
+{
+    const auto &entry = row[m_partitioning->column];
+    if (!entry || entry->is_null())
+        return std::nullopt;
+
+    return entry->as_long();
+}
+
+std::optional<int64_t> Table::partition_window(Chunk &chunk)
+{
+    auto window = m_partition_windows.find(chunk.index());
+    if (window != m_partition_windows.end())
+        return window->second;
+
+    // NOTE: Every row in a chunk is in the same window, so the first says which
+    if (chunk.size_in_bytes() < m_row_size)
+        return std::nullopt;
+
+    auto value = partition_value(read_row(chunk, 0));
+    if (!value)
+        return std::nullopt;
+
+    auto first_window = window_of(*value, m_partitioning->width);
+    m_partition_windows.emplace(chunk.index(), first_window);
+    return first_window;
+}
+
+bool Table::can_append(const Row &row)
+{
+    auto value = partition_value(row);
+    if (!value)
+        return false;
+
+    for (auto it = m_row_data_chunks.rbegin(); it != m_row_data_chunks.rend(); ++it)
+    {
+        if (auto window = partition_window(**it))
+            return window_of(*value, m_partitioning->width) >= *window;
+    }
+
+    return true;
+}
+
+std::optional<ZoneMap> Table::partition_zone_map(Chunk &chunk)
+{
+    if (!m_partitioning)
+        return std::nullopt;
+
+    auto window = partition_window(chunk);
+    if (!window)
+        return std::nullopt;
+
+    auto width = m_partitioning->width;
+    return ZoneMap::of_range(m_partitioning->column, *window * width, *window * width + width - 1);
+}
+
+std::optional<size_t> Table::drop_partitions_before(int64_t time)
+{
+    assert (m_partitioning);
+    auto width = m_partitioning->width;
+
+    // Partitions are in time order, so the ones to drop are at the start
+    size_t chunk_count = 0;
+    for (; chunk_count < m_row_data_chunks.size(); chunk_count++)
+    {
+        auto window = partition_window(*m_row_data_chunks[chunk_count]);
+        if (!window || *window * width + width > time)
+        {
+            if (window && *window * width < time)
+                return std::nullopt;
+            break;
+        }
+    }
+
+    // The text of the dropped rows goes with them
+    std::unordered_set<uint32_t> dynamic_data_ids;
+    auto text_offsets = this->text_offsets();
+    size_t row_count = 0;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        auto &chunk = *m_row_data_chunks[i];
+        auto chunk_row_count = chunk.size_in_bytes() / m_row_size;
+        for (size_t row = 0; row < chunk_row_count && !text_offsets.empty(); row++)
+        {
+            // NOTE: Null text has no data, so its id isn't set
+            for (auto text_offset : text_offsets)
+            {
+                auto offset = row * m_row_size + text_offset;
+                if (!chunk.read_byte(offset))
+                    dynamic_data_ids.insert(chunk.read_int(offset + 1));
+            }
+        }
+
+        chunk.drop();
+        m_zone_maps.erase(chunk.index());
+        m_partition_windows.erase(chunk.index());
+        row_count += chunk_row_count;
+    }
+    m_row_data_chunks.erase(m_row_data_chunks.begin(), m_row_data_chunks.begin() + chunk_count);
+
+    auto dynamic_end = std::remove_if(m_dynamic_data_chunks.begin(), m_dynamic_data_chunks.end(),
+        [&](const auto &chunk)
+        {
+            if (!dynamic_data_ids.count(chunk->index()))
+                return false;
+
+            chunk->drop();
+            return true;
+        });
+    m_dynamic_data_chunks.erase(dynamic_end, m_dynamic_data_chunks.end());
+
+    for (auto &index : m_indexes)
+    {
+        mark_index_changed(index);
+        index.index.remove_first_rows(row_count);
+    }
+
+    m_row_count -= row_count;
+    m_header->write_long(m_row_count_offset, m_row_count);
+    return row_count;
+}
+
 void Table::drop()
 {
     m_header->drop();
     for (const auto &chunk : m_row_data_chunks)
         chunk->drop();
+    if (m_stats_chunk)
+        m_stats_chunk->drop();
+    for (const auto &index : m_indexes)
+        index.chunk->drop();
+    m_zone_maps.clear();
+    m_stats = std::nullopt;
+    m_indexes.clear();
 }
@@ -2,6 +2,10 @@
 #include "forward.hpp"
 #include "column.hpp"
 #include "row.hpp"
+#include "zonemap.hpp"
+#include "stats.hpp"
+#include "trigramindex.hpp"
+#include <map>
 #include <vector>
 #include <string>
 #include <optional>
@@ -32,15 +36,26 @@ namespace DB
                 m_columns.emplace_back(name, type);
             }
 
+            // Make the table append only, with its rows split into partitions
+            // that each cover a window of the given width of an integer column
+            void partition_by(std::string column, int64_t width)
+            {
+                m_partition_column = std::move(column);
+                m_partition_width = width;
+            }
+
         private:
             std::string m_name;
             std::vector<std::pair<std::string, DataType>> m_columns;
+            std::string m_partition_column;
+            int64_t m_partition_width { 0 };
 
         };
 
-        inline int id() const { return m_id; }
+        inline uint32_t id() const { return m_id; }
         inline const std::string &name() const { return m_name; }
         inline size_t row_count() const { return m_row_count; }
+        inline const std::vector<Column> &columns() const { return m_columns; }
 
         std::optional<Row> get_row(size_t index);
         void update_row(size_t index, Row);
@@ -49,17 +64,76 @@ namespace DB
         Row make_row();
         void drop();
 
+        struct RowChunk
+        {
+            std::shared_ptr<Chunk> chunk;
+            size_t first_row;
+            size_t row_count;
+        };
+
+        // Row data split by chunk, so scans can read (or skip) a chunk at a time
+        std::vector<RowChunk> row_chunks() const;
+        Row read_row(Chunk&, size_t index_in_chunk);
+        std::string read_row_data(Chunk&, size_t index_in_chunk);
+
+        // Start reading the next few chunks from the given one, so a
+        // scan finds them already in memory when it gets to them
+        void read_ahead(const std::vector<RowChunk>&, size_t index);
+
+        const ZoneMap *find_zone_map(const Chunk&) const;
+        void set_zone_map(const Chunk&, ZoneMap);
+        inline ZoneMap make_zone_map() const { return ZoneMap(m_columns); }
+
+        // Sample the table's rows and store statistics about them
+        void analyze();
+        inline const TableStats *stats() const { return m_stats ? &*m_stats : nullptr; }
+
+        // Partitioned tables are append only. Each partition is one or more row data
+        // chunks holding the rows in a window of time, sealed once a later one starts.
+        struct Partitioning
+        {
+            std::string column;
+            size_t column_index;
+            int64_t width;
+        };
+
+        inline const std::optional<Partitioning> &partitioning() const { return m_partitioning; }
+
+        // Rows can only be added to the latest partition or a new later one
+        bool can_append(const Row&);
+
+        // The window a row data chunk's partition covers, as a zone map to skip it by
+        std::optional<ZoneMap> partition_zone_map(Chunk&);
+
+        // Drop the partitions that end at or before the given time, returning
+        // the number of rows dropped. Nothing is dropped if one only partly does.
+        std::optional<size_t> drop_partitions_before(int64_t time);
+
+        // Index a Char or Text column, so 'LIKE' can find
+        // the rows that could match without a full scan
+        void create_index(const std::string &column);
+        const TrigramIndex *find_index(const std::string &column) const;
+
     private:
         Table(DataBase&, Constructor);
         Table(DataBase&, std::shared_ptr<Chunk> header);
 
         std::tuple<std::shared_ptr<Chunk>, size_t> find_chunk_and_offset_for_row(size_t row);
         std::unique_ptr<DynamicData> new_dynamic_data();
-        std::shared_ptr<Chunk> find_dynamic_chunk(int id);
-        int find_next_row_chunk_index();
+        std::shared_ptr<Chunk> find_dynamic_chunk(uint32_t id);
+        uint32_t find_next_row_chunk_index();
         void add_row_data(std::shared_ptr<Chunk> data);
         void add_dynamic_data(std::shared_ptr<Chunk> data);
+        void load_zone_maps(Chunk&);
+        void load_stats(std::shared_ptr<Chunk>);
+        void load_index(std::shared_ptr<Chunk>);
+        void write_zone_maps();
+        void write_indexes();
         void write_header();
+        void check_consistency(std::vector<std::string> &problems);
+        std::vector<size_t> text_offsets() const;
+        std::optional<int64_t> partition_value(const Row&) const;
+        std::optional<int64_t> partition_window(Chunk&);
 
         DataBase &m_db;
         std::shared_ptr<Chunk> m_header;
@@ -67,12 +141,36 @@ namespace DB
         std::vector<std::shared_ptr<Chunk>> m_dynamic_data_chunks;
         size_t m_row_count_offset;
 
-        int m_id { 0xCD };
+        uint32_t m_id { 0xCDCDCDCD };
         std::string m_name;
         std::vector<Column> m_columns;
         size_t m_row_size { 0 };
         size_t m_row_count { 0 };
 
+        // Zone maps by row data chunk index
+        std::map<size_t, ZoneMap> m_zone_maps;
+
+        std::optional<TableStats> m_stats;
+        std::shared_ptr<Chunk> m_stats_chunk;
+
+        // Partition windows by row data chunk index, found from their first row
+        std::optional<Partitioning> m_partitioning;
+        std::map<size_t, int64_t> m_partition_windows;
+
+        // NOTE: Indexes are kept up to date in memory, and written back when
+        //       the database is closed. The first byte of the chunk says if
+        //       it's up to date, so it's rebuilt if that never happened.
+        struct Index
+        {
+            TrigramIndex index;
+            std::shared_ptr<Chunk> chunk;
+            bool has_changed { false };
+        };
+        std::vector<Index> m_indexes;
+
+        Index build_index(const std::string &column);
+        void mark_index_changed(Index&);
+
     };
 
 }
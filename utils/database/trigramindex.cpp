@@ -0,0 +1,212 @@
+#include "trigramindex.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+using namespace DB;
+
+std::vector<uint32_t> TrigramIndex::trigrams(std::string_view text)
+{
+    std::vector<uint32_t> out;
+    for (size_t i = 0; i + 3 <= text.size(); i++)
+    {
+        out.push_back(
+            ((uint32_t)(uint8_t)text[i] << 16) |
+            ((uint32_t)(uint8_t)text[i + 1] << 8) |
+            (uint32_t)(uint8_t)text[i + 2]);
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+std::vector<uint32_t> TrigramIndex::pattern_trigrams(std::string_view pattern)
+{
+    // NOTE: Only the runs of characters between wildcards have to be in the text
+    std::vector<uint32_t> out;
+    size_t start = 0;
+    while (start < pattern.size())
+    {
+        auto end = pattern.find_first_of("%_", start);
+        if (end == std::string_view::npos)
+            end = pattern.size();
+
+        auto run = trigrams(pattern.substr(start, end - start));
+        out.insert(out.end(), run.begin(), run.end());
+        start = end + 1;
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+void TrigramIndex::add(size_t row, std::string_view text)
+{
+    for (auto trigram : trigrams(text))
+    {
+        // NOTE: Rows are mostly added to the end, so this is usually an append
+        auto &rows = m_rows[trigram];
+        auto it = std::lower_bound(rows.begin(), rows.end(), (uint32_t)row);
+        if (it == rows.end() || *it != row)
+            rows.insert(it, row);
+    }
+}
+
+void TrigramIndex::remove(size_t row, std::string_view text)
+{
+    for (auto trigram : trigrams(text))
+    {
+        auto rows = m_rows.find(trigram);
+        if (rows == m_rows.end())
+            continue;
+
+        auto &list = rows->second;
+        auto it = std::lower_bound(list.begin(), list.end(), (uint32_t)row);
+        if (it != list.end() && *it == row)
+            list.erase(it);
+        if (list.empty())
+            m_rows.erase(rows);
+    }
+}
+
+void TrigramIndex::remove_row(size_t row)
+{
+    for (auto &[trigram, rows] : m_rows)
+    {
+        auto it = std::upper_bound(rows.begin(), rows.end(), (uint32_t)row);
+        for (; it != rows.end(); ++it)
+            *it -= 1;
+    }
+}
+
+void TrigramIndex::remove_first_rows(size_t count)
+{
+    for (auto it = m_rows.begin(); it != m_rows.end();)
+    {
+        auto &rows = it->second;
+        rows.erase(rows.begin(), std::lower_bound(rows.begin(), rows.end(), (uint32_t)count));
+        for (auto &row : rows)
+            row -= count;
+
+        if (rows.empty())
+            it = m_rows.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::optional<std::vector<uint32_t>> TrigramIndex::candidates(std::string_view pattern) const
+{
+    auto pattern_trigrams = TrigramIndex::pattern_trigrams(pattern);
+    if (pattern_trigrams.empty())
+        return std::nullopt;
+
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (auto trigram : pattern_trigrams)
+    {
+        auto rows = m_rows.find(trigram);
+        if (rows == m_rows.end())
+            return std::vector<uint32_t>();
+        lists.push_back(&rows->second);
+    }
+
+    // Start from the shortest list, so the rest only shrink it
+    std::sort(lists.begin(), lists.end(), [](const auto *a, const auto *b)
+    {
+        return a->size() < b->size();
+    });
+
+    auto out = *lists.front();
+    for (size_t i = 1; i < lists.size() && !out.empty(); i++)
+    {
+        std::vector<uint32_t> both;
+        std::set_intersection(out.begin(), out.end(),
+            lists[i]->begin(), lists[i]->end(), std::back_inserter(both));
+        out = std::move(both);
+    }
+
+    return out;
+}
+
+std::optional<size_t> TrigramIndex::estimate_candidates(std::string_view pattern) const
+{
+    auto pattern_trigrams = TrigramIndex::pattern_trigrams(pattern);
+    if (pattern_trigrams.empty())
+        return std::nullopt;
+
+    size_t smallest = SIZE_MAX;
+    for (auto trigram : pattern_trigrams)
+    {
+        auto rows = m_rows.find(trigram);
+        smallest = std::min(smallest, rows == m_rows.end() ? 0 : rows->second.size());
+    }
+
+    return smallest;
+}
+
+template <typename T>
+static void append(std::string &out, T value)
+{
+    out.append((const char*)&value, sizeof(T));
+}
+
+template <typename T>
+static bool take(const std::string &in, size_t &offset, T &value)
+{
+    if (offset + sizeof(T) > in.size())
+        return false;
+
+    memcpy(&value, in.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+std::string TrigramIndex::serialize() const
+{
+    std::string out;
+    append<uint8_t>(out, m_column.size());
+    out += m_column;
+    append<uint32_t>(out, m_rows.size());
+    for (const auto &[trigram, rows] : m_rows)
+    {
+        append<uint32_t>(out, trigram);
+        append<uint32_t>(out, rows.size());
+        out.append((const char*)rows.data(), rows.size() * sizeof(uint32_t));
+    }
+
+    return out;
+}
+
+std::optional<TrigramIndex> TrigramIndex::deserialize(const std::string &in)
+{
+    size_t offset = 0;
+    uint8_t name_length;
+    if (!take(in, offset, name_length) || offset + name_length > in.size())
+        return std::nullopt;
+
+    TrigramIndex index(in.substr(offset, name_length));
+    offset += name_length;
+
+    uint32_t trigram_count;
+    if (!take(in, offset, trigram_count))
+        return std::nullopt;
+
+    index.m_rows.reserve(trigram_count);
+    for (uint32_t i = 0; i < trigram_count; i++)
+    {
+        uint32_t trigram, row_count;
+        if (!take(in, offset, trigram) || !take(in, offset, row_count))
+            return std::nullopt;
+        if (offset + (size_t)row_count * sizeof(uint32_t) > in.size())
+            return std::nullopt;
+
+        auto &rows = index.m_rows[trigram];
+        rows.resize(row_count);
+        memcpy(rows.data(), in.data() + offset, row_count * sizeof(uint32_t));
+        offset += row_count * sizeof(uint32_t);
+    }
+
+    return index;
+}
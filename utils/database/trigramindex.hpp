@@ -0,0 +1,54 @@
+#pragma once
+#include "forward.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace DB
+{
+
+    // The rows containing each run of three characters in a Char or Text
+    // column, so 'LIKE' can look up the rows that might match a pattern
+    // rather than reading every row.
+    // NOTE: Rows are kept by their index in the table, so removing a row
+    //       shifts every row after it down by one
+    class TrigramIndex
+    {
+    public:
+        explicit TrigramIndex(std::string column)
+            : m_column(std::move(column)) {}
+
+        inline const std::string &column() const { return m_column; }
+
+        void add(size_t row, std::string_view text);
+        void remove(size_t row, std::string_view text);
+
+        // Shift the rows after one that's been removed down
+        void remove_row(size_t row);
+        void remove_first_rows(size_t count);
+
+        // Rows that could match a 'LIKE' pattern, in order. These still have to
+        // be checked against it. There are none when the pattern doesn't have
+        // three characters in a row without a wildcard, as it could be anywhere.
+        std::optional<std::vector<uint32_t>> candidates(std::string_view pattern) const;
+
+        // The most rows a pattern could match, without looking them up
+        std::optional<size_t> estimate_candidates(std::string_view pattern) const;
+
+        std::string serialize() const;
+        static std::optional<TrigramIndex> deserialize(const std::string&);
+
+    private:
+        // Each trigram is packed into the low three bytes
+        static std::vector<uint32_t> trigrams(std::string_view text);
+        static std::vector<uint32_t> pattern_trigrams(std::string_view pattern);
+
+        std::string m_column;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> m_rows;
+
+    };
+
+}
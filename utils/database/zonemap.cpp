@@ -0,0 +1,161 @@
+#include "zonemap.hpp"
+#include "entry.hpp"
+#include "chunk.hpp"
+#include "row.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+using namespace DB;
+
+ZoneMap::ZoneMap(const std::vector<Column> &columns)
+{
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        const auto &column = columns[i];
+        switch (column.data_type().primitive())
+        {
+            case DataType::Integer:
+            case DataType::BigInt:
+                m_ranges.push_back({ column.name(), i, Range {} });
+                break;
+            case DataType::Float:
+                m_ranges.push_back({ column.name(), i, Range { false, true } });
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void ZoneMap::add(const Row &row)
+{
+    auto range_it = m_ranges.begin();
+    size_t column_index = 0;
+    for (auto it = row.begin(); it != row.end() && range_it != m_ranges.end(); ++it, ++column_index)
+    {
+        if (range_it->column_index != column_index)
+            continue;
+
+        // NOTE: Null entries still compare by their stored data,
+        //       so they're included in the range
+        const auto *entry = (*it).second;
+        auto &range = range_it->range;
+        switch (entry->data_type().primitive())
+        {
+            case DataType::Integer:
+            case DataType::BigInt:
+            {
+                auto value = entry->data_type().primitive() == DataType::Integer
+                    ? (int64_t)static_cast<const IntegerEntry*>(entry)->data()
+                    : static_cast<const BigIntEntry*>(entry)->data();
+                range.min_int = range.has_values ? std::min(range.min_int, value) : value;
+                range.max_int = range.has_values ? std::max(range.max_int, value) : value;
+                break;
+            }
+            case DataType::Float:
+            {
+                double value = static_cast<const FloatEntry*>(entry)->data();
+                range.min_float = range.has_values ? std::min(range.min_float, value) : value;
+                range.max_float = range.has_values ? std::max(range.max_float, value) : value;
+                break;
+            }
+            default:
+                assert (false);
+        }
+
+        range.has_values = true;
+        ++range_it;
+    }
+}
+
+ZoneMap ZoneMap::of_range(const std::string &column_name, int64_t min, int64_t max)
+{
+    ZoneMap zone_map;
+    zone_map.m_ranges.push_back({ column_name, 0, Range { true, false, min, max } });
+    return zone_map;
+}
+
+const ZoneMap::Range *ZoneMap::range(const std::string &column_name) const
+{
+    for (const auto &column_range : m_ranges)
+    {
+        if (column_range.name == column_name)
+            return &column_range.range;
+    }
+
+    return nullptr;
+}
+
+size_t ZoneMap::write(Chunk &chunk, size_t offset) const
+{
+    auto start = offset;
+    chunk.write_byte(offset, m_ranges.size());
+    offset += 1;
+
+    for (const auto &column_range : m_ranges)
+    {
+        const auto &range = column_range.range;
+        chunk.write_byte(offset, column_range.column_index);
+        chunk.write_byte(offset + 1, range.has_values);
+        chunk.write_byte(offset + 2, range.is_float);
+        offset += 3;
+
+        if (range.is_float)
+        {
+            int64_t min, max;
+            memcpy(&min, &range.min_float, sizeof(double));
+            memcpy(&max, &range.max_float, sizeof(double));
+            chunk.write_long(offset, min);
+            chunk.write_long(offset + 8, max);
+        }
+        else
+        {
+            chunk.write_long(offset, range.min_int);
+            chunk.write_long(offset + 8, range.max_int);
+        }
+        offset += 16;
+    }
+
+    return offset - start;
+}
+
+ZoneMap ZoneMap::read(Chunk &chunk, size_t offset,
+    const std::vector<Column> &columns, size_t &size_out)
+{
+    auto start = offset;
+    ZoneMap zone_map;
+
+    auto range_count = chunk.read_byte(offset);
+    offset += 1;
+
+    for (size_t i = 0; i < range_count; i++)
+    {
+        ColumnRange column_range;
+        column_range.column_index = chunk.read_byte(offset);
+        column_range.range.has_values = chunk.read_byte(offset + 1);
+        column_range.range.is_float = chunk.read_byte(offset + 2);
+        offset += 3;
+
+        auto min = chunk.read_long(offset);
+        auto max = chunk.read_long(offset + 8);
+        offset += 16;
+
+        if (column_range.range.is_float)
+        {
+            memcpy(&column_range.range.min_float, &min, sizeof(double));
+            memcpy(&column_range.range.max_float, &max, sizeof(double));
+        }
+        else
+        {
+            column_range.range.min_int = min;
+            column_range.range.max_int = max;
+        }
+
+        assert (column_range.column_index < columns.size());
+        column_range.name = columns[column_range.column_index].name();
+        zone_map.m_ranges.push_back(std::move(column_range));
+    }
+
+    size_out = offset - start;
+    return zone_map;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "forward.hpp"
+#include "column.hpp"
+#include <string>
+#include <vector>
+
+namespace DB
+{
+
+    // The min and max of each numeric column in a chunk of row data,
+    // used to skip over whole chunks that can't match a condition.
+    // NOTE: Removed rows are not accounted for, so the ranges may be wider
+    //       than the data, but never narrower.
+    class ZoneMap
+    {
+    public:
+        struct Range
+        {
+            bool has_values { false };
+            bool is_float { false };
+            int64_t min_int { 0 };
+            int64_t max_int { 0 };
+            double min_float { 0 };
+            double max_float { 0 };
+        };
+
+        ZoneMap(const std::vector<Column> &columns);
+
+        // Only the range of one integer column, nothing is skipped on the others
+        static ZoneMap of_range(const std::string &column_name, int64_t min, int64_t max);
+
+        void add(const Row&);
+        const Range *range(const std::string &column_name) const;
+
+        size_t write(Chunk&, size_t offset) const;
+        static ZoneMap read(Chunk&, size_t offset,
+            const std::vector<Column> &columns, size_t &size_out);
+
+    private:
+        ZoneMap() = default;
+
+        struct ColumnRange
+        {
+            std::string name;
+            size_t column_index;
+            Range range;
+        };
+
+        std::vector<ColumnRange> m_ranges;
+
+    };
+
+}
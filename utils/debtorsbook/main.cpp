@@ -4,7 +4,6 @@
 #include <libconfig.hpp>
 #include <getopt.h>
 #include <ctime>
-#include <cassert>
 #include <unistd.h>
 #include <pwd.h>
 
@@ -32,6 +31,8 @@ static void add_new_debt(DB::DataBase &db, bool multi_mode)
     float owed_by_me = 0;
     float owed_by_them = 0;
 
+    // NOTE: In multi mode, debts are added together once they've all been entered
+    std::vector<std::vector<DB::Sql::Value>> debts;
     do
     {
 
@@ -70,23 +71,33 @@ static void add_new_debt(DB::DataBase &db, bool multi_mode)
                 break;
             std::cout << "\n";
         }
-        std::cout << "\nAdding debt\n";
-
-        // Add to database
         int64_t datetime = time(0);
         int id = rand();
-        auto result = db.execute_sql("INSERT INTO Debts (id, datetime, person, transaction, owedbyme, owedbythem) VALUES ("
-                       + std::to_string(id) + ", "
-                       + std::to_string(datetime) + ", "
-                       + "'" + name + "', "
-                       + "'" + transaction + "', "
-                       + std::to_string(owed_by_me) + ", "
-                       + std::to_string(owed_by_them) + ")");
+        debts.push_back({
+            DB::Sql::Value((int64_t)id),
+            DB::Sql::Value(datetime),
+            DB::Sql::Value(name),
+            DB::Sql::Value(transaction),
+            DB::Sql::Value(owed_by_me),
+            DB::Sql::Value(owed_by_them),
+        });
+
+        if (multi_mode)
+        {
+            std::cout << "Add another [y]: ";
+            std::getline(std::cin, buffer);
+            if (buffer == "n" || buffer == "N" || buffer == "no" || buffer == "No")
+                break;
+            std::cout << "\n";
+        }
+    } while (multi_mode);
 
-        if (!result.good())
-            result.output_errors();
+    std::cout << "\nAdding " << debts.size() << (debts.size() == 1 ? " debt\n" : " debts\n");
+    auto result = db.execute_many("INSERT INTO Debts (id, datetime, person, transaction, owedbyme, owedbythem) "
+                   "VALUES (?, ?, ?, ?, ?, ?)", debts);
 
-    } while (multi_mode);
+    if (!result.good())
+        result.output_errors();
 }
 
 static void print_report(DB::DataBase &db, const std::string &condition = "")
@@ -124,13 +135,6 @@ static void print_report(DB::DataBase &db, const std::string &condition = "")
 
 static std::optional<int> select_row(DB::DataBase &db)
 {
-    auto result = db.execute_sql("SELECT * FROM Debts");
-    if (!result.good())
-    {
-        result.output_errors();
-        return std::nullopt;
-    }
-
     std::string buffer;
     std::string name_filter;
     std::string transaction_filter;
@@ -171,6 +175,19 @@ static std::optional<int> select_row(DB::DataBase &db)
     std::vector<int> id_index;
     for (;;)
     {
+        // NOTE: An empty filter matches everything
+        auto result = db.execute_sql("SELECT * FROM Debts "
+            "WHERE (? = '' OR person = ?) AND (? = '' OR transaction = ?)",
+            {
+                DB::Sql::Value(name_filter), DB::Sql::Value(name_filter),
+                DB::Sql::Value(transaction_filter), DB::Sql::Value(transaction_filter),
+            });
+        if (!result.good())
+        {
+            result.output_errors();
+            return std::nullopt;
+        }
+
         int id = 0;
         id_index.clear();
         for (const auto &row : result)
@@ -179,12 +196,6 @@ static std::optional<int> select_row(DB::DataBase &db)
             auto transaction = row["transaction"]->as_string();
             auto amount_owed_by_me = row["owedbyme"]->as_float();
             auto amount_owed_by_them = row["owedbythem"]->as_float();
-            if ((!name_filter.empty() && name != name_filter)
-                || (!transaction_filter.empty() && transaction != transaction_filter))
-            {
-                continue;
-            }
-
             printf("%-3i: %-10s %-20s £%-5.2f £%-5.2f\n", id, name.c_str(),
                    transaction.c_str(), amount_owed_by_me, amount_owed_by_them);
             id_index.push_back(row["id"]->as_int());
@@ -306,7 +317,8 @@ int main(int argc, char *argv[])
     }
 
     auto db = DB::DataBase::open(Config::resolve_home_path(g_book));
-    assert (db);
+    if (!db)
+        return 1;
     setup_database(*db);
 
     switch (mode)